@@ -0,0 +1,515 @@
+//======================================================================
+//
+// bench_poly1305.c
+// ----------------
+// Throughput and latency benchmark for the C model. Measures
+// message sizes from 0 bytes to 64 kB, an IMIX packet size mix and
+// incremental updates in chunks of different sizes, for each of the
+// block kernels. Results are printed as a table and can be written
+// as JSON for tracking regressions.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "monocypher.h"
+#include "poly1305_service.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC 1
+#endif
+
+
+// Bytes MACed per measurement, and bounds on the number of calls.
+#define BENCH_BYTES     (64 * 1024 * 1024)
+#define BENCH_MIN_CALLS 2000
+#define BENCH_MAX_CALLS 200000
+
+#define MAX_MESSAGE (64 * 1024)
+#define NB_SIZES    14
+#define NB_CHUNKS   8
+
+static const size_t bench_sizes[NB_SIZES] = {
+  0, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096,
+  8192, 16384, 32768, 65536
+};
+
+// Update chunk sizes for the incremental case, 0 is one-shot.
+static const size_t bench_chunks[NB_CHUNKS] = {
+  0, 1, 16, 64, 100, 1024, 4096, 16384
+};
+
+// Simple IMIX, 7:4:1 packets of 40, 576 and 1500 bytes.
+#define IMIX_PACKETS 12
+static const size_t imix_sizes[IMIX_PACKETS] = {
+  40, 576, 40, 40, 1500, 40, 576, 40, 40, 576, 40, 576
+};
+
+
+//------------------------------------------------------------------
+// Result of one measurement.
+//------------------------------------------------------------------
+typedef struct {
+  const char *name;
+  size_t      size;     // message size, or chunk size
+  size_t      calls;
+  uint64_t    bytes;
+  double      seconds;
+  double      p50, p90, p99, p999; // per call latency in ns
+} bench_result;
+
+
+static uint8_t message[MAX_MESSAGE];
+static uint8_t key[32];
+static double  ticks_per_ns = 1.0;
+static int     quick = 0;
+
+
+//------------------------------------------------------------------
+// Timestamps. The TSC where there is one, calibrated against the
+// monotonic clock, otherwise the monotonic clock in ns.
+//------------------------------------------------------------------
+static uint64_t clock_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+}
+
+static inline uint64_t ticks(void)
+{
+#ifdef BENCH_TSC
+  return __rdtsc();
+#else
+  return clock_ns();
+#endif
+}
+
+static void calibrate(void)
+{
+#ifdef BENCH_TSC
+  uint64_t t0 = clock_ns();
+  uint64_t c0 = ticks();
+  while (clock_ns() - t0 < 100000000) {
+  }
+  uint64_t t1 = clock_ns();
+  uint64_t c1 = ticks();
+  ticks_per_ns = (double)(c1 - c0) / (double)(t1 - t0);
+#endif
+}
+
+
+//------------------------------------------------------------------
+// Percentiles of the per call samples, in ns.
+//------------------------------------------------------------------
+static int cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void percentiles(bench_result *res, uint64_t *samples, size_t n)
+{
+  qsort(samples, n, sizeof(uint64_t), cmp_u64);
+  res->p50  = (double)samples[n * 500 / 1000] / ticks_per_ns;
+  res->p90  = (double)samples[n * 900 / 1000] / ticks_per_ns;
+  res->p99  = (double)samples[n * 990 / 1000] / ticks_per_ns;
+  res->p999 = (double)samples[n * 999 / 1000] / ticks_per_ns;
+}
+
+
+static size_t nb_calls(size_t bytes_per_call)
+{
+  size_t n = BENCH_BYTES / (bytes_per_call ? bytes_per_call : 1);
+  if (n < BENCH_MIN_CALLS) { n = BENCH_MIN_CALLS; }
+  if (n > BENCH_MAX_CALLS) { n = BENCH_MAX_CALLS; }
+  return quick ? n / 10 : n;
+}
+
+
+//------------------------------------------------------------------
+// One MAC of size bytes, one-shot or in updates of chunk bytes.
+//------------------------------------------------------------------
+static void mac(uint8_t tag[16], size_t size, size_t chunk)
+{
+  if (chunk == 0) {
+    crypto_poly1305(tag, message, size, key);
+    return;
+  }
+
+  crypto_poly1305_ctx ctx;
+  crypto_poly1305_init(&ctx, key);
+  for (size_t i = 0 ; i < size ; i += chunk) {
+    crypto_poly1305_update(&ctx, message + i,
+                           size - i < chunk ? size - i : chunk);
+  }
+  crypto_poly1305_final(&ctx, tag);
+}
+
+
+//------------------------------------------------------------------
+// Time calls MACs of the given sizes, cycling through them, each
+// call on its own for the latency and the total for throughput.
+//------------------------------------------------------------------
+static void run(bench_result *res, const size_t *sizes, size_t nb_sizes,
+                size_t chunk, size_t calls)
+{
+  uint64_t *samples = malloc(calls * sizeof(uint64_t));
+  uint8_t   tag[16];
+  uint64_t  bytes = 0;
+
+  if (samples == NULL) {
+    fprintf(stderr, "bench_poly1305: out of memory\n");
+    exit(1);
+  }
+
+  // Warm up
+  for (size_t i = 0 ; i < calls / 10 + 1 ; i++) {
+    mac(tag, sizes[i % nb_sizes], chunk);
+  }
+
+  uint64_t start = clock_ns();
+  for (size_t i = 0 ; i < calls ; i++) {
+    size_t   size = sizes[i % nb_sizes];
+    uint64_t t0   = ticks();
+    mac(tag, size, chunk);
+    samples[i] = ticks() - t0;
+    bytes     += size;
+  }
+  uint64_t stop = clock_ns();
+
+  res->calls   = calls;
+  res->bytes   = bytes;
+  res->seconds = (double)(stop - start) / 1e9;
+  percentiles(res, samples, calls);
+  free(samples);
+}
+
+
+//------------------------------------------------------------------
+// Printing
+//------------------------------------------------------------------
+static double gbps(const bench_result *res)
+{
+  return res->seconds > 0.0 ? (double)res->bytes / res->seconds / 1e9 : 0.0;
+}
+
+static double cpb(const bench_result *res)
+{
+  if (res->bytes == 0) {
+    return 0.0;
+  }
+  return res->seconds * 1e9 * ticks_per_ns / (double)res->bytes;
+}
+
+static void print_header(const char *what)
+{
+  printf("%-10s %8s %9s %8s %8s %9s %9s %9s %9s\n", what, "size", "calls",
+         "GB/s", "cpb", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns");
+}
+
+static void print_result(const bench_result *res)
+{
+  printf("%-10s %8zu %9zu %8.3f %8.2f %9.0f %9.0f %9.0f %9.0f\n",
+         res->name, res->size, res->calls, gbps(res), cpb(res),
+         res->p50, res->p90, res->p99, res->p999);
+}
+
+static void json_result(FILE *f, const bench_result *res, int last)
+{
+  fprintf(f, "        {\"name\": \"%s\", \"size\": %zu, \"calls\": %zu, "
+          "\"bytes\": %llu, \"seconds\": %.6f, \"gbps\": %.4f, "
+          "\"cpb\": %.3f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, "
+          "\"p99_ns\": %.1f, \"p999_ns\": %.1f}%s\n",
+          res->name, res->size, res->calls,
+          (unsigned long long)res->bytes, res->seconds, gbps(res), cpb(res),
+          res->p50, res->p90, res->p99, res->p999, last ? "" : ",");
+}
+
+
+//------------------------------------------------------------------
+// Benchmark the active kernel, and add it to the JSON file.
+//------------------------------------------------------------------
+static void bench_kernel(FILE *json, int first_kernel)
+{
+  const char  *kernel = crypto_poly1305_active_kernel();
+  bench_result sizes[NB_SIZES];
+  bench_result chunks[NB_CHUNKS];
+  bench_result imix;
+
+  printf("Kernel: %s\n", kernel);
+  print_header("sizes");
+  for (size_t i = 0 ; i < NB_SIZES ; i++) {
+    sizes[i].name = "oneshot";
+    sizes[i].size = bench_sizes[i];
+    run(&sizes[i], &bench_sizes[i], 1, 0, nb_calls(bench_sizes[i]));
+    print_result(&sizes[i]);
+  }
+
+  print_header("imix");
+  imix.name = "imix";
+  imix.size = 0;
+  run(&imix, imix_sizes, IMIX_PACKETS, 0, nb_calls(340));
+  print_result(&imix);
+
+  print_header("chunks");
+  for (size_t i = 0 ; i < NB_CHUNKS ; i++) {
+    size_t size     = MAX_MESSAGE;
+    chunks[i].name  = bench_chunks[i] ? "update" : "oneshot";
+    chunks[i].size  = bench_chunks[i];
+    run(&chunks[i], &size, 1, bench_chunks[i],
+        nb_calls(bench_chunks[i] == 1 ? size * 16 : size));
+    print_result(&chunks[i]);
+  }
+  printf("\n");
+
+  if (json == NULL) {
+    return;
+  }
+  fprintf(json, "%s    {\n      \"kernel\": \"%s\",\n",
+          first_kernel ? "" : ",\n", kernel);
+  fprintf(json, "      \"sizes\": [\n");
+  for (size_t i = 0 ; i < NB_SIZES ; i++) {
+    json_result(json, &sizes[i], i + 1 == NB_SIZES);
+  }
+  fprintf(json, "      ],\n      \"imix\": [\n");
+  json_result(json, &imix, 1);
+  fprintf(json, "      ],\n      \"chunks\": [\n");
+  for (size_t i = 0 ; i < NB_CHUNKS ; i++) {
+    json_result(json, &chunks[i], i + 1 == NB_CHUNKS);
+  }
+  fprintf(json, "      ]\n    }");
+}
+
+
+//------------------------------------------------------------------
+// Scaling of poly1305_service with the number of workers, on IMIX
+// traffic with one large message every SERVICE_LARGE_EVERY.
+//------------------------------------------------------------------
+#define SERVICE_MESSAGES    100000
+#define SERVICE_LARGE       (1024 * 1024)
+#define SERVICE_LARGE_EVERY 1000
+
+static void bench_service(FILE *json)
+{
+  size_t   nb_messages = quick ? SERVICE_MESSAGES / 10 : SERVICE_MESSAGES;
+  uint8_t *large       = malloc(SERVICE_LARGE);
+  uint8_t *macs        = malloc(nb_messages * 16);
+  size_t  *sizes       = malloc(nb_messages * sizeof(size_t));
+  if (large == NULL || macs == NULL || sizes == NULL) {
+    fprintf(stderr, "bench_poly1305: out of memory\n");
+    exit(1);
+  }
+  uint64_t total = 0;
+  for (size_t i = 0 ; i < SERVICE_LARGE ; i++) {
+    large[i] = (uint8_t)(i * 11 + 1);
+  }
+  for (size_t i = 0 ; i < nb_messages ; i++) {
+    sizes[i] = i % SERVICE_LARGE_EVERY == SERVICE_LARGE_EVERY - 1
+             ? SERVICE_LARGE : imix_sizes[i % IMIX_PACKETS];
+    total += sizes[i];
+  }
+
+  long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nproc < 1) {
+    nproc = 1;
+  }
+
+  printf("Service: %zu messages, %.1f MB, %ld CPUs\n",
+         nb_messages, (double)total / 1e6, nproc);
+  printf("%8s %12s %8s\n", "workers", "msg/s", "GB/s");
+  if (json != NULL) {
+    fprintf(json, "  \"service\": [\n");
+  }
+
+  for (long workers = 1 ; ; workers *= 2) {
+    if (workers > nproc) {
+      workers = nproc;
+    }
+    poly1305_service *svc = poly1305_service_create((unsigned)workers);
+    if (svc == NULL) {
+      fprintf(stderr, "bench_poly1305: cannot start %ld workers\n",
+              workers);
+      exit(1);
+    }
+    uint64_t t0 = clock_ns();
+    for (size_t i = 0 ; i < nb_messages ; i++) {
+      const uint8_t *msg = sizes[i] == SERVICE_LARGE ? large : message;
+      if (poly1305_service_submit(svc, macs + i * 16, msg, sizes[i],
+                                  key, NULL, NULL) != 0) {
+        fprintf(stderr, "bench_poly1305: submit failed\n");
+        exit(1);
+      }
+    }
+    poly1305_service_drain(svc);
+    uint64_t t1 = clock_ns();
+    poly1305_service_destroy(svc);
+
+    double seconds = (double)(t1 - t0) / 1e9;
+    double msgs    = (double)nb_messages / seconds;
+    double rate    = (double)total / seconds / 1e9;
+    printf("%8ld %12.0f %8.3f\n", workers, msgs, rate);
+    if (json != NULL) {
+      fprintf(json, "    { \"workers\": %ld, \"messages\": %zu, "
+              "\"bytes\": %" PRIu64 ", \"seconds\": %.6f, "
+              "\"msg_per_s\": %.0f, \"gbps\": %.4f }%s\n",
+              workers, nb_messages, total, seconds, msgs, rate,
+              workers == nproc ? "" : ",");
+    }
+    if (workers == nproc) {
+      break;
+    }
+  }
+  printf("\n");
+  if (json != NULL) {
+    fprintf(json, "  ],\n");
+  }
+
+  free(large);
+  free(macs);
+  free(sizes);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static void usage(void)
+{
+  fprintf(stderr,
+          "usage: bench_poly1305 [-a] [-k kernel] [-j file.json] [-q] [-s]\n"
+          "  -a         benchmark all kernels usable on this machine\n"
+          "  -k kernel  benchmark the given kernel only\n"
+          "  -j file    also write the results as JSON to file\n"
+          "  -q         quick run, a tenth of the calls\n"
+          "  -s         also measure poly1305_service scaling\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *kernel    = NULL;
+  const char *json_name = NULL;
+  int         all       = 0;
+  int         service   = 0;
+  int         opt;
+
+  while ((opt = getopt(argc, argv, "ak:j:qs")) != -1) {
+    switch (opt) {
+    case 'a': all       = 1;      break;
+    case 'k': kernel    = optarg; break;
+    case 'j': json_name = optarg; break;
+    case 'q': quick     = 1;      break;
+    case 's': service   = 1;      break;
+    default:  usage();            return 2;
+    }
+  }
+
+  for (size_t i = 0 ; i < MAX_MESSAGE ; i++) {
+    message[i] = (uint8_t)(i * 7 + 3);
+  }
+  for (size_t i = 0 ; i < 32 ; i++) {
+    key[i] = (uint8_t)(i * 13 + 5);
+  }
+
+  // Kernels to run, the active one unless asked otherwise.
+  const char *kernels[16];
+  size_t      nb_kernels = 0;
+  if (all) {
+    for (size_t i = 0 ; crypto_poly1305_kernel_name(i) != NULL &&
+                        nb_kernels < 16 ; i++) {
+      kernels[nb_kernels++] = crypto_poly1305_kernel_name(i);
+    }
+  }
+  else if (kernel != NULL) {
+    kernels[nb_kernels++] = kernel;
+  }
+  else {
+    kernels[nb_kernels++] = crypto_poly1305_active_kernel();
+  }
+
+  FILE *json = NULL;
+  if (json_name != NULL) {
+    json = fopen(json_name, "w");
+    if (json == NULL) {
+      perror(json_name);
+      return 1;
+    }
+  }
+
+  calibrate();
+  printf("Timer: %.3f ticks per ns%s\n\n", ticks_per_ns,
+#ifdef BENCH_TSC
+         " (TSC)"
+#else
+         " (clock_gettime)"
+#endif
+         );
+
+  if (json != NULL) {
+    fprintf(json, "{\n  \"ticks_per_ns\": %.4f,\n  \"quick\": %d,\n",
+            ticks_per_ns, quick);
+  }
+  if (service) {
+    bench_service(json);
+  }
+  if (json != NULL) {
+    fprintf(json, "  \"kernels\": [\n");
+  }
+
+  int status = 0;
+  int first  = 1;
+  for (size_t i = 0 ; i < nb_kernels ; i++) {
+    if (crypto_poly1305_select_kernel(kernels[i]) != 0) {
+      fprintf(stderr, "bench_poly1305: kernel %s not usable here\n",
+              kernels[i]);
+      status = 1;
+      continue;
+    }
+    bench_kernel(json, first);
+    first = 0;
+  }
+
+  if (json != NULL) {
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+  }
+  return status;
+}
+
+//======================================================================
+// EOF bench_poly1305.c
+//======================================================================
@@ -1,5 +1,11 @@
 #include "monocypher.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 /////////////////
 /// Utilities ///
@@ -18,6 +24,55 @@ typedef int32_t  i32;
 typedef int64_t  i64;
 typedef uint64_t u64;
 
+// Non-temporal stores for crypto_poly1305_update_copy().
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define POLY1305_COPY_NT
+#include <emmintrin.h>
+#endif
+
+// The radix 2^44 block kernel needs 128 bit products. It is not
+// used in the traced build, see poly_blocks().
+#if defined(__SIZEOF_INT128__) && !defined(POLY1305_TRACE) \
+    && !defined(POLY1305_NO_RADIX44)
+#define POLY1305_RADIX44
+__extension__ typedef unsigned __int128 u128;
+#endif
+
+// The portable four block kernel only needs 32x32 bit multiplies.
+#if !defined(POLY1305_TRACE) && !defined(POLY1305_NO_SCALAR4)
+#define POLY1305_SCALAR4
+// Runs shorter than this, before the powers of r are computed, are
+// left to poly_block().
+#ifndef POLY1305_SCALAR4_COLD_BLOCKS
+#define POLY1305_SCALAR4_COLD_BLOCKS 64
+#endif
+#endif
+
+// The AVX2 kernel is compiled on x86 with GCC or Clang and used if
+// the CPU supports it. Calls with fewer blocks than the threshold
+// are left to the scalar kernel.
+#if (defined(__x86_64__) || defined(__i386__))                   \
+    && (defined(__GNUC__) || defined(__clang__))                  \
+    && !defined(POLY1305_TRACE) && !defined(POLY1305_NO_AVX2)
+#define POLY1305_AVX2
+#include <cpuid.h>
+#include <immintrin.h>
+#ifndef POLY1305_AVX2_MIN_BLOCKS
+#define POLY1305_AVX2_MIN_BLOCKS 16
+#endif
+// The threshold when r^1..r^8 are not computed yet, which costs as
+// much as a few blocks. Every update of a flow of poly1305_flow
+// starts that way.
+#ifndef POLY1305_AVX2_COLD_BLOCKS
+#define POLY1305_AVX2_COLD_BLOCKS 20
+#endif
+// Messages of the batch interface longer than this are faster with
+// the AVX2 kernel on their own than in a lane.
+#ifndef POLY1305_BATCH_MAX_BLOCKS
+#define POLY1305_BATCH_MAX_BLOCKS 96
+#endif
+#endif
+
 static u32 load32_le(u8 s[4])
 {
     return (u32)s[0]
@@ -26,6 +81,13 @@ static u32 load32_le(u8 s[4])
         | ((u32)s[3] << 24);
 }
 
+#ifdef POLY1305_RADIX44
+static u64 load64_le(u8 s[8])
+{
+    return (u64)load32_le(s) | ((u64)load32_le(s + 4) << 32);
+}
+#endif
+
 static void store32_le(u8 out[4], u32 in)
 {
     out[0] =  in        & 0xff;
@@ -36,10 +98,26 @@ static void store32_le(u8 out[4], u32 in)
 
 void crypto_wipe(void *secret, size_t size)
 {
+#if defined(__GNUC__) || defined(__clang__)
+    // memset() at full speed, and an empty asm statement claiming to
+    // read the buffer so the compiler cannot drop the stores.
+    memset(secret, 0, size);
+    __asm__ __volatile__("" : : "r"(secret) : "memory");
+#else
     volatile u8 *v_secret = (u8*)secret;
     FOR (i, 0, size) {
         v_secret[i] = 0;
     }
+#endif
+}
+
+int crypto_verify16(const u8 a[16], const u8 b[16])
+{
+    u32 diff = 0;
+    FOR (i, 0, 16) {
+        diff |= a[i] ^ b[i];
+    }
+    return (1 & ((diff - 1) >> 8)) - 1;
 }
 
 
@@ -79,6 +157,113 @@ void print_context(crypto_poly1305_ctx *ctx) {
 }
 
 
+///////////////
+/// Tracing ///
+///////////////
+
+// When built with POLY1305_TRACE defined all TRACE* macros below
+// are routed through the currently installed trace hooks. In the
+// release build they expand to nothing and the arguments are never
+// evaluated, so the model runs at full speed.
+#ifdef POLY1305_TRACE
+static void trace_print_text(const char *fmt, va_list ap)
+{
+  vprintf(fmt, ap);
+}
+
+static void trace_print_hexdata(const uint8_t *data, size_t len)
+{
+  print_hexdata((uint8_t *)data, (uint32_t)len);
+}
+
+static void trace_print_context(const crypto_poly1305_ctx *ctx)
+{
+  print_context((crypto_poly1305_ctx *)ctx);
+}
+
+const crypto_poly1305_trace_hooks crypto_poly1305_trace_print = {
+  trace_print_text,
+  trace_print_hexdata,
+  trace_print_context,
+  NULL,
+};
+
+static const crypto_poly1305_trace_hooks *trace_hooks =
+  &crypto_poly1305_trace_print;
+
+void crypto_poly1305_set_trace_hooks(const crypto_poly1305_trace_hooks *hooks)
+{
+  trace_hooks = hooks;
+}
+
+__attribute__((format(printf, 1, 2)))
+static void trace_text(const char *fmt, ...)
+{
+  if (trace_hooks && trace_hooks->text) {
+    va_list ap;
+    va_start(ap, fmt);
+    trace_hooks->text(fmt, ap);
+    va_end(ap);
+  }
+}
+
+static void trace_hexdata(const u8 *data, size_t len)
+{
+  if (trace_hooks && trace_hooks->hexdata) {
+    trace_hooks->hexdata(data, len);
+  }
+}
+
+static void trace_context(const crypto_poly1305_ctx *ctx)
+{
+  if (trace_hooks && trace_hooks->context) {
+    trace_hooks->context(ctx);
+  }
+}
+
+static void trace_record(int kind, const u64 *values, size_t nb_values)
+{
+  if (trace_hooks && trace_hooks->record) {
+    trace_hooks->record(kind, values, nb_values);
+  }
+}
+
+#define TRACE(...)           trace_text(__VA_ARGS__)
+#define TRACE_HEX(data, len) trace_hexdata(data, len)
+#define TRACE_CTX(ctx)       trace_context(ctx)
+#define TRACE_REC(kind, ...)                                    \
+  do {                                                          \
+    const u64 trace_values_[] = { __VA_ARGS__ };                \
+    trace_record(kind, trace_values_,                           \
+                 sizeof(trace_values_) / sizeof(u64));          \
+  } while (0)
+#else
+#define TRACE(...)           do {} while (0)
+#define TRACE_HEX(data, len) do {} while (0)
+#define TRACE_CTX(ctx)       do {} while (0)
+#define TRACE_REC(kind, ...) do {} while (0)
+#endif
+
+
+//------------------------------------------------------------------
+// Performance counters.
+//
+// With POLY1305_PERF defined the block kernels, the update bulk
+// path and the batch interface are measured with the counters in
+// poly1305_perf.c. Otherwise the macros expand to nothing.
+//------------------------------------------------------------------
+#ifdef POLY1305_PERF
+#include "poly1305_perf.h"
+#define PERF_SAMPLE(sample)      poly1305_perf_sample sample
+#define PERF_BEGIN(sample)       poly1305_perf_begin(&(sample))
+#define PERF_END(sample, k, n)   poly1305_perf_end(&(sample), k, n)
+#else
+#define PERF_SAMPLE(sample)      do {} while (0)
+#define PERF_BEGIN(sample)       do {} while (0)
+#define PERF_END(sample, k, n)   do {} while (0)
+#endif
+
+
 //------------------------------------------------------------------
 // poly_block()
 // h = (h + c) * r
@@ -91,13 +276,13 @@ void print_context(crypto_poly1305_ctx *ctx) {
 //------------------------------------------------------------------
 static void poly_block(crypto_poly1305_ctx *ctx)
 {
-  printf("\n");
-  printf("poly_block started\n");
-  printf("------------------\n");
-  printf("poly_block: Context before processing:\n");
-  print_context(ctx);
+  TRACE("\n");
+  TRACE("poly_block started\n");
+  TRACE("------------------\n");
+  TRACE("poly_block: Context before processing:\n");
+  TRACE_CTX(ctx);
 
-  printf("poly_block: Intermediate results during processing:\n");
+  TRACE("poly_block: Intermediate results during processing:\n");
   // s = h + c, without carry propagation
   u64 s0 = ctx->h[0] + (u64)ctx->c[0]; // s0 <= 1_fffffffe
   u64 s1 = ctx->h[1] + (u64)ctx->c[1]; // s1 <= 1_fffffffe
@@ -105,23 +290,23 @@ static void poly_block(crypto_poly1305_ctx *ctx)
   u64 s3 = ctx->h[3] + (u64)ctx->c[3]; // s3 <= 1_fffffffe
   u32 s4 = ctx->h[4] +      ctx->c[4]; // s4 <=          5
 
-  printf("s0  = 0x%016llx, s1  = 0x%016llx, s2  = 0x%016llx\n", s0, s1, s2);
-  printf("s3  = 0x%016llx, s4  = 0x%016x\n", s3, s4);
-  printf("\n");
+  TRACE("s0  = 0x%016" PRIx64 ", s1  = 0x%016" PRIx64 ", s2  = 0x%016" PRIx64 "\n", s0, s1, s2);
+  TRACE("s3  = 0x%016" PRIx64 ", s4  = 0x%016x\n", s3, s4);
+  TRACE("\n");
 
   // Local all the things!
   u32 r0 = ctx->r[0];       // r0  <= 0fffffff
   u32 r1 = ctx->r[1];       // r1  <= 0ffffffc
   u32 r2 = ctx->r[2];       // r2  <= 0ffffffc
   u32 r3 = ctx->r[3];       // r3  <= 0ffffffc
-  u32 rr0 = (r0 >> 2) * 5;  // rr0 <= 13fffffb // lose 2 bits...
-  u32 rr1 = (r1 >> 2) + r1; // rr1 <= 13fffffb // rr1 == (r1 >> 2) * 5
-  u32 rr2 = (r2 >> 2) + r2; // rr2 <= 13fffffb // rr1 == (r2 >> 2) * 5
-  u32 rr3 = (r3 >> 2) + r3; // rr3 <= 13fffffb // rr1 == (r3 >> 2) * 5
+  u32 rr0 = ctx->rr[0];     // rr0 <= 13fffffb // lose 2 bits...
+  u32 rr1 = ctx->rr[1];     // rr1 <= 13fffffb // rr1 == (r1 >> 2) * 5
+  u32 rr2 = ctx->rr[2];     // rr2 <= 13fffffb // rr1 == (r2 >> 2) * 5
+  u32 rr3 = ctx->rr[3];     // rr3 <= 13fffffb // rr1 == (r3 >> 2) * 5
 
-  printf("rr0 = 0x%016x, rr1 = 0x%016x, rr2 = 0x%016x, rr3 = 0x%016x\n",
+  TRACE("rr0 = 0x%016x, rr1 = 0x%016x, rr2 = 0x%016x, rr3 = 0x%016x\n",
          rr0, rr1, rr2, rr3);
-  printf("\n");
+  TRACE("\n");
 
   // (h + c) * r, without carry propagation
   u64 x0 = s0*r0 + s1*rr3 + s2*rr2 + s3*rr1 + s4*rr0; // <= 97ffffe007fffff8
@@ -130,9 +315,9 @@ static void poly_block(crypto_poly1305_ctx *ctx)
   u64 x3 = s0*r3 + s1*r2  + s2*r1  + s3*r0  + s4*rr3; // <= 7fffffe61ffffff2
   u32 x4 = s4 * (r0 & 3); // ...recover 2 bits        // <=                f
 
-  printf("x0  = 0x%016llx, x1  = 0x%016llx, x2  = 0x%016llx\n", x0, x1, x2);
-  printf("x3  = 0x%016llx, x4  = 0x%016x\n", x3, x4);
-  printf("\n");
+  TRACE("x0  = 0x%016" PRIx64 ", x1  = 0x%016" PRIx64 ", x2  = 0x%016" PRIx64 "\n", x0, x1, x2);
+  TRACE("x3  = 0x%016" PRIx64 ", x4  = 0x%016x\n", x3, x4);
+  TRACE("\n");
 
   // partial reduction modulo 2^130 - 5
   u32 u5 = x4 + (x3 >> 32); // u5 <= 7ffffff5
@@ -142,9 +327,13 @@ static void poly_block(crypto_poly1305_ctx *ctx)
   u64 u3 = (u2 >> 32)     + (x3 & 0xffffffff) + (x2 >> 32);
   u64 u4 = (u3 >> 32)     + (u5 & 3);
 
-  printf("u0  = 0x%016llx, u1  = 0x%016llx, u2  = 0x%016llx\n", u0, u1, u2);
-  printf("u3  = 0x%016llx, u4  = 0x%016llx, u5  = 0x%016x\n", u3, u4, u5);
-  printf("\n");
+  TRACE("u0  = 0x%016" PRIx64 ", u1  = 0x%016" PRIx64 ", u2  = 0x%016" PRIx64 "\n", u0, u1, u2);
+  TRACE("u3  = 0x%016" PRIx64 ", u4  = 0x%016" PRIx64 ", u5  = 0x%016x\n", u3, u4, u5);
+  TRACE("\n");
+
+  TRACE_REC(CRYPTO_POLY1305_TRACE_BLOCK,
+            s0, s1, s2, s3, s4, rr0, rr1, rr2, rr3,
+            x0, x1, x2, x3, x4, u0, u1, u2, u3, u4, u5);
 
   // Update the hash
   ctx->h[0] = u0 & 0xffffffff; // u0 <= 1_9ffffff0
@@ -153,12 +342,626 @@ static void poly_block(crypto_poly1305_ctx *ctx)
   ctx->h[3] = u3 & 0xffffffff; // u3 <= 1_87ffffe4
   ctx->h[4] = (u32)u4;         // u4 <=          4
 
-  printf("\n");
-  printf("poly_block: Context after processing:\n");
-  print_context(ctx);
-  printf("poly_block completed\n");
-  printf("--------------------\n");
-  printf("\n");
+  TRACE("\n");
+  TRACE("poly_block: Context after processing:\n");
+  TRACE_CTX(ctx);
+  TRACE("poly_block completed\n");
+  TRACE("--------------------\n");
+  TRACE("\n");
+}
+
+
+//------------------------------------------------------------------
+// poly_blocks_32()
+// Process nb_blocks full message blocks, one poly_block() per block.
+// This is the reference kernel matching the RTL datapath.
+//------------------------------------------------------------------
+static void poly_blocks_32(crypto_poly1305_ctx *ctx,
+                           u8 *message, size_t nb_blocks)
+{
+  FOR (i, 0, nb_blocks) {
+    TRACE("poly_blocks_32: Processing block %zu\n", i);
+    FOR (j, 0, 4) {
+      ctx->c[j] = load32_le(message +  j*4);
+    }
+    TRACE("poly_blocks_32: Calling poly_block with block le32-loaded into ctx->c:\n");
+    poly_block(ctx);
+    message += 16;
+  }
+}
+
+
+#ifdef POLY1305_RADIX44
+//------------------------------------------------------------------
+// poly_blocks_44()
+// Process nb_blocks full message blocks using three limbs of
+// 44, 44 and 42 bits with 128 bit partial products. This needs
+// 9 multiplies per block instead of 20 in poly_block().
+//
+// The hash is converted from and back to the five 32 bit limbs
+// in the context, so the kernel can be mixed freely with
+// poly_block() on the same context.
+// preconditions:
+//   ctx->h <= 4_ffffffff_ffffffff_ffffffff_ffffffff
+// Postcondition:
+//   ctx->h <= 4_ffffffff_ffffffff_ffffffff_ffffffff
+//------------------------------------------------------------------
+static void poly_blocks_44(crypto_poly1305_ctx *ctx,
+                           u8 *message, size_t nb_blocks)
+{
+  const u64 mask44 = 0xfffffffffff;
+  const u64 mask42 = 0x3ffffffffff;
+
+  // r in radix 2^44
+  u64 t0 = ctx->r[0] | ((u64)ctx->r[1] << 32);
+  u64 t1 = ctx->r[2] | ((u64)ctx->r[3] << 32);
+  u64 r0 =   t0                      & mask44; // r0 <= 0ffc0fffffff
+  u64 r1 = ((t0 >> 44) | (t1 << 20)) & mask44; // r1 <= 0fffffc0ffff
+  u64 r2 =  (t1 >> 24)               & mask42; // r2 <= 00ffffffc0f
+  u64 s1 = r1 * (5 << 2);                     // 2^132 == 5*4 mod p
+  u64 s2 = r2 * (5 << 2);
+
+  // h in radix 2^44
+  u64 g0 = ctx->h[0] | ((u64)ctx->h[1] << 32);
+  u64 g1 = ctx->h[2] | ((u64)ctx->h[3] << 32);
+  u64 h0 =   g0                      & mask44;
+  u64 h1 = ((g0 >> 44) | (g1 << 20)) & mask44;
+  u64 h2 =  (g1 >> 24) | ((u64)ctx->h[4] << 40); // h2 <= 4_ffffffffff
+
+  FOR (i, 0, nb_blocks) {
+    u64 m0 = load64_le(message    );
+    u64 m1 = load64_le(message + 8);
+
+    // h += m, with 2^128 added to every block
+    h0 +=   m0                      & mask44;
+    h1 += ((m0 >> 44) | (m1 << 20)) & mask44;
+    h2 += ((m1 >> 24) & mask42) | ((u64)1 << 40);
+
+    // h * r, without carry propagation
+    u128 d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+    u128 d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+    u128 d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+    // partial reduction modulo 2^130 - 5
+    u64 c;
+    c = (u64)(d0 >> 44);  h0 = (u64)d0 & mask44;  d1 += c;
+    c = (u64)(d1 >> 44);  h1 = (u64)d1 & mask44;  d2 += c;
+    c = (u64)(d2 >> 42);  h2 = (u64)d2 & mask42;
+    h0 += c * 5;
+    c = h0 >> 44;         h0 &= mask44;           h1 += c;
+
+    message += 16;
+  }
+
+  // h1 may have one bit too many, carry it into h2 before packing
+  h2 += h1 >> 44;
+  h1 &= mask44;
+
+  // Back to radix 2^32
+  g0 =  h0        | (h1 << 44);
+  g1 = (h1 >> 20) | (h2 << 24);
+  ctx->h[0] = (u32)g0;
+  ctx->h[1] = (u32)(g0 >> 32);
+  ctx->h[2] = (u32)g1;
+  ctx->h[3] = (u32)(g1 >> 32);
+  ctx->h[4] = (u32)(h2 >> 40);    // h2 <= 4_00000000000
+}
+#endif // POLY1305_RADIX44
+
+
+//------------------------------------------------------------------
+// Radix 2^26 helpers.
+// 130 bit values are held in five 26 bit limbs. Unlike poly_block()
+// the multiplication does not depend on the clamping of r, so it
+// can be used with powers of r.
+//------------------------------------------------------------------
+static void poly26_from32(u32 out[5], const u32 in[5])
+{
+  out[0] =   in[0]                       & 0x3ffffff;
+  out[1] = ((in[0] >> 26) | (in[1] <<  6)) & 0x3ffffff;
+  out[2] = ((in[1] >> 20) | (in[2] << 12)) & 0x3ffffff;
+  out[3] = ((in[2] >> 14) | (in[3] << 18)) & 0x3ffffff;
+  out[4] =  (in[3] >>  8) | (in[4] << 24); // <= 4_ffffff
+}
+
+// in: limbs <= 2^32. out <= 4_ffffffff_ffffffff_ffffffff_ffffffff
+//
+// After the last carry l1 can be 2^26, one bit more than its limb.
+// The words are therefore summed, not or-ed, so that bit carries
+// into the next limb instead of being lost.
+static void poly26_to32(u32 out[5], const u64 in[5])
+{
+  u64 l0 = in[0], l1 = in[1], l2 = in[2], l3 = in[3], l4 = in[4];
+  l1 += l0 >> 26;  l0 &= 0x3ffffff;
+  l2 += l1 >> 26;  l1 &= 0x3ffffff;
+  l3 += l2 >> 26;  l2 &= 0x3ffffff;
+  l4 += l3 >> 26;  l3 &= 0x3ffffff;
+  l0 += (l4 >> 26) * 5;  l4 &= 0x3ffffff;
+  l1 += l0 >> 26;  l0 &= 0x3ffffff;     // l1 <= 2^26
+
+  u64 w;
+  w = l0         + (l1 << 26);  out[0] = (u32)w;
+  w = (w >> 32)  + (l2 << 20);  out[1] = (u32)w;
+  w = (w >> 32)  + (l3 << 14);  out[2] = (u32)w;
+  w = (w >> 32)  + (l4 <<  8);  out[3] = (u32)w;
+  out[4] = (u32)(w >> 32);
+}
+
+// out = a * b, partially reduced modulo 2^130 - 5.
+// a, b limbs <= 2^27, out limbs <= 2^26 except out[1] <= 2^26 + 2^11
+static void poly26_mul(u32 out[5], const u32 a[5], const u32 b[5])
+{
+  u64 s1 = b[1] * 5, s2 = b[2] * 5, s3 = b[3] * 5, s4 = b[4] * 5;
+  u64 d0 = (u64)a[0]*b[0] + a[1]*s4    + a[2]*s3    + a[3]*s2    + a[4]*s1;
+  u64 d1 = (u64)a[0]*b[1] + (u64)a[1]*b[0] + a[2]*s4 + a[3]*s3   + a[4]*s2;
+  u64 d2 = (u64)a[0]*b[2] + (u64)a[1]*b[1] + (u64)a[2]*b[0] + a[3]*s4
+         + a[4]*s3;
+  u64 d3 = (u64)a[0]*b[3] + (u64)a[1]*b[2] + (u64)a[2]*b[1]
+         + (u64)a[3]*b[0] + a[4]*s4;
+  u64 d4 = (u64)a[0]*b[4] + (u64)a[1]*b[3] + (u64)a[2]*b[2]
+         + (u64)a[3]*b[1] + (u64)a[4]*b[0];
+
+  d1 += d0 >> 26;  d0 &= 0x3ffffff;
+  d2 += d1 >> 26;  d1 &= 0x3ffffff;
+  d3 += d2 >> 26;  d2 &= 0x3ffffff;
+  d4 += d3 >> 26;  d3 &= 0x3ffffff;
+  d0 += (d4 >> 26) * 5;  d4 &= 0x3ffffff;
+  d1 += d0 >> 26;  d0 &= 0x3ffffff;
+
+  out[0] = (u32)d0;
+  out[1] = (u32)d1;
+  out[2] = (u32)d2;
+  out[3] = (u32)d3;
+  out[4] = (u32)d4;
+}
+
+
+// out = a^e, e >= 0
+static void poly26_pow(u32 out[5], const u32 a[5], u64 e)
+{
+  u32 base[5] = {a[0], a[1], a[2], a[3], a[4]};
+  u32 acc [5] = {1, 0, 0, 0, 0};
+  while (e > 0) {
+    if (e & 1) {
+      poly26_mul(acc, acc, base);
+    }
+    poly26_mul(base, base, base);
+    e >>= 1;
+  }
+  FOR (i, 0, 5) { out[i] = acc[i]; }
+  WIPE_BUFFER(base);
+  WIPE_BUFFER(acc);
+}
+
+
+//------------------------------------------------------------------
+// poly_rr()
+// rr = (r >> 2) * 5, the multiples of r used by poly_block().
+//------------------------------------------------------------------
+static void poly_rr(u32 rr[4], const u32 r[4])
+{
+  rr[0] = (r[0] >> 2) * 5;
+  FOR (i, 1, 4) {
+    rr[i] = (r[i] >> 2) + r[i];
+  }
+}
+
+
+//------------------------------------------------------------------
+// poly_rpow()
+// Compute r^1..r^8 in radix 2^26 for the multi-block kernels.
+//------------------------------------------------------------------
+static void poly_rpow(u32 rpow[8][5], const u32 r[4])
+{
+  u32 r5[5] = {r[0], r[1], r[2], r[3], 0};
+  poly26_from32(rpow[0], r5);
+  FOR (i, 1, 8) {
+    poly26_mul(rpow[i], rpow[i - 1], rpow[0]);
+  }
+  WIPE_BUFFER(r5);
+}
+
+
+#ifdef POLY1305_SCALAR4
+//------------------------------------------------------------------
+// d += (m + 2^128) * p, without carry propagation, with m a message
+// block split into 26 bit limbs on the fly. h is added to the block
+// when given. ps holds the limbs 1..4 of p times 5.
+// m + h limbs < 2^28, p limbs <= 2^26 + 2^11.
+//------------------------------------------------------------------
+static inline void poly26_block_mul_acc(u64 d[5], const u8 *message,
+                                        const u32 *h, const u32 p[5],
+                                        const u32 ps[5])
+{
+  u32 t0 = load32_le((u8 *)message     );
+  u32 t1 = load32_le((u8 *)message +  4);
+  u32 t2 = load32_le((u8 *)message +  8);
+  u32 t3 = load32_le((u8 *)message + 12);
+  u32 a0 =   t0                       & 0x3ffffff;
+  u32 a1 = ((t0 >> 26) | (t1 <<  6))  & 0x3ffffff;
+  u32 a2 = ((t1 >> 20) | (t2 << 12))  & 0x3ffffff;
+  u32 a3 = ((t2 >> 14) | (t3 << 18))  & 0x3ffffff;
+  u32 a4 =  (t3 >>  8) | (1 << 24);
+  if (h) {
+    a0 += h[0];  a1 += h[1];  a2 += h[2];  a3 += h[3];  a4 += h[4];
+  }
+
+  d[0] += (u64)a0*p[0]  + (u64)a1*ps[4] + (u64)a2*ps[3]
+        + (u64)a3*ps[2] + (u64)a4*ps[1];
+  d[1] += (u64)a0*p[1]  + (u64)a1*p[0]  + (u64)a2*ps[4]
+        + (u64)a3*ps[3] + (u64)a4*ps[2];
+  d[2] += (u64)a0*p[2]  + (u64)a1*p[1]  + (u64)a2*p[0]
+        + (u64)a3*ps[4] + (u64)a4*ps[3];
+  d[3] += (u64)a0*p[3]  + (u64)a1*p[2]  + (u64)a2*p[1]
+        + (u64)a3*p[0]  + (u64)a4*ps[4];
+  d[4] += (u64)a0*p[4]  + (u64)a1*p[3]  + (u64)a2*p[2]
+        + (u64)a3*p[1]  + (u64)a4*p[0];
+}
+
+
+//------------------------------------------------------------------
+// poly_blocks_scalar4()
+// Process nb_blocks full message blocks, four at a time, with the
+// aggregated Horner rule:
+//   h' = (h + m1)*r^4 + m2*r^3 + m3*r^2 + m4*r
+// The four products are independent and summed before a single
+// partial reduction, instead of one reduction per block as in
+// poly_block(). Limbs are 26 bits, so only 32x32 bit multiplies
+// are needed. The last one to three blocks use poly_block().
+//
+// Sum of the products: limbs < 4 * 5 * 2^28 * 5 * (2^26 + 2^11)
+// < 2^61. The carry out of d[4] times 5 does not fit in 32 bits,
+// so it is folded into d[0] in 64 bits.
+//------------------------------------------------------------------
+static void poly_blocks_scalar4(crypto_poly1305_ctx *ctx,
+                                u8 *message, size_t nb_blocks)
+{
+  if (nb_blocks >= (ctx->rpow_ready ? 4 : POLY1305_SCALAR4_COLD_BLOCKS)) {
+    if (!ctx->rpow_ready) {
+      poly_rpow(ctx->rpow, ctx->r);
+      ctx->rpow_ready = 1;
+    }
+
+    // Five times the powers, for the wrap around of the products
+    u32 ps[4][5];
+    FOR (i, 0, 4) {
+      FOR (j, 0, 5) { ps[i][j] = ctx->rpow[i][j] * 5; }
+    }
+
+    u32 h[5];
+    poly26_from32(h, ctx->h);
+
+    for (; nb_blocks >= 4; nb_blocks -= 4) {
+      u64 d[5] = {0, 0, 0, 0, 0};
+      poly26_block_mul_acc(d, message     , h   , ctx->rpow[3], ps[3]);
+      poly26_block_mul_acc(d, message + 16, NULL, ctx->rpow[2], ps[2]);
+      poly26_block_mul_acc(d, message + 32, NULL, ctx->rpow[1], ps[1]);
+      poly26_block_mul_acc(d, message + 48, NULL, ctx->rpow[0], ps[0]);
+
+      d[1] += d[0] >> 26;
+      d[2] += d[1] >> 26;  h[1] = (u32)d[1] & 0x3ffffff;
+      d[3] += d[2] >> 26;  h[2] = (u32)d[2] & 0x3ffffff;
+      d[4] += d[3] >> 26;  h[3] = (u32)d[3] & 0x3ffffff;
+      d[0]  = (d[0] & 0x3ffffff) + (d[4] >> 26) * 5;
+      h[4]  = (u32)d[4] & 0x3ffffff;
+      h[0]  = (u32)d[0] & 0x3ffffff;
+      h[1] += (u32)(d[0] >> 26);
+
+      message += 64;
+    }
+
+    u64 h64[5] = {h[0], h[1], h[2], h[3], h[4]};
+    poly26_to32(ctx->h, h64);
+    WIPE_BUFFER(h);
+    WIPE_BUFFER(h64);
+    WIPE_BUFFER(ps);
+  }
+
+  poly_blocks_32(ctx, message, nb_blocks);
+}
+#endif // POLY1305_SCALAR4
+
+
+#ifdef POLY1305_AVX2
+//------------------------------------------------------------------
+// Split four message blocks, a holding blocks 0 and 1 and b blocks 2
+// and 3, into five vectors of 26 bit limbs, one block per 64 bit
+// lane, with 2^128 added to each.
+//------------------------------------------------------------------
+__attribute__((target("avx2"), always_inline))
+static inline void avx2_split_blocks(__m256i m[5], __m256i a, __m256i b)
+{
+  const __m256i mask26 = _mm256_set1_epi64x(0x3ffffff);
+  __m256i lo = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), 0xd8);
+  __m256i hi = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), 0xd8);
+
+  m[0] = _mm256_and_si256(lo, mask26);
+  m[1] = _mm256_and_si256(_mm256_srli_epi64(lo, 26), mask26);
+  m[2] = _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(lo, 52),
+                                          _mm256_slli_epi64(hi, 12)), mask26);
+  m[3] = _mm256_and_si256(_mm256_srli_epi64(hi, 14), mask26);
+  m[4] = _mm256_or_si256 (_mm256_srli_epi64(hi, 40),
+                          _mm256_set1_epi64x(1 << 24));
+}
+
+
+//------------------------------------------------------------------
+// Load four consecutive message blocks, one block per lane.
+//------------------------------------------------------------------
+__attribute__((target("avx2"), always_inline))
+static inline void avx2_load_blocks(__m256i m[5], const u8 *message)
+{
+  avx2_split_blocks(m,
+                    _mm256_loadu_si256((const __m256i *)(message     )),
+                    _mm256_loadu_si256((const __m256i *)(message + 32)));
+}
+
+
+//------------------------------------------------------------------
+// d += h * r, lane by lane, without carry propagation.
+// h limbs <= 2^27, r limbs <= 2^27, s = 5 * r.
+//------------------------------------------------------------------
+__attribute__((target("avx2"), always_inline))
+static inline void avx2_mul_acc(__m256i d[5], const __m256i h[5],
+                                const __m256i r[5], const __m256i s[5])
+{
+#define MUL(a, b) _mm256_mul_epu32(a, b)
+#define ADD(a, b) _mm256_add_epi64(a, b)
+  d[0] = ADD(d[0], ADD(ADD(ADD(ADD(MUL(h[0], r[0]), MUL(h[1], s[4])),
+                               MUL(h[2], s[3])), MUL(h[3], s[2])),
+                       MUL(h[4], s[1])));
+  d[1] = ADD(d[1], ADD(ADD(ADD(ADD(MUL(h[0], r[1]), MUL(h[1], r[0])),
+                               MUL(h[2], s[4])), MUL(h[3], s[3])),
+                       MUL(h[4], s[2])));
+  d[2] = ADD(d[2], ADD(ADD(ADD(ADD(MUL(h[0], r[2]), MUL(h[1], r[1])),
+                               MUL(h[2], r[0])), MUL(h[3], s[4])),
+                       MUL(h[4], s[3])));
+  d[3] = ADD(d[3], ADD(ADD(ADD(ADD(MUL(h[0], r[3]), MUL(h[1], r[2])),
+                               MUL(h[2], r[1])), MUL(h[3], r[0])),
+                       MUL(h[4], s[4])));
+  d[4] = ADD(d[4], ADD(ADD(ADD(ADD(MUL(h[0], r[4]), MUL(h[1], r[3])),
+                               MUL(h[2], r[2])), MUL(h[3], r[1])),
+                       MUL(h[4], r[0])));
+#undef MUL
+#undef ADD
+}
+
+
+//------------------------------------------------------------------
+// h = d, with partial reduction modulo 2^130 - 5.
+// d limbs < 2^62, h limbs <= 2^26 except h[1] <= 2^26 + 2^11.
+//------------------------------------------------------------------
+__attribute__((target("avx2"), always_inline))
+static inline void avx2_carry(__m256i h[5], __m256i d[5])
+{
+  const __m256i mask26 = _mm256_set1_epi64x(0x3ffffff);
+  __m256i c;
+  c = _mm256_srli_epi64(d[0], 26);  h[0] = _mm256_and_si256(d[0], mask26);
+  d[1] = _mm256_add_epi64(d[1], c);
+  c = _mm256_srli_epi64(d[1], 26);  h[1] = _mm256_and_si256(d[1], mask26);
+  d[2] = _mm256_add_epi64(d[2], c);
+  c = _mm256_srli_epi64(d[2], 26);  h[2] = _mm256_and_si256(d[2], mask26);
+  d[3] = _mm256_add_epi64(d[3], c);
+  c = _mm256_srli_epi64(d[3], 26);  h[3] = _mm256_and_si256(d[3], mask26);
+  d[4] = _mm256_add_epi64(d[4], c);
+  c = _mm256_srli_epi64(d[4], 26);  h[4] = _mm256_and_si256(d[4], mask26);
+  h[0] = _mm256_add_epi64(h[0], _mm256_add_epi64(c, _mm256_slli_epi64(c, 2)));
+  c = _mm256_srli_epi64(h[0], 26);  h[0] = _mm256_and_si256(h[0], mask26);
+  h[1] = _mm256_add_epi64(h[1], c);
+}
+
+
+//------------------------------------------------------------------
+// Broadcast a power of r, and five times it, to all lanes.
+//------------------------------------------------------------------
+__attribute__((target("avx2"), always_inline))
+static inline void avx2_broadcast(__m256i r[5], __m256i s[5], const u32 p[5])
+{
+  FOR (i, 0, 5) {
+    r[i] = _mm256_set1_epi64x(p[i]);
+    s[i] = _mm256_set1_epi64x((u64)p[i] * 5);
+  }
+}
+
+
+//------------------------------------------------------------------
+// poly_blocks_avx2()
+// Process nb_blocks full message blocks, nb_blocks a non-zero
+// multiple of four, four blocks in parallel.
+//
+// Lane i accumulates every fourth block, starting with block i.
+// Between groups of four blocks the lanes are multiplied by r^4.
+// Two groups at a time are processed as h*r^8 + m*r^4 + m', where
+// the two products are independent and share one carry chain. At
+// the end the lanes are multiplied by r^4, r^3, r^2 and r^1 and
+// summed: h' = (h + m0)*r^4 + m1*r^3 + m2*r^2 + m3*r
+//------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void poly_blocks_avx2(crypto_poly1305_ctx *ctx,
+                             u8 *message, size_t nb_blocks)
+{
+  if (!ctx->rpow_ready) {
+    poly_rpow(ctx->rpow, ctx->r);
+    ctx->rpow_ready = 1;
+  }
+
+  __m256i r4[5], s4[5], r8[5], s8[5], h[5], m[5], d[5];
+  avx2_broadcast(r4, s4, ctx->rpow[3]);
+  avx2_broadcast(r8, s8, ctx->rpow[7]);
+
+  // The current hash goes into lane 0 with the first block.
+  u32 h26[5];
+  poly26_from32(h26, ctx->h);
+  avx2_load_blocks(h, message);
+  FOR (i, 0, 5) {
+    h[i] = _mm256_add_epi64(h[i], _mm256_set_epi64x(0, 0, 0, h26[i]));
+  }
+  message += 64;
+
+  size_t i = 4;
+  for (; i + 8 <= nb_blocks; i += 8) {
+    FOR (j, 0, 5) { d[j] = _mm256_setzero_si256(); }
+    avx2_mul_acc(d, h, r8, s8);
+    avx2_load_blocks(m, message);
+    avx2_mul_acc(d, m, r4, s4);
+    avx2_load_blocks(m, message + 64);
+    FOR (j, 0, 5) { d[j] = _mm256_add_epi64(d[j], m[j]); }
+    avx2_carry(h, d);
+    message += 128;
+  }
+
+  if (i < nb_blocks) {
+    FOR (j, 0, 5) { d[j] = _mm256_setzero_si256(); }
+    avx2_mul_acc(d, h, r4, s4);
+    avx2_load_blocks(m, message);
+    FOR (j, 0, 5) { d[j] = _mm256_add_epi64(d[j], m[j]); }
+    avx2_carry(h, d);
+  }
+
+  // Lanes 0..3 times r^4..r^1
+  FOR (j, 0, 5) {
+    r4[j] = _mm256_set_epi64x(ctx->rpow[0][j], ctx->rpow[1][j],
+                              ctx->rpow[2][j], ctx->rpow[3][j]);
+    s4[j] = _mm256_add_epi64(r4[j], _mm256_slli_epi64(r4[j], 2));
+    d[j]  = _mm256_setzero_si256();
+  }
+  avx2_mul_acc(d, h, r4, s4);
+  avx2_carry(h, d);
+
+  // Sum the lanes and go back to radix 2^32
+  u64 sum[5];
+  FOR (j, 0, 5) {
+    __m128i t = _mm_add_epi64(_mm256_castsi256_si128(h[j]),
+                              _mm256_extracti128_si256(h[j], 1));
+    sum[j] = (u64)_mm_cvtsi128_si64(t) + (u64)_mm_extract_epi64(t, 1);
+  }
+
+  // Leave clean upper halves for the SSE code we return to. The
+  // compiler does not always do it, and mixing costs dearly.
+  _mm256_zeroupper();
+  poly26_to32(ctx->h, sum);
+}
+
+
+//------------------------------------------------------------------
+// poly_blocks_avx2_tail()
+// The AVX2 kernel as seen from poly_blocks(). Long runs of blocks
+// use the vector code, short runs and the last one to three blocks
+// use the scalar kernel. Runs have to be longer before the powers
+// of r are computed.
+//------------------------------------------------------------------
+static void poly_blocks_avx2_tail(crypto_poly1305_ctx *ctx,
+                                  u8 *message, size_t nb_blocks)
+{
+  if (nb_blocks >= (ctx->rpow_ready ? POLY1305_AVX2_MIN_BLOCKS
+                                    : POLY1305_AVX2_COLD_BLOCKS)) {
+    size_t nb_vector = nb_blocks & ~(size_t)3;
+    poly_blocks_avx2(ctx, message, nb_vector);
+    message   += nb_vector * 16;
+    nb_blocks -= nb_vector;
+  }
+#ifdef POLY1305_RADIX44
+  poly_blocks_44(ctx, message, nb_blocks);
+#else
+  poly_blocks_32(ctx, message, nb_blocks);
+#endif
+}
+
+
+//------------------------------------------------------------------
+// cpu_has_avx2()
+// The CPU must support AVX2 and the OS must save the YMM registers.
+//------------------------------------------------------------------
+static int cpu_has_avx2(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+      || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+    return 0;
+  }
+
+  unsigned int xcr0_lo, xcr0_hi;
+  __asm__ volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+  if ((xcr0_lo & 6) != 6) {
+    return 0;
+  }
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return 0;
+  }
+  return (ebx & bit_AVX2) != 0;
+}
+#endif // POLY1305_AVX2
+
+
+//------------------------------------------------------------------
+// Kernel registry.
+// All block kernels compiled in, in order of preference. The first
+// one supported by the CPU that passes the self test is used, see
+// poly_kernel_init(). The traced build only has the reference
+// kernel since its intermediate values are the ones in the RTL.
+//------------------------------------------------------------------
+typedef struct {
+  const char *name;
+  void (*blocks)(crypto_poly1305_ctx *ctx, u8 *message, size_t nb_blocks);
+  int  (*supported)(void);
+} poly_kernel;
+
+static int cpu_any(void)
+{
+  return 1;
+}
+
+static const poly_kernel poly_kernels[] = {
+#ifdef POLY1305_AVX2
+  {"avx2",    poly_blocks_avx2_tail, cpu_has_avx2},
+#endif
+#ifdef POLY1305_RADIX44
+  {"radix44", poly_blocks_44,        cpu_any},
+#endif
+#ifdef POLY1305_SCALAR4
+  {"scalar4", poly_blocks_scalar4,   cpu_any},
+#endif
+  {"ref32",   poly_blocks_32,        cpu_any},
+};
+
+#define NB_KERNELS (sizeof(poly_kernels) / sizeof(poly_kernels[0]))
+
+// Set by poly_kernel_init() under poly_kernel_once, and after that
+// only by crypto_poly1305_select_kernel(), with release stores that
+// pair with the acquire load of poly_kernel_get().
+static const poly_kernel *_Atomic poly_kernel_active;
+static pthread_once_t             poly_kernel_once = PTHREAD_ONCE_INIT;
+static void                       poly_kernel_init(void);
+
+
+//------------------------------------------------------------------
+// poly_kernel_get()
+// The selected kernel, selecting it on first use.
+//------------------------------------------------------------------
+static const poly_kernel *poly_kernel_get(void)
+{
+  pthread_once(&poly_kernel_once, poly_kernel_init);
+  return atomic_load_explicit(&poly_kernel_active, memory_order_acquire);
+}
+
+
+//------------------------------------------------------------------
+// poly_blocks()
+// Process nb_blocks full message blocks with the selected kernel.
+//------------------------------------------------------------------
+static void poly_blocks(crypto_poly1305_ctx *ctx,
+                        u8 *message, size_t nb_blocks)
+{
+  if (nb_blocks == 0) {
+    return;
+  }
+  const poly_kernel *kernel = poly_kernel_get();
+
+  PERF_SAMPLE(sample);
+  PERF_BEGIN(sample);
+  kernel->blocks(ctx, message, nb_blocks);
+  PERF_END(sample, kernel->name, nb_blocks * 16);
 }
 
 
@@ -167,8 +970,8 @@ static void poly_block(crypto_poly1305_ctx *ctx)
 //------------------------------------------------------------------
 static void poly_clear_c(crypto_poly1305_ctx *ctx)
 {
-  printf("\n");
-  printf("poly_clear_c called\n");
+  TRACE("\n");
+  TRACE("poly_clear_c called\n");
 
   ctx->c[0]  = 0;
   ctx->c[1]  = 0;
@@ -176,8 +979,8 @@ static void poly_clear_c(crypto_poly1305_ctx *ctx)
   ctx->c[3]  = 0;
   ctx->c_idx = 0;
 
-  printf("poly_clear_c completed.\n");
-  printf("-----------------------\n\n");
+  TRACE("poly_clear_c completed.\n");
+  TRACE("-----------------------\n\n");
 }
 
 
@@ -185,21 +988,21 @@ static void poly_clear_c(crypto_poly1305_ctx *ctx)
 //------------------------------------------------------------------
 static void poly_take_input(crypto_poly1305_ctx *ctx, u8 input)
 {
-  printf("poly_take_input() called with input: 0x%02x: \n", input);
-  printf("poly_take_input: Context before poly_take_input():\n");
-  print_context(ctx);
+  TRACE("poly_take_input() called with input: 0x%02x: \n", input);
+  TRACE("poly_take_input: Context before poly_take_input():\n");
+  TRACE_CTX(ctx);
 
   size_t word = ctx->c_idx >> 2;
   size_t byte = ctx->c_idx & 3;
   ctx->c[word] |= (u32)input << (byte * 8);
   ctx->c_idx++;
-  printf("poly_take_input: calculated word: %0zu, calculated byte: %0zu\n", word, byte);
-  printf("poly_take_input: ctx->c[word] = 0x%08x\n", ctx->c[word]);
+  TRACE("poly_take_input: calculated word: %0zu, calculated byte: %0zu\n", word, byte);
+  TRACE("poly_take_input: ctx->c[word] = 0x%08x\n", ctx->c[word]);
 
-  printf("Context after poly_take_input():\n");
-  print_context(ctx);
+  TRACE("Context after poly_take_input():\n");
+  TRACE_CTX(ctx);
 
-  printf("poly_take_input() done.\n\n");
+  TRACE("poly_take_input() done.\n\n");
 }
 
 
@@ -209,28 +1012,28 @@ static void poly_update(crypto_poly1305_ctx *ctx,
                         u8 *message, size_t message_size)
 
 {
-  printf("poly_update called.\n");
-  printf("poly_update: Message given:\n");
-  print_hexdata(&message[0], message_size);
+  TRACE("poly_update called.\n");
+  TRACE("poly_update: Message given:\n");
+  TRACE_HEX(&message[0], message_size);
 
   if (message_size == 0) {
-    printf("poly_update: message_size == 0. No processing in poly_update done.\n");
-    printf("poly_update completed.\n\n");
+    TRACE("poly_update: message_size == 0. No processing in poly_update done.\n");
+    TRACE("poly_update completed.\n\n");
     return;
   }
 
   // We loop over the bytes in the message, calling poly_take_input.
   FOR (i, 0, message_size) {
-    printf("poly_update: Calling poly_take_input\n");
+    TRACE("poly_update: Calling poly_take_input\n");
     poly_take_input(ctx, message[i]);
 
     if (ctx->c_idx == 16) {
-      printf("poly_update: ctx->c_idx == 16, we thus do some magic calling poly_block() and then poly_clear_c()\n");
+      TRACE("poly_update: ctx->c_idx == 16, we thus do some magic calling poly_block() and then poly_clear_c()\n");
       poly_block(ctx);
       poly_clear_c(ctx);
     }
   }
-  printf("poly_update completed.\n\n");
+  TRACE("poly_update completed.\n\n");
 }
 
 
@@ -238,13 +1041,13 @@ static void poly_update(crypto_poly1305_ctx *ctx,
 //------------------------------------------------------------------
 void crypto_poly1305_init(crypto_poly1305_ctx *ctx, u8 key[32])
 {
-  printf("crypto_poly1305_init called.\n");
-  printf("----------------------------\n");
-  printf("crypto_poly1305_init: Key given:\n");
-  print_hexdata(&key[0], 32);
+  TRACE("crypto_poly1305_init called.\n");
+  TRACE("----------------------------\n");
+  TRACE("crypto_poly1305_init: Key given:\n");
+  TRACE_HEX(&key[0], 32);
 
-  printf("crypto_poly1305_init: Context before processing:\n");
-  print_context(ctx);
+  TRACE("crypto_poly1305_init: Context before processing:\n");
+  TRACE_CTX(ctx);
 
   // Initial hash is zero
   FOR (i, 0, 5) {
@@ -253,17 +1056,61 @@ void crypto_poly1305_init(crypto_poly1305_ctx *ctx, u8 key[32])
 
   // add 2^130 to every input block
   ctx->c[4] = 1;
+  ctx->rpow_ready = 0;
   poly_clear_c(ctx);
 
   // load r and s (r has some of its bits cleared)
   FOR (i, 0, 1) { ctx->r[0] = load32_le(key           ) & 0x0fffffff; }
   FOR (i, 1, 4) { ctx->r[i] = load32_le(key + i*4     ) & 0x0ffffffc; }
   FOR (i, 0, 4) { ctx->s[i] = load32_le(key + i*4 + 16);              }
+  poly_rr(ctx->rr, ctx->r);
+
+  TRACE("crypto_poly1305_init: Context after processing:\n");
+  TRACE_CTX(ctx);
+  TRACE("crypto_poly1305_init completed.\n");
+  TRACE("-------------------------------\n\n");
+}
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_key_init()
+// Parse and clamp the key and compute everything the kernels
+// derive from it, once.
+//------------------------------------------------------------------
+void crypto_poly1305_key_init(crypto_poly1305_key *ks, u8 key[32])
+{
+  FOR (i, 0, 1) { ks->r[0] = load32_le(key           ) & 0x0fffffff; }
+  FOR (i, 1, 4) { ks->r[i] = load32_le(key + i*4     ) & 0x0ffffffc; }
+  FOR (i, 0, 4) { ks->s[i] = load32_le(key + i*4 + 16);              }
+  poly_rr(ks->rr, ks->r);
+  poly_rpow(ks->rpow, ks->r);
+}
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_init_key()
+// Start a context from a key schedule. Same result as
+// crypto_poly1305_init() with the key of the schedule.
+//------------------------------------------------------------------
+void crypto_poly1305_init_key(crypto_poly1305_ctx *ctx,
+                              const crypto_poly1305_key *ks)
+{
+  TRACE("crypto_poly1305_init_key called.\n");
+
+  FOR (i, 0, 5) {
+    ctx->h[i] = 0;
+  }
+  ctx->c[4] = 1;
+  poly_clear_c(ctx);
 
-  printf("crypto_poly1305_init: Context after processing:\n");
-  print_context(ctx);
-  printf("crypto_poly1305_init completed.\n");
-  printf("-------------------------------\n\n");
+  memcpy(ctx->r,    ks->r,    sizeof(ctx->r));
+  memcpy(ctx->rr,   ks->rr,   sizeof(ctx->rr));
+  memcpy(ctx->s,    ks->s,    sizeof(ctx->s));
+  memcpy(ctx->rpow, ks->rpow, sizeof(ctx->rpow));
+  ctx->rpow_ready = 1;
+
+  TRACE("crypto_poly1305_init_key: Context after processing:\n");
+  TRACE_CTX(ctx);
 }
 
 
@@ -272,57 +1119,190 @@ void crypto_poly1305_init(crypto_poly1305_ctx *ctx, u8 key[32])
 void crypto_poly1305_update(crypto_poly1305_ctx *ctx,
                             u8 *message, size_t message_size)
 {
-  printf("crypto_poly1305_update called.\n");
-  printf("------------------------------\n");
-  printf("Message given:\n");
-  print_hexdata(&message[0], message_size);
+  TRACE("crypto_poly1305_update called.\n");
+  TRACE("------------------------------\n");
+  TRACE("Message given:\n");
+  TRACE_HEX(&message[0], message_size);
+
+  TRACE("Context before crypto_poly1305_update:\n");
+  TRACE_CTX(ctx);
 
-  printf("Context before crypto_poly1305_update:\n");
-  print_context(ctx);
+  PERF_SAMPLE(sample);
+  PERF_BEGIN(sample);
 
   // Align ourselves with block boundaries
   size_t align = MIN(ALIGN(ctx->c_idx, 16), message_size);
-  printf("crypto_poly1305_update: Calculated align: 0x%08zx\n", align);
+  TRACE("crypto_poly1305_update: Calculated align: 0x%08zx\n", align);
 
-  printf("crypto_poly1305_update: Calling poly_update with align as message size:\n");
+  TRACE("crypto_poly1305_update: Calling poly_update with align as message size:\n");
   poly_update(ctx, message, align);
 
   message      += align;
   message_size -= align;
-  printf("crypto_poly1305_update: Message efter alignment:\n");
-  print_hexdata(&message[0], message_size);
+  TRACE("crypto_poly1305_update: Message efter alignment:\n");
+  TRACE_HEX(&message[0], message_size);
 
 
   // Process the message block by block
-  printf("crypto_poly1305_update: Alignment completed. Time for block processing.\n");
+  TRACE("crypto_poly1305_update: Alignment completed. Time for block processing.\n");
   size_t nb_blocks = message_size >> 4;
-  printf("crypto_poly1305_update: Calculated number of blocks: %lu\n", nb_blocks);
+  TRACE("crypto_poly1305_update: Calculated number of blocks: %zu\n", nb_blocks);
 
-  printf("crypto_poly1305_update: Looping over all blocks\n");
-  FOR (i, 0, nb_blocks) {
-    printf("crypto_poly1305_update: Processing block %lu\n", i);
-    FOR (j, 0, 4) {
-      ctx->c[j] = load32_le(message +  j*4);
-    }
-    printf("crypto_poly1305_update: Calling poly_block with block le32-loaded into ctx->c:\n");
-    poly_block(ctx);
-    message += 16;
-  }
-    printf("crypto_poly1305_update: All blocks processed.\n");
+  TRACE("crypto_poly1305_update: Looping over all blocks\n");
+  poly_blocks(ctx, message, nb_blocks);
+  message += nb_blocks * 16;
+  TRACE("crypto_poly1305_update: All blocks processed.\n");
 
   if (nb_blocks > 0) {
-    printf("crypto_poly1305_update: Clearing ctx->c after processing message blocks\n");
+    TRACE("crypto_poly1305_update: Clearing ctx->c after processing message blocks\n");
     poly_clear_c(ctx);
   }
   message_size &= 15;
-  printf("crypto_poly1305_update: Message size after final adjustment: %zu\n", message_size);
+  TRACE("crypto_poly1305_update: Message size after final adjustment: %zu\n", message_size);
 
   // remaining bytes
-  printf("crypto_poly1305_update: Calling poly_update a final time.\n");
+  TRACE("crypto_poly1305_update: Calling poly_update a final time.\n");
   poly_update(ctx, message, message_size);
 
-  printf("crypto_poly1305_update completed.\n");
-  printf("---------------------------------\n\n");
+  PERF_END(sample, "update", align + nb_blocks * 16 + message_size);
+
+  TRACE("crypto_poly1305_update completed.\n");
+  TRACE("---------------------------------\n\n");
+}
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_updatev()
+//
+// Same as calling crypto_poly1305_update() for each fragment, but
+// blocks straddling fragment boundaries are assembled in a local
+// buffer and loaded a word at a time, instead of going through
+// poly_take_input() byte by byte. Full blocks within a fragment go
+// straight to the block kernel.
+//------------------------------------------------------------------
+void crypto_poly1305_updatev(crypto_poly1305_ctx *ctx,
+                             const struct iovec *iov, size_t iovcnt)
+{
+  TRACE("crypto_poly1305_updatev called with %zu fragments.\n", iovcnt);
+
+  // Pending bytes of the current block
+  u8     block[16];
+  size_t fill = ctx->c_idx;
+  FOR (i, 0, 4) {
+    store32_le(block + i*4, ctx->c[i]);
+  }
+
+  FOR (i, 0, iovcnt) {
+    u8    *message      = iov[i].iov_base;
+    size_t message_size = iov[i].iov_len;
+
+    if (fill > 0) {
+      size_t take = MIN(16 - fill, message_size);
+      memcpy(block + fill, message, take);
+      fill         += take;
+      message      += take;
+      message_size -= take;
+      if (fill < 16) {
+        continue;
+      }
+      TRACE("crypto_poly1305_updatev: Block straddling fragment %zu.\n", i);
+      poly_blocks(ctx, block, 1);
+      fill = 0;
+    }
+
+    size_t nb_blocks = message_size >> 4;
+    TRACE("crypto_poly1305_updatev: %zu blocks in fragment %zu.\n",
+          nb_blocks, i);
+    poly_blocks(ctx, message, nb_blocks);
+    message      += nb_blocks * 16;
+    message_size &= 15;
+
+    memcpy(block, message, message_size);
+    fill = message_size;
+  }
+
+  // Keep the remaining bytes in the context
+  memset(block + fill, 0, 16 - fill);
+  FOR (i, 0, 4) {
+    ctx->c[i] = load32_le(block + i*4);
+  }
+  ctx->c_idx = fill;
+  WIPE_BUFFER(block);
+
+  TRACE("crypto_poly1305_updatev: Context after processing:\n");
+  TRACE_CTX(ctx);
+}
+
+
+#ifdef POLY1305_COPY_NT
+//------------------------------------------------------------------
+// copy_nt()
+// memcpy() with non-temporal stores for the 16 byte aligned part
+// of dst. The caller issues the store fence.
+//------------------------------------------------------------------
+static void copy_nt(u8 *dst, const u8 *src, size_t size)
+{
+  size_t head = MIN(ALIGN((uintptr_t)dst, 16), size);
+  memcpy(dst, src, head);
+  dst  += head;
+  src  += head;
+  size -= head;
+
+  for (; size >= 64 ; size -= 64) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src     ));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+    __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+    _mm_stream_si128((__m128i *)(dst     ), a);
+    _mm_stream_si128((__m128i *)(dst + 16), b);
+    _mm_stream_si128((__m128i *)(dst + 32), c);
+    _mm_stream_si128((__m128i *)(dst + 48), d);
+    dst += 64;
+    src += 64;
+  }
+  memcpy(dst, src, size);
+}
+#endif
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_update_copy()
+//
+// Each chunk is copied first, which brings src into L1, and then
+// MACed from src with the block kernels. src is used rather than
+// dst, which is not in the cache after non-temporal stores.
+//------------------------------------------------------------------
+void crypto_poly1305_update_copy(crypto_poly1305_ctx *ctx, u8 *dst,
+                                 const u8 *src, size_t size)
+{
+  TRACE("crypto_poly1305_update_copy called with %zu bytes.\n", size);
+
+#ifdef POLY1305_COPY_NT
+  int nt = size >= POLY1305_COPY_NT_THRESHOLD;
+#endif
+
+  while (size > 0) {
+    size_t chunk = MIN(size, POLY1305_COPY_CHUNK);
+#ifdef POLY1305_COPY_NT
+    if (nt) {
+      copy_nt(dst, src, chunk);
+    }
+    else
+#endif
+    {
+      memcpy(dst, src, chunk);
+    }
+    crypto_poly1305_update(ctx, (u8 *)src, chunk);
+    dst  += chunk;
+    src  += chunk;
+    size -= chunk;
+  }
+
+#ifdef POLY1305_COPY_NT
+  if (nt) {
+    _mm_sfence();
+  }
+#endif
 }
 
 
@@ -330,28 +1310,28 @@ void crypto_poly1305_update(crypto_poly1305_ctx *ctx,
 //------------------------------------------------------------------
 void crypto_poly1305_final(crypto_poly1305_ctx *ctx, u8 mac[16])
 {
-  printf("\n");
-  printf("crypto_poly1305_final started\n");
-  printf("-----------------------------\n");
+  TRACE("\n");
+  TRACE("crypto_poly1305_final started\n");
+  TRACE("-----------------------------\n");
 
-  printf("crypto_poly1305_final: Handling last block and updating ctx->c based on c_idx.\n");
+  TRACE("crypto_poly1305_final: Handling last block and updating ctx->c based on c_idx.\n");
   // Process the last block (if any)
   if (ctx->c_idx != 0) {
-    printf("crypto_poly1305_final: ctx->c_idx != 0.\n");
+    TRACE("crypto_poly1305_final: ctx->c_idx != 0.\n");
     // move the final 1 according to remaining input length
     // (We may add less than 2^130 to the last input block)
     ctx->c[4] = 0;
-    printf("crypto_poly1305_final: Adjusted ctx->c[4] = 0.\n");
-    printf("crypto_poly1305_final: Calling poly_take_input with message length 1.\n");
+    TRACE("crypto_poly1305_final: Adjusted ctx->c[4] = 0.\n");
+    TRACE("crypto_poly1305_final: Calling poly_take_input with message length 1.\n");
     poly_take_input(ctx, 1);
     // one last hash update
-    printf("crypto_poly1305_final: Calling poly_block once more.\n");
+    TRACE("crypto_poly1305_final: Calling poly_block once more.\n");
     poly_block(ctx);
   }
-  printf("crypto_poly1305_final: Final block handling done.\n");
+  TRACE("crypto_poly1305_final: Final block handling done.\n");
 
-  printf("crypto_poly1305_final: Context before final processing:\n");
-  print_context(ctx);
+  TRACE("crypto_poly1305_final: Context before final processing:\n");
+  TRACE_CTX(ctx);
 
   // check if we should subtract 2^130-5 by performing the
   // corresponding carry propagation.
@@ -368,44 +1348,219 @@ void crypto_poly1305_final(crypto_poly1305_ctx *ctx, u8 mac[16])
   u64 uu2 = (uu1 >> 32)   + ctx->h[2] + ctx->s[2]; // <= 2_00000000
   u64 uu3 = (uu2 >> 32)   + ctx->h[3] + ctx->s[3]; // <= 2_00000000
 
-  printf("crypto_poly1305_final: Intermediate results during final processing:\n");
-  printf("u0  = 0x%016llx, u1  = 0x%016llx, u2  = 0x%016llx\n", u0, u1, u2);
-  printf("u3  = 0x%016llx, u4  = 0x%016llx\n", u3, u4);
-  printf("\n");
+  TRACE("crypto_poly1305_final: Intermediate results during final processing:\n");
+  TRACE("u0  = 0x%016" PRIx64 ", u1  = 0x%016" PRIx64 ", u2  = 0x%016" PRIx64 "\n", u0, u1, u2);
+  TRACE("u3  = 0x%016" PRIx64 ", u4  = 0x%016" PRIx64 "\n", u3, u4);
+  TRACE("\n");
 
-  printf("uu0 = 0x%016llx, uu1 = 0x%016llx\n", uu0, uu1);
-  printf("uu2 = 0x%016llx, uu3 = 0x%016llx\n", uu2, uu3);
-  printf("\n");
+  TRACE("uu0 = 0x%016" PRIx64 ", uu1 = 0x%016" PRIx64 "\n", uu0, uu1);
+  TRACE("uu2 = 0x%016" PRIx64 ", uu3 = 0x%016" PRIx64 "\n", uu2, uu3);
+  TRACE("\n");
+
+  TRACE_REC(CRYPTO_POLY1305_TRACE_FINAL,
+            u0, u1, u2, u3, u4, uu0, uu1, uu2, uu3);
 
   u32 m0 = (u32)uu0;
   u32 m1 = (u32)uu1;
   u32 m2 = (u32)uu2;
   u32 m3 = (u32)uu3;
 
-  printf("m0 = 0x%08x, m1 = 0x%08x\n", m0, m1);
-  printf("m2 = 0x%08x, m3 = 0x%08x\n", m2, m3);
-  printf("\n\n");
-  printf("crypto_poly1305_final: Final processing done.\n");
+  TRACE("m0 = 0x%08x, m1 = 0x%08x\n", m0, m1);
+  TRACE("m2 = 0x%08x, m3 = 0x%08x\n", m2, m3);
+  TRACE("\n\n");
+  TRACE("crypto_poly1305_final: Final processing done.\n");
 
-  printf("crypto_poly1305_final: Assembling the mac by applying le32 on m0..m3:\n");
+  TRACE("crypto_poly1305_final: Assembling the mac by applying le32 on m0..m3:\n");
   store32_le(mac     , (u32)m0);
   store32_le(mac +  4, (u32)m1);
   store32_le(mac +  8, (u32)m2);
   store32_le(mac + 12, (u32)m3);
 
-  printf("crypto_poly1305_final: The resulting mac:\n");
-  print_hexdata(&mac[0], 16);
-  printf("\n");
+  TRACE("crypto_poly1305_final: The resulting mac:\n");
+  TRACE_HEX(&mac[0], 16);
+  TRACE("\n");
 
-  printf("crypto_poly1305_final: Context before wiping:\n");
-  print_context(ctx);
+  TRACE("crypto_poly1305_final: Context before wiping:\n");
+  TRACE_CTX(ctx);
   WIPE_CTX(ctx);
-  printf("crypto_poly1305_final: Context after wiping:\n");
-  print_context(ctx);
+  TRACE("crypto_poly1305_final: Context after wiping:\n");
+  TRACE_CTX(ctx);
 
-  printf("crypto_poly1305_final completed\n");
-  printf("-------------------------------\n");
-  printf("\n");
+  TRACE("crypto_poly1305_final completed\n");
+  TRACE("-------------------------------\n");
+  TRACE("\n");
+}
+
+
+//------------------------------------------------------------------
+// poly_fingerprint()
+// Fingerprint of r for matching a saved state with its key: the low
+// 64 bits of the MAC of a fixed block with r and s = 0. As the MAC
+// is linear in r, the full 128 bits would give r away. A clamped r
+// has 106 free bits, so 64 bits still pin it down to about 2^42
+// candidates. That is acceptable because h gives away as much: it is
+// a known function of r and the message, so whoever holds a state
+// and the data it covers can solve for r anyway. The fingerprint
+// adds nothing to that, and nothing about s, which is never stored.
+// Defined with the short message one-shots.
+//------------------------------------------------------------------
+static void poly_fingerprint(u8 fp[8], const u32 r[4]);
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_save()
+// Serialize the mid-state. r and s are not stored, only the
+// fingerprint of r.
+//------------------------------------------------------------------
+void crypto_poly1305_save(u8 state[CRYPTO_POLY1305_STATE_SIZE],
+                          const crypto_poly1305_ctx *ctx)
+{
+  u8 *p = state;
+  store32_le(p, CRYPTO_POLY1305_STATE_MAGIC);   p += 4;
+  store32_le(p, CRYPTO_POLY1305_STATE_VERSION); p += 4;
+  FOR (i, 0, 5) { store32_le(p, ctx->h[i]); p += 4; }
+  FOR (i, 0, 4) { store32_le(p, ctx->c[i]); p += 4; }
+  store32_le(p, (u32)ctx->c_idx);               p += 4;
+  poly_fingerprint(p, ctx->r);
+}
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_restore()
+// Load a serialized mid-state, with r and s from the key. Besides
+// the header and the fingerprint, the state must be one update()
+// could have left: h[4] within the bound of poly_block() and no
+// bytes in c beyond c_idx.
+//------------------------------------------------------------------
+int crypto_poly1305_restore(crypto_poly1305_ctx *ctx,
+                            u8 state[CRYPTO_POLY1305_STATE_SIZE],
+                            u8 key[32])
+{
+  crypto_poly1305_ctx tmp;
+  u8  fp[8];
+  u8 *p = state + 8;
+
+  if (load32_le(state    ) != CRYPTO_POLY1305_STATE_MAGIC ||
+      load32_le(state + 4) != CRYPTO_POLY1305_STATE_VERSION) {
+    return -1;
+  }
+  crypto_poly1305_init(&tmp, key);
+  FOR (i, 0, 5) { tmp.h[i] = load32_le(p); p += 4; }
+  FOR (i, 0, 4) { tmp.c[i] = load32_le(p); p += 4; }
+  tmp.c_idx = load32_le(p);                p += 4;
+
+  poly_fingerprint(fp, tmp.r);
+  u32 bad = (u32)(tmp.h[4] > 4) | (u32)(tmp.c_idx > 15);
+  FOR (i, 0, 8) { bad |= fp[i] ^ p[i]; }
+  FOR (i, tmp.c_idx, 16) {
+    bad |= tmp.c[i / 4] >> ((i % 4) * 8) & 0xff;
+  }
+  WIPE_BUFFER(fp);
+  if (bad) {
+    WIPE_CTX(&tmp);
+    return -1;
+  }
+
+  *ctx = tmp;
+  WIPE_CTX(&tmp);
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_set_r()
+// Load a clamped r kept outside the context, with its multiples.
+//------------------------------------------------------------------
+void crypto_poly1305_set_r(crypto_poly1305_ctx *ctx, const u32 r[4])
+{
+  FOR (i, 0, 4) { ctx->r[i] = r[i]; }
+  poly_rr(ctx->rr, ctx->r);
+  ctx->rpow_ready = 0;
+}
+
+
+//------------------------------------------------------------------
+// AEAD construction (RFC 8439, section 2.8).
+//
+// The MAC covers the additional data and the ciphertext, each padded
+// with zeros to a multiple of 16 bytes, followed by a block with
+// their sizes as 64 bit little endian numbers. The padding and the
+// size block are applied directly on the block in the context, so
+// no staging buffer is needed.
+//------------------------------------------------------------------
+
+//------------------------------------------------------------------
+// poly_pad16()
+// Process a pending partial block as if it was padded with zeros
+// to 16 bytes. The unused bytes of the block are already zero.
+//------------------------------------------------------------------
+static void poly_pad16(crypto_poly1305_ctx *ctx)
+{
+  if (ctx->c_idx != 0) {
+    TRACE("poly_pad16: Padding %zu byte block with zeros.\n", ctx->c_idx);
+    poly_block(ctx);
+    poly_clear_c(ctx);
+  }
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_aead_init(crypto_poly1305_aead_ctx *ctx, u8 key[32])
+{
+  crypto_poly1305_init(&ctx->poly, key);
+  ctx->ad_size   = 0;
+  ctx->text_size = 0;
+  ctx->ad_padded = 0;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_aead_ad(crypto_poly1305_aead_ctx *ctx,
+                             u8 *ad, size_t ad_size)
+{
+  crypto_poly1305_update(&ctx->poly, ad, ad_size);
+  ctx->ad_size += ad_size;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_aead_text(crypto_poly1305_aead_ctx *ctx,
+                               u8 *text, size_t text_size)
+{
+  if (!ctx->ad_padded) {
+    poly_pad16(&ctx->poly);
+    ctx->ad_padded = 1;
+  }
+  crypto_poly1305_update(&ctx->poly, text, text_size);
+  ctx->text_size += text_size;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_aead_final(crypto_poly1305_aead_ctx *ctx, u8 mac[16])
+{
+  crypto_poly1305_ctx *poly = &ctx->poly;
+
+  if (!ctx->ad_padded) {
+    poly_pad16(poly);
+  }
+  poly_pad16(poly);
+
+  // Size block, with the 2^128 bit as any other full block
+  poly->c[0] = (u32) ctx->ad_size;
+  poly->c[1] = (u32)(ctx->ad_size   >> 32);
+  poly->c[2] = (u32) ctx->text_size;
+  poly->c[3] = (u32)(ctx->text_size >> 32);
+  TRACE("crypto_poly1305_aead_final: Processing the size block.\n");
+  poly_block(poly);
+  poly_clear_c(poly);
+
+  crypto_poly1305_final(poly, mac);
+  WIPE_CTX(ctx);
 }
 
 
@@ -413,8 +1568,828 @@ void crypto_poly1305_final(crypto_poly1305_ctx *ctx, u8 mac[16])
 //------------------------------------------------------------------
 void crypto_poly1305(u8 mac[16], u8 *message, size_t message_size, u8 key[32])
 {
+#ifndef POLY1305_TRACE
+  // Short messages never benefit from the block kernels
+  if (message_size <= 64) {
+    crypto_poly1305_small(mac, message, message_size, key);
+    return;
+  }
+#endif
+
   crypto_poly1305_ctx ctx;
   crypto_poly1305_init  (&ctx, key);
   crypto_poly1305_update(&ctx, message, message_size);
   crypto_poly1305_final (&ctx, mac);
 }
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_verify()
+// Compute the tag and compare with mac in constant time.
+//------------------------------------------------------------------
+int crypto_poly1305_verify(const u8 mac[16],
+                           u8 *message, size_t message_size, u8 key[32])
+{
+  u8 tag[16];
+  crypto_poly1305(tag, message, message_size, key);
+  int res = crypto_verify16(tag, mac);
+  WIPE_BUFFER(tag);
+  return res;
+}
+
+
+
+//------------------------------------------------------------------
+// poly_tag()
+// mac = (h + s) mod 2^128, with h fully reduced modulo 2^130 - 5.
+// Same as the end of crypto_poly1305_final(), for callers keeping
+// h and s outside of a context.
+//------------------------------------------------------------------
+static void poly_tag(u8 mac[16], const u32 h[5], const u32 s[4])
+{
+  u64 u0 = (u64)5     + h[0]; // <= 1_00000004
+  u64 u1 = (u0 >> 32) + h[1]; // <= 1_00000000
+  u64 u2 = (u1 >> 32) + h[2]; // <= 1_00000000
+  u64 u3 = (u2 >> 32) + h[3]; // <= 1_00000000
+  u64 u4 = (u3 >> 32) + h[4]; // <=          5
+
+  u64 uu0 = (u4 >> 2) * 5 + h[0] + s[0]; // <= 2_00000003
+  u64 uu1 = (uu0 >> 32)   + h[1] + s[1]; // <= 2_00000000
+  u64 uu2 = (uu1 >> 32)   + h[2] + s[2]; // <= 2_00000000
+  u64 uu3 = (uu2 >> 32)   + h[3] + s[3]; // <= 2_00000000
+
+  store32_le(mac     , (u32)uu0);
+  store32_le(mac +  4, (u32)uu1);
+  store32_le(mac +  8, (u32)uu2);
+  store32_le(mac + 12, (u32)uu3);
+}
+
+
+//------------------------------------------------------------------
+// Short message one-shots.
+//
+// Messages of at most 64 bytes are dominated by the per call
+// overhead of the context: clearing the block, loading partial
+// blocks byte by byte and wiping. Here the whole state is kept in
+// local variables the compiler can keep in registers, and the
+// blocks are processed by straight line code. Only r, s and h are
+// wiped at the end, 52 bytes instead of a whole context.
+//------------------------------------------------------------------
+
+//------------------------------------------------------------------
+// small_block()
+// h = (h + block) * r, block given as 16 bytes plus the 2^128 bit.
+// Same arithmetic and bounds as poly_block().
+//------------------------------------------------------------------
+__attribute__((always_inline))
+static inline void small_block(u32 h[5], const u32 r[4], u8 *block, u32 hibit)
+{
+  u64 s0 = h[0] + (u64)load32_le(block     );
+  u64 s1 = h[1] + (u64)load32_le(block +  4);
+  u64 s2 = h[2] + (u64)load32_le(block +  8);
+  u64 s3 = h[3] + (u64)load32_le(block + 12);
+  u32 s4 = h[4] + hibit;
+
+  u32 r0  = r[0];
+  u32 r1  = r[1];
+  u32 r2  = r[2];
+  u32 r3  = r[3];
+  u32 rr0 = (r0 >> 2) * 5;
+  u32 rr1 = (r1 >> 2) + r1;
+  u32 rr2 = (r2 >> 2) + r2;
+  u32 rr3 = (r3 >> 2) + r3;
+
+  u64 x0 = s0*r0 + s1*rr3 + s2*rr2 + s3*rr1 + s4*rr0;
+  u64 x1 = s0*r1 + s1*r0  + s2*rr3 + s3*rr2 + s4*rr1;
+  u64 x2 = s0*r2 + s1*r1  + s2*r0  + s3*rr3 + s4*rr2;
+  u64 x3 = s0*r3 + s1*r2  + s2*r1  + s3*r0  + s4*rr3;
+  u32 x4 = s4 * (r0 & 3);
+
+  u32 u5 = x4 + (x3 >> 32);
+  u64 u0 = (u5 >>  2) * 5 + (x0 & 0xffffffff);
+  u64 u1 = (u0 >> 32)     + (x1 & 0xffffffff) + (x0 >> 32);
+  u64 u2 = (u1 >> 32)     + (x2 & 0xffffffff) + (x1 >> 32);
+  u64 u3 = (u2 >> 32)     + (x3 & 0xffffffff) + (x2 >> 32);
+  u64 u4 = (u3 >> 32)     + (u5 & 3);
+
+  h[0] = (u32)u0;
+  h[1] = (u32)u1;
+  h[2] = (u32)u2;
+  h[3] = (u32)u3;
+  h[4] = (u32)u4;
+}
+
+
+// Declare and load the state from the key
+#define SMALL_INIT(key)                                         \
+  u32 h[5] = {0, 0, 0, 0, 0};                                   \
+  u32 r[4] = {load32_le(key     ) & 0x0fffffff,                 \
+              load32_le(key +  4) & 0x0ffffffc,                 \
+              load32_le(key +  8) & 0x0ffffffc,                 \
+              load32_le(key + 12) & 0x0ffffffc};                \
+  u32 s[4] = {load32_le(key + 16), load32_le(key + 20),         \
+              load32_le(key + 24), load32_le(key + 28)}
+
+// Wipe the state declared by SMALL_INIT
+#define SMALL_WIPE()                                            \
+  WIPE_BUFFER(h);                                               \
+  WIPE_BUFFER(r);                                               \
+  WIPE_BUFFER(s)
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_16(u8 mac[16], u8 message[16], u8 key[32])
+{
+  SMALL_INIT(key);
+  small_block(h, r, message, 1);
+  poly_tag(mac, h, s);
+  SMALL_WIPE();
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_32(u8 mac[16], u8 message[32], u8 key[32])
+{
+  SMALL_INIT(key);
+  small_block(h, r, message     , 1);
+  small_block(h, r, message + 16, 1);
+  poly_tag(mac, h, s);
+  SMALL_WIPE();
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_64(u8 mac[16], u8 message[64], u8 key[32])
+{
+  SMALL_INIT(key);
+  small_block(h, r, message     , 1);
+  small_block(h, r, message + 16, 1);
+  small_block(h, r, message + 32, 1);
+  small_block(h, r, message + 48, 1);
+  poly_tag(mac, h, s);
+  SMALL_WIPE();
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static void poly_fingerprint(u8 fp[8], const u32 r[4])
+{
+  static const u8 block[16] = "P13S fingerprint";
+  u32 h[5] = {0, 0, 0, 0, 0};
+  u32 s[4] = {0, 0, 0, 0};
+  u8  tag[16];
+
+  small_block(h, r, (u8 *)block, 1);
+  poly_tag(tag, h, s);
+  FOR (i, 0, 8) { fp[i] = tag[i]; }
+  WIPE_BUFFER(h);
+  WIPE_BUFFER(tag);
+}
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_small()
+// Any message size up to 64 bytes. Longer messages are handed to
+// the incremental interface.
+//------------------------------------------------------------------
+void crypto_poly1305_small(u8 mac[16], u8 *message, size_t message_size,
+                           u8 key[32])
+{
+  if (message_size > 64) {
+    crypto_poly1305_ctx ctx;
+    crypto_poly1305_init  (&ctx, key);
+    crypto_poly1305_update(&ctx, message, message_size);
+    crypto_poly1305_final (&ctx, mac);
+    return;
+  }
+
+  SMALL_INIT(key);
+
+  // Full blocks, in message order
+  switch (message_size >> 4) {
+  case 4: small_block(h, r, message, 1); message += 16; // fall through
+  case 3: small_block(h, r, message, 1); message += 16; // fall through
+  case 2: small_block(h, r, message, 1); message += 16; // fall through
+  case 1: small_block(h, r, message, 1); message += 16; // fall through
+  default: break;
+  }
+
+  // Last, partial block padded with a 1 byte, no 2^128 bit
+  size_t tail = message_size & 15;
+  if (tail != 0) {
+    u8 block[16] = {0};
+    memcpy(block, message, tail);
+    block[tail] = 1;
+    small_block(h, r, block, 0);
+    WIPE_BUFFER(block);
+  }
+
+  poly_tag(mac, h, s);
+  SMALL_WIPE();
+}
+
+
+//------------------------------------------------------------------
+// Batch interface.
+//
+// With the AVX2 kernel, BATCH_LANES independent messages are
+// processed side by side, one block of each per step, in the 64 bit
+// lanes of two vectors. Every lane has its own r, so a step is one
+// multiplication h = (h + m) * r per lane, in radix 2^26 with the
+// arithmetic of the AVX2 kernel. As long as every message has full
+// blocks left the steps run back to back. When a message ends its
+// lane is finalized and refilled with the next message. Lanes left
+// without a message have r = 0 and compute nothing of use.
+//
+// Lanes only pay off in between. Up to 64 bytes the one-shot short
+// message path is as fast as a lane with its loading and finishing,
+// and long messages keep the 8 block steps of the AVX2 kernel busy
+// on their own. Those messages, and all messages with the other
+// kernels, are handed to crypto_poly1305() one by one.
+//------------------------------------------------------------------
+typedef struct {
+  u8    **macs;
+  u8    **messages;
+  size_t *message_sizes;
+  u8    **keys;
+  size_t  nb_messages;
+  size_t  next;    // next message to load into a lane
+  u64    *pass;    // verification bitmask, NULL to output the tags
+} poly_batch_job;
+
+
+//------------------------------------------------------------------
+// poly_batch_single()
+// MAC or verify message i on its own, the same as crypto_poly1305()
+// and crypto_poly1305_verify().
+//------------------------------------------------------------------
+static void poly_batch_single(poly_batch_job *job, size_t i)
+{
+  if (job->pass == NULL) {
+    crypto_poly1305(job->macs[i], job->messages[i], job->message_sizes[i],
+                    job->keys[i]);
+    return;
+  }
+
+  u64 ok = (u64)(crypto_poly1305_verify(job->macs[i], job->messages[i],
+                                        job->message_sizes[i],
+                                        job->keys[i]) + 1);
+  job->pass[i / 64] |= ok << (i % 64);
+}
+
+
+#ifdef POLY1305_AVX2
+#define BATCH_LANES 8
+
+typedef struct {
+  u64 h   [5][BATCH_LANES]; // accumulated hash, radix 2^26
+  u64 r   [5][BATCH_LANES]; // radix 2^26
+  u64 r5  [5][BATCH_LANES]; // 5 * r
+  u64 last   [BATCH_LANES]; // 2^24 if the block is the last, partial one
+  u32 s   [4][BATCH_LANES];
+  u8  tail[BATCH_LANES][16]; // last block padded, zeros for idle lanes
+} poly_batch_lanes;
+
+typedef struct {
+  u8     *message;
+  size_t  left;    // bytes of the message not yet in a block
+  size_t  index;   // message number, or SIZE_MAX if idle
+} poly_batch_lane;
+
+
+//------------------------------------------------------------------
+// poly_batch_retire()
+// Output the tag of message i, or compare it with the expected tag
+// and record the result when verifying.
+//------------------------------------------------------------------
+static void poly_batch_retire(poly_batch_job *job, size_t i,
+                              const u8 tag[16])
+{
+  if (job->pass == NULL) {
+    FOR (j, 0, 16) { job->macs[i][j] = tag[j]; }
+    return;
+  }
+
+  u64 ok = (u64)(crypto_verify16(tag, job->macs[i]) + 1);
+  job->pass[i / 64] |= ok << (i % 64);
+}
+
+
+//------------------------------------------------------------------
+// poly_batch_steps()
+// h = (h + m) * r for all lanes, nb_steps times. The block of lane l
+// in step k is at block[l] + k * stride[l]. The 2^128 bit is cleared
+// in the lanes with last set.
+//------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void poly_batch_steps(poly_batch_lanes *b, u8 *block[BATCH_LANES],
+                             const size_t stride[BATCH_LANES],
+                             size_t nb_steps)
+{
+  __m256i h[2][5], r[2][5], s[2][5], last[2], m[5], d[5];
+  FOR (g, 0, 2) {
+    FOR (j, 0, 5) {
+      h[g][j] = _mm256_loadu_si256((const __m256i *)&b->h [j][g * 4]);
+      r[g][j] = _mm256_loadu_si256((const __m256i *)&b->r [j][g * 4]);
+      s[g][j] = _mm256_loadu_si256((const __m256i *)&b->r5[j][g * 4]);
+    }
+    last[g] = _mm256_loadu_si256((const __m256i *)&b->last[g * 4]);
+  }
+
+  u8 *p[BATCH_LANES];
+  FOR (l, 0, BATCH_LANES) { p[l] = block[l]; }
+
+  FOR (k, 0, nb_steps) {
+    FOR (g, 0, 2) {
+      u8 **q = p + g * 4;
+      __m256i lo = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)q[0])),
+        _mm_loadu_si128((const __m128i *)q[1]), 1);
+      __m256i hi = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)q[2])),
+        _mm_loadu_si128((const __m128i *)q[3]), 1);
+      avx2_split_blocks(m, lo, hi);
+      m[4] = _mm256_xor_si256(m[4], last[g]);
+
+      FOR (j, 0, 5) {
+        m[j] = _mm256_add_epi64(m[j], h[g][j]);
+        d[j] = _mm256_setzero_si256();
+      }
+      avx2_mul_acc(d, m, r[g], s[g]);
+      avx2_carry(h[g], d);
+    }
+    FOR (l, 0, BATCH_LANES) { p[l] += stride[l]; }
+  }
+
+  FOR (g, 0, 2) {
+    FOR (j, 0, 5) {
+      _mm256_storeu_si256((__m256i *)&b->h[j][g * 4], h[g][j]);
+    }
+  }
+  _mm256_zeroupper();
+}
+
+
+//------------------------------------------------------------------
+// poly_batch_finish()
+// Finalize the message of the lane.
+//------------------------------------------------------------------
+static void poly_batch_finish(poly_batch_lanes *b, size_t l,
+                              poly_batch_job *job, size_t i)
+{
+  u64 h26[5];
+  u32 h[5];
+  u32 s[4];
+  u8  tag[16];
+
+  FOR (j, 0, 5) { h26[j] = b->h[j][l]; }
+  FOR (j, 0, 4) { s[j]   = b->s[j][l]; }
+  poly26_to32(h, h26);
+  poly_tag(tag, h, s);
+  poly_batch_retire(job, i, tag);
+  WIPE_BUFFER(h26);
+  WIPE_BUFFER(h);
+  WIPE_BUFFER(s);
+  WIPE_BUFFER(tag);
+}
+
+
+//------------------------------------------------------------------
+// poly_batch_refill()
+// Load the next message into the lane. Messages of up to 64 bytes,
+// which have the one-shot short message path, and messages of more
+// than POLY1305_BATCH_MAX_BLOCKS blocks are MACed right away with
+// crypto_poly1305(). The lane is left idle, with r = 0, when there
+// are no more messages.
+//------------------------------------------------------------------
+static void poly_batch_refill(poly_batch_lanes *b, poly_batch_lane *lane,
+                              size_t l, poly_batch_job *job)
+{
+  u32 r[5], r26[5];
+
+  lane->index = SIZE_MAX;
+  FOR (j, 0, 5) {
+    b->h [j][l] = 0;
+    b->r [j][l] = 0;
+    b->r5[j][l] = 0;
+  }
+  while (job->next < job->nb_messages) {
+    size_t i = job->next++;
+    u8 *key  = job->keys[i];
+
+    size_t size = job->message_sizes[i];
+    if (size <= 64 || size > POLY1305_BATCH_MAX_BLOCKS * 16) {
+      poly_batch_single(job, i);
+      continue;
+    }
+
+    FOR (j, 0, 4) { b->s[j][l] = load32_le(key + j*4 + 16); }
+
+    r[0] = load32_le(key     ) & 0x0fffffff;
+    r[1] = load32_le(key +  4) & 0x0ffffffc;
+    r[2] = load32_le(key +  8) & 0x0ffffffc;
+    r[3] = load32_le(key + 12) & 0x0ffffffc;
+    r[4] = 0;
+    poly26_from32(r26, r);
+    FOR (j, 0, 5) {
+      b->r [j][l] = r26[j];
+      b->r5[j][l] = (u64)r26[j] * 5;
+    }
+    WIPE_BUFFER(r);
+    WIPE_BUFFER(r26);
+
+    lane->message = job->messages[i];
+    lane->left    = job->message_sizes[i];
+    lane->index   = i;
+    return;
+  }
+}
+
+
+//------------------------------------------------------------------
+// poly_batch_lanes_run()
+// Run all messages of the job through the lanes. As many steps as
+// the shortest message has full blocks left are run at once. When a
+// lane has no full block left, a single step takes the last, partial
+// block of that lane and full blocks of the others.
+//------------------------------------------------------------------
+static void poly_batch_lanes_run(poly_batch_job *job)
+{
+  poly_batch_lanes b;
+  poly_batch_lane  lanes[BATCH_LANES];
+  u8    *block [BATCH_LANES];
+  size_t stride[BATCH_LANES];
+  size_t active = 0;
+
+  memset(&b, 0, sizeof(b));
+  FOR (l, 0, BATCH_LANES) {
+    poly_batch_refill(&b, &lanes[l], l, job);
+    active += lanes[l].index != SIZE_MAX;
+  }
+
+  while (active > 0) {
+    size_t nb_steps = SIZE_MAX;
+    FOR (l, 0, BATCH_LANES) {
+      if (lanes[l].index != SIZE_MAX && lanes[l].left / 16 < nb_steps) {
+        nb_steps = lanes[l].left / 16;
+      }
+    }
+
+    FOR (l, 0, BATCH_LANES) {
+      poly_batch_lane *lane = &lanes[l];
+      b.last[l] = 0;
+      if (lane->index == SIZE_MAX) {
+        block [l] = b.tail[l];
+        stride[l] = 0;
+      }
+      else if (lane->left >= 16) {
+        size_t n = nb_steps ? nb_steps : 1;
+        block [l] = lane->message;
+        stride[l] = 16;
+        lane->message += n * 16;
+        lane->left    -= n * 16;
+      }
+      else {
+        // Last, partial block. Pad with a 1 byte, no 2^128 bit.
+        FOR (j, 0, 16) { b.tail[l][j] = 0; }
+        FOR (j, 0, lane->left) { b.tail[l][j] = lane->message[j]; }
+        b.tail[l][lane->left] = 1;
+        b.last[l] = 1 << 24;
+        block [l] = b.tail[l];
+        stride[l] = 0;
+        lane->left = 0;
+      }
+    }
+
+    poly_batch_steps(&b, block, stride, nb_steps ? nb_steps : 1);
+
+    // Finalize ended messages and refill their lanes.
+    FOR (l, 0, BATCH_LANES) {
+      poly_batch_lane *lane = &lanes[l];
+      if (lane->index == SIZE_MAX || lane->left > 0) {
+        continue;
+      }
+      FOR (j, 0, 16) { b.tail[l][j] = 0; }
+      poly_batch_finish(&b, l, job, lane->index);
+      poly_batch_refill(&b, lane, l, job);
+      active -= lane->index == SIZE_MAX;
+    }
+  }
+
+  WIPE_CTX(&b);
+}
+#endif // POLY1305_AVX2
+
+
+//------------------------------------------------------------------
+// poly_batch()
+// Run all messages of the job, in lanes with the AVX2 kernel, one
+// at a time otherwise.
+//------------------------------------------------------------------
+static void poly_batch(poly_batch_job *job)
+{
+  PERF_SAMPLE(sample);
+  PERF_BEGIN(sample);
+
+#ifdef POLY1305_AVX2
+  if (poly_kernel_get()->blocks == poly_blocks_avx2_tail) {
+    poly_batch_lanes_run(job);
+  }
+  else
+#endif
+  {
+    for (; job->next < job->nb_messages; job->next++) {
+      poly_batch_single(job, job->next);
+    }
+  }
+
+#ifdef POLY1305_PERF
+  size_t total_size = 0;
+  FOR (i, 0, job->nb_messages) {
+    total_size += job->message_sizes[i];
+  }
+  PERF_END(sample, "batch", total_size);
+#endif
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_batch(u8 *macs[], u8 *messages[],
+                           size_t message_sizes[], u8 *keys[],
+                           size_t nb_messages)
+{
+  poly_batch_job job = {macs, messages, message_sizes, keys,
+                        nb_messages, 0, NULL};
+  poly_batch(&job);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int crypto_poly1305_batch_verify(u64 pass[],
+                                 u8 *macs[], u8 *messages[],
+                                 size_t message_sizes[], u8 *keys[],
+                                 size_t nb_messages)
+{
+  size_t nb_words = (nb_messages + 63) / 64;
+  FOR (i, 0, nb_words) {
+    pass[i] = 0;
+  }
+
+  poly_batch_job job = {macs, messages, message_sizes, keys,
+                        nb_messages, 0, pass};
+  poly_batch(&job);
+
+  // All bits set, in constant time. The top bit of fail | -fail is
+  // set when fail is not zero.
+  u64 fail = 0;
+  FOR (i, 0, nb_words) {
+    u64 want = i + 1 < nb_words || nb_messages % 64 == 0
+             ? ~(u64)0 : ((u64)1 << (nb_messages % 64)) - 1;
+    fail |= pass[i] ^ want;
+  }
+  return -(int)((fail | (0 - fail)) >> 63);
+}
+
+
+//------------------------------------------------------------------
+// Partial evaluation.
+//
+// The MAC is the polynomial h = m_1*r^n + m_2*r^(n-1) + ... + m_n*r
+// (plus s), so a message can be split into consecutive chunks that
+// are evaluated on their own. A chunk covering k blocks evaluates
+// to h_c = m_1*r^k + ... + m_k*r. Two adjacent partials combine as
+// h = h_a * r^k_b + h_b, which is associative.
+//------------------------------------------------------------------
+void crypto_poly1305_chunk(crypto_poly1305_partial *partial, u8 key[32],
+                           u8 *chunk, size_t chunk_size)
+{
+  crypto_poly1305_ctx ctx;
+  crypto_poly1305_init  (&ctx, key);
+  crypto_poly1305_update(&ctx, chunk, chunk_size);
+
+  // Last, partial block of the message, as in crypto_poly1305_final()
+  if (ctx.c_idx != 0) {
+    ctx.c[4] = 0;
+    poly_take_input(&ctx, 1);
+    poly_block(&ctx);
+  }
+
+  FOR (i, 0, 5) { partial->h[i] = ctx.h[i]; }
+  partial->nb_blocks = (chunk_size + 15) >> 4;
+  WIPE_CTX(&ctx);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_combine(crypto_poly1305_partial *acc,
+                             const crypto_poly1305_partial *next,
+                             u8 key[32])
+{
+  u32 r[5] = {load32_le(key     ) & 0x0fffffff,
+              load32_le(key +  4) & 0x0ffffffc,
+              load32_le(key +  8) & 0x0ffffffc,
+              load32_le(key + 12) & 0x0ffffffc,
+              0};
+  u32 r26[5], rk[5], a26[5], b26[5];
+  u64 sum[5];
+
+  poly26_from32(r26, r);
+  poly26_pow(rk, r26, next->nb_blocks);
+  poly26_from32(a26, acc->h);
+  poly26_from32(b26, next->h);
+  poly26_mul(a26, a26, rk);
+  FOR (i, 0, 5) { sum[i] = (u64)a26[i] + b26[i]; }
+  poly26_to32(acc->h, sum);
+  acc->nb_blocks += next->nb_blocks;
+
+  WIPE_BUFFER(r);
+  WIPE_BUFFER(r26);
+  WIPE_BUFFER(rk);
+  WIPE_BUFFER(a26);
+  WIPE_BUFFER(b26);
+  WIPE_BUFFER(sum);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void crypto_poly1305_partial_final(u8 mac[16],
+                                   const crypto_poly1305_partial *partial,
+                                   u8 key[32])
+{
+  u32 s[4];
+  FOR (i, 0, 4) { s[i] = load32_le(key + i*4 + 16); }
+  poly_tag(mac, partial->h, s);
+  WIPE_BUFFER(s);
+}
+
+
+//------------------------------------------------------------------
+// Known answer tests for the kernel self test. The RFC 8439 test
+// vector in section 2.5.2, and the same message repeated eight
+// times, which is long enough for the vector kernels.
+//------------------------------------------------------------------
+static const u8 kat_key[32] = {
+  0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+  0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+  0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+  0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+static const u8 kat_message[34] = {
+  0x43, 0x72, 0x79, 0x70, 0x74, 0x6f, 0x67, 0x72,
+  0x61, 0x70, 0x68, 0x69, 0x63, 0x20, 0x46, 0x6f,
+  0x72, 0x75, 0x6d, 0x20, 0x52, 0x65, 0x73, 0x65,
+  0x61, 0x72, 0x63, 0x68, 0x20, 0x47, 0x72, 0x6f,
+  0x75, 0x70};
+
+static const u8 kat_tag_x1[16] = {
+  0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6,
+  0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9};
+
+static const u8 kat_tag_x8[16] = {
+  0xa6, 0xce, 0x7a, 0x9a, 0x78, 0x85, 0x39, 0xfc,
+  0xb4, 0x53, 0xe6, 0xe7, 0x26, 0xdd, 0xd1, 0x06};
+
+
+//------------------------------------------------------------------
+// poly_kernel_mac()
+// MAC a message using the given kernel for all full blocks.
+//------------------------------------------------------------------
+static void poly_kernel_mac(const poly_kernel *kernel, u8 mac[16],
+                            u8 *message, size_t message_size)
+{
+  crypto_poly1305_ctx ctx;
+  size_t nb_blocks = message_size >> 4;
+
+  crypto_poly1305_init(&ctx, (u8 *)kat_key);
+  kernel->blocks(&ctx, message, nb_blocks);
+  poly_clear_c(&ctx);
+  poly_update(&ctx, message + nb_blocks * 16, message_size & 15);
+  crypto_poly1305_final(&ctx, mac);
+}
+
+
+//------------------------------------------------------------------
+// poly_kernel_selftest()
+// Returns 0 if the kernel is supported and produces the expected
+// tags, -1 otherwise.
+//------------------------------------------------------------------
+static int poly_kernel_selftest(const poly_kernel *kernel)
+{
+  if (!kernel->supported()) {
+    return -1;
+  }
+
+#ifdef POLY1305_TRACE
+  // Keep the self test out of the trace.
+  const crypto_poly1305_trace_hooks *saved_hooks = trace_hooks;
+  trace_hooks = NULL;
+#endif
+
+  u8 message[8 * sizeof(kat_message)];
+  u8 tag_x1[16];
+  u8 tag_x8[16];
+  FOR (i, 0, sizeof(message)) {
+    message[i] = kat_message[i % sizeof(kat_message)];
+  }
+  poly_kernel_mac(kernel, tag_x1, message, sizeof(kat_message));
+  poly_kernel_mac(kernel, tag_x8, message, sizeof(message));
+
+#ifdef POLY1305_TRACE
+  trace_hooks = saved_hooks;
+#endif
+
+  return (memcmp(tag_x1, kat_tag_x1, 16) == 0 &&
+          memcmp(tag_x8, kat_tag_x8, 16) == 0) ? 0 : -1;
+}
+
+
+//------------------------------------------------------------------
+// poly_kernel_find()
+//------------------------------------------------------------------
+static const poly_kernel *poly_kernel_find(const char *name)
+{
+  FOR (i, 0, NB_KERNELS) {
+    if (strcmp(poly_kernels[i].name, name) == 0) {
+      return &poly_kernels[i];
+    }
+  }
+  return NULL;
+}
+
+
+//------------------------------------------------------------------
+// poly_kernel_init()
+// Select the kernel, called once. The kernel named by the
+// environment variable POLY1305_KERNEL is used if it is usable,
+// otherwise the first usable kernel in the registry.
+//------------------------------------------------------------------
+static void poly_kernel_init(void)
+{
+  const char *forced = getenv("POLY1305_KERNEL");
+  if (forced && *forced) {
+    const poly_kernel *kernel = poly_kernel_find(forced);
+    if (kernel && poly_kernel_selftest(kernel) == 0) {
+      atomic_store_explicit(&poly_kernel_active, kernel,
+                            memory_order_release);
+      return;
+    }
+    fprintf(stderr, "poly1305: kernel '%s' is not usable, "
+            "selecting automatically.\n", forced);
+  }
+
+  FOR (i, 0, NB_KERNELS) {
+    if (poly_kernel_selftest(&poly_kernels[i]) == 0) {
+      atomic_store_explicit(&poly_kernel_active, &poly_kernels[i],
+                            memory_order_release);
+      return;
+    }
+  }
+
+  // The reference kernel is always supported. If even that one
+  // fails the self test the build is broken.
+  fprintf(stderr, "poly1305: no kernel passed the self test.\n");
+  abort();
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+const char *crypto_poly1305_kernel_name(size_t i)
+{
+  return i < NB_KERNELS ? poly_kernels[i].name : NULL;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+const char *crypto_poly1305_active_kernel(void)
+{
+  return poly_kernel_get()->name;
+}
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_select_kernel()
+// The automatic selection, and with it POLY1305_KERNEL, is done
+// first, so an explicit selection always replaces it, whichever
+// thread gets to the first MAC.
+//------------------------------------------------------------------
+int crypto_poly1305_select_kernel(const char *name)
+{
+  pthread_once(&poly_kernel_once, poly_kernel_init);
+
+  const poly_kernel *kernel = poly_kernel_find(name);
+  if (!kernel || poly_kernel_selftest(kernel) != 0) {
+    return -1;
+  }
+  atomic_store_explicit(&poly_kernel_active, kernel, memory_order_release);
+  return 0;
+}
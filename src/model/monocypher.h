@@ -2,7 +2,13 @@
 #define MONOCYPHER_H
 
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stddef.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 ////////////////////////
 /// Type definitions ///
@@ -15,10 +21,38 @@ typedef struct {
     uint32_t c[5];   // chunk of the message
     uint32_t s[4];   // random nonce added at the end (from the secret key)
     size_t   c_idx;  // How many bytes are there in the chunk.
+    uint32_t rr[4];  // (r >> 2) * 5, for the reduction in poly_block()
+    uint32_t rpow[8][5]; // r^1..r^8 in radix 2^26, for the vector kernel
+    uint32_t rpow_ready; // rpow has been computed
 } crypto_poly1305_ctx;
 
+// Key schedule, everything derived from a key, computed once
+typedef struct {
+    uint32_t r[4];       // clamped multiplier
+    uint32_t rr[4];      // (r >> 2) * 5
+    uint32_t s[4];       // nonce added at the end
+    uint32_t rpow[8][5]; // r^1..r^8 in radix 2^26
+} crypto_poly1305_key;
+
+// Poly1305 as used in the RFC 8439 AEAD construction
+typedef struct {
+    crypto_poly1305_ctx poly;
+    uint64_t ad_size;    // bytes of additional data so far
+    uint64_t text_size;  // bytes of ciphertext so far
+    int      ad_padded;  // additional data done and padded
+} crypto_poly1305_aead_ctx;
+
+// Partial evaluation of a chunk of a message
+typedef struct {
+    uint32_t h[5];       // chunk evaluated as a polynomial in r
+    uint64_t nb_blocks;  // number of blocks in the chunk
+} crypto_poly1305_partial;
+
 
 // Utility functions.
+void crypto_wipe(void *secret, size_t size);
+// Constant time comparison, 0 if equal, -1 otherwise
+int  crypto_verify16(const uint8_t a[16], const uint8_t b[16]);
 void print_hexdata(uint8_t *data, uint32_t len);
 void print_context(crypto_poly1305_ctx *ctx);
 
@@ -31,11 +65,201 @@ void crypto_poly1305(uint8_t mac[16],
                      uint8_t *message, size_t message_size,
                      uint8_t  key[32]);
 
+// Verification
+// Computes the tag of the message and compares it with mac in
+// constant time. Returns 0 if they match, -1 otherwise.
+int crypto_poly1305_verify(const uint8_t mac[16],
+                           uint8_t *message, size_t message_size,
+                           uint8_t  key[32]);
+
+// Short message interface
+// Same result as crypto_poly1305(), for fixed sizes of 16, 32 and 64
+// bytes and any size up to 64 bytes. crypto_poly1305() uses these
+// for short messages.
+void crypto_poly1305_16   (uint8_t mac[16], uint8_t message[16],
+                           uint8_t key[32]);
+void crypto_poly1305_32   (uint8_t mac[16], uint8_t message[32],
+                           uint8_t key[32]);
+void crypto_poly1305_64   (uint8_t mac[16], uint8_t message[64],
+                           uint8_t key[32]);
+void crypto_poly1305_small(uint8_t mac[16],
+                           uint8_t *message, size_t message_size,
+                           uint8_t key[32]);
+
 // Incremental interface
 void crypto_poly1305_init  (crypto_poly1305_ctx *ctx, uint8_t key[32]);
 void crypto_poly1305_update(crypto_poly1305_ctx *ctx,
                             uint8_t *message, size_t message_size);
 void crypto_poly1305_final (crypto_poly1305_ctx *ctx, uint8_t mac[16]);
 
+// Key schedule interface
+// crypto_poly1305_key_init() parses and clamps the key and computes
+// the powers of r once. crypto_poly1305_init_key() then starts a
+// context from the schedule by copy, for the same result as
+// crypto_poly1305_init() with the key. Wipe the schedule with
+// crypto_wipe() when done.
+void crypto_poly1305_key_init(crypto_poly1305_key *ks, uint8_t key[32]);
+void crypto_poly1305_init_key(crypto_poly1305_ctx *ctx,
+                              const crypto_poly1305_key *ks);
+
+// Serialized mid-state
+// crypto_poly1305_save() stores a context between updates, and
+// crypto_poly1305_restore() continues the MAC from the stored state
+// with the key the MAC was started with. It returns -1 if the state
+// is not a valid state of this version, or was made with another
+// key. The key is not stored: r and s are derived from the key
+// again, and keys are matched by a 64 bit fingerprint of r. s, and
+// therefore the tag, can not be recovered from a state. h and the
+// message give r away though, so treat the state as private as r and
+// wipe it with crypto_wipe() after use. Stored as little endian 32
+// bit words:
+//
+//   magic, version, h[0..4], c[0..3], c_idx, fingerprint[0..1]
+#define CRYPTO_POLY1305_STATE_MAGIC   0x53333150 // "P13S"
+#define CRYPTO_POLY1305_STATE_VERSION 2
+#define CRYPTO_POLY1305_STATE_SIZE    56
+void crypto_poly1305_save   (uint8_t state[CRYPTO_POLY1305_STATE_SIZE],
+                             const crypto_poly1305_ctx *ctx);
+int  crypto_poly1305_restore(crypto_poly1305_ctx *ctx,
+                             uint8_t state[CRYPTO_POLY1305_STATE_SIZE],
+                             uint8_t key[32]);
+
+// Internal, for contexts kept elsewhere (poly1305_flow). Set the
+// clamped r of ctx and the multiples derived from it. The powers of
+// r are computed again by the kernels if needed.
+void crypto_poly1305_set_r(crypto_poly1305_ctx *ctx, const uint32_t r[4]);
+
+// Scatter-gather update, same as one crypto_poly1305_update() per
+// fragment but without the byte by byte path at fragment boundaries.
+void crypto_poly1305_updatev(crypto_poly1305_ctx *ctx,
+                             const struct iovec *iov, size_t iovcnt);
+
+// Fused copy and update, same as memcpy(dst, src, size) followed by
+// crypto_poly1305_update() on src, but done in chunks small enough
+// to stay in the L1 cache, so the data is only read from memory
+// once. From POLY1305_COPY_NT_THRESHOLD bytes dst is written with
+// non-temporal stores where available, bypassing the cache. dst and
+// src must not overlap.
+#ifndef POLY1305_COPY_CHUNK
+#define POLY1305_COPY_CHUNK (8 * 1024)
+#endif
+#ifndef POLY1305_COPY_NT_THRESHOLD
+#define POLY1305_COPY_NT_THRESHOLD (1024 * 1024)
+#endif
+void crypto_poly1305_update_copy(crypto_poly1305_ctx *ctx, uint8_t *dst,
+                                 const uint8_t *src, size_t size);
+
+// AEAD interface
+// Computes the tag of the RFC 8439 AEAD construction. The additional
+// data and the ciphertext can each be given in any number of pieces,
+// but all additional data must come before the ciphertext. Padding
+// and the size block are handled internally.
+void crypto_poly1305_aead_init (crypto_poly1305_aead_ctx *ctx,
+                                uint8_t key[32]);
+void crypto_poly1305_aead_ad   (crypto_poly1305_aead_ctx *ctx,
+                                uint8_t *ad, size_t ad_size);
+void crypto_poly1305_aead_text (crypto_poly1305_aead_ctx *ctx,
+                                uint8_t *text, size_t text_size);
+void crypto_poly1305_aead_final(crypto_poly1305_aead_ctx *ctx,
+                                uint8_t mac[16]);
+
+// Batch interface
+// Computes macs[i] for messages[i] of message_sizes[i] bytes with
+// keys[i], for i < nb_messages. With the AVX2 kernel, messages of 65
+// bytes to POLY1305_BATCH_MAX_BLOCKS blocks (1536 bytes) are MACed 8
+// at a time in vector lanes, 1.3 to 2 times faster than calling
+// crypto_poly1305() for each. Shorter and longer messages, and all
+// messages with the other kernels, are MACed one at a time, as fast
+// as calling crypto_poly1305() but no faster.
+void crypto_poly1305_batch(uint8_t *macs[], uint8_t *messages[],
+                           size_t message_sizes[], uint8_t *keys[],
+                           size_t nb_messages);
+
+// Batch verification
+// Same as crypto_poly1305_batch(), but compares the computed tags
+// with macs[i] in constant time as the messages end. Bit i % 64 of
+// pass[i / 64] is set if message i verifies, so pass must hold
+// (nb_messages + 63) / 64 words. Returns 0 if all messages verify,
+// -1 otherwise. Messages are processed as by crypto_poly1305_batch(),
+// in lanes where that is faster and with crypto_poly1305_verify()
+// otherwise.
+int crypto_poly1305_batch_verify(uint64_t pass[],
+                                 uint8_t *macs[], uint8_t *messages[],
+                                 size_t message_sizes[], uint8_t *keys[],
+                                 size_t nb_messages);
+
+// Partial evaluation interface
+// A message can be split into chunks that are evaluated
+// independently, possibly on different threads or machines. Every
+// chunk except the last must be a multiple of 16 bytes. Partials
+// of adjacent chunks are combined in message order, acc followed
+// by next, into acc. The result is identical to crypto_poly1305().
+void crypto_poly1305_chunk(crypto_poly1305_partial *partial,
+                           uint8_t key[32],
+                           uint8_t *chunk, size_t chunk_size);
+void crypto_poly1305_combine(crypto_poly1305_partial *acc,
+                             const crypto_poly1305_partial *next,
+                             uint8_t key[32]);
+void crypto_poly1305_partial_final(uint8_t mac[16],
+                                   const crypto_poly1305_partial *partial,
+                                   uint8_t key[32]);
+
+
+// Block kernels
+// -------------
+// The full message blocks are processed by one of several kernels.
+// The first time a MAC is computed the fastest kernel supported by
+// the CPU that passes a known answer self test is selected. Setting
+// the environment variable POLY1305_KERNEL to a kernel name forces
+// that kernel, if it is usable.
+//
+// crypto_poly1305_kernel_name() returns the name of kernel i, or
+// NULL if there are no more kernels. crypto_poly1305_select_kernel()
+// returns 0 if the kernel was selected, -1 if the kernel is unknown,
+// not supported or fails the self test. It always takes precedence
+// over POLY1305_KERNEL, which only affects the automatic selection.
+// It may be called while other threads are computing MACs. Blocks
+// already being processed finish with the previous kernel, so a
+// context can have its blocks processed by both.
+const char *crypto_poly1305_kernel_name(size_t i);
+const char *crypto_poly1305_active_kernel(void);
+int         crypto_poly1305_select_kernel(const char *name);
+
+
+// Tracing
+// -------
+// Only available when the model is built with POLY1305_TRACE
+// defined. The hooks are called with the free-form debug text,
+// message and key data, and context dumps at every step of the
+// processing. The record hook gets the intermediate values of
+// every block and of the final step, in the order listed below,
+// widened to 64 bits. Any hook may be NULL. Installing a NULL hook
+// table silences the trace. The default is
+// crypto_poly1305_trace_print which dumps everything to stdout.
+// poly1305_trace.h has a second implementation writing the records
+// to a binary file.
+enum {
+    CRYPTO_POLY1305_TRACE_BLOCK = 1, // s0..s4, rr0..rr3, x0..x4, u0..u5
+    CRYPTO_POLY1305_TRACE_FINAL = 2  // u0..u4, uu0..uu3
+};
+#define CRYPTO_POLY1305_TRACE_BLOCK_VALUES 20
+#define CRYPTO_POLY1305_TRACE_FINAL_VALUES 9
+
+#ifdef POLY1305_TRACE
+typedef struct {
+    void (*text)   (const char *fmt, va_list ap);
+    void (*hexdata)(const uint8_t *data, size_t len);
+    void (*context)(const crypto_poly1305_ctx *ctx);
+    void (*record) (int kind, const uint64_t *values, size_t nb_values);
+} crypto_poly1305_trace_hooks;
+
+extern const crypto_poly1305_trace_hooks crypto_poly1305_trace_print;
+
+void crypto_poly1305_set_trace_hooks(const crypto_poly1305_trace_hooks *hooks);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // MONOCYPHER_H
@@ -0,0 +1,365 @@
+//======================================================================
+//
+// poly1305.hpp
+// ------------
+// Header-only C++20 interface to the C model. A move-only context
+// that wipes itself, std::span inputs, and one-shot MACs that can
+// be evaluated at compile time. The message length and the kernel
+// are template parameters, resolved at compile time: fixed size
+// messages call the matching short message function directly, and
+// the inline32 kernel is inlined into the caller.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef POLY1305_HPP
+#define POLY1305_HPP
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include "monocypher.h"
+
+namespace poly1305 {
+
+using tag = std::array<std::uint8_t, 16>;
+using key = std::span<const std::uint8_t, 32>;
+
+// Where the MAC is computed.
+//   inline32   The 32 bit reference arithmetic below, the same as
+//              poly_block() and the RTL. constexpr and fully
+//              inlined into the caller.
+//   library    The C library. Messages of a fixed size of 16, 32 or
+//              64 bytes go straight to the matching short message
+//              function, others to crypto_poly1305() and its run
+//              time selected bulk kernel. Evaluated with inline32
+//              at compile time.
+//   automatic  inline32 at compile time, library at run time. The
+//              short message functions are as fast as inline32.
+enum class kernel { automatic, inline32, library };
+
+
+namespace detail {
+
+// State of the inline32 kernel, limbs as in crypto_poly1305_ctx.
+struct state {
+  std::uint32_t r[4]  = {};
+  std::uint32_t rr[4] = {};
+  std::uint32_t s[4]  = {};
+  std::uint32_t h[5]  = {};
+};
+
+constexpr std::uint32_t load32_le(const std::uint8_t *p)
+{
+  return  (std::uint32_t)p[0]        | ((std::uint32_t)p[1] <<  8) |
+         ((std::uint32_t)p[2] << 16) | ((std::uint32_t)p[3] << 24);
+}
+
+constexpr void init(state &st, key k)
+{
+  st.r[0] = load32_le(&k[0]) & 0x0fffffff;
+  for (int i = 1 ; i < 4 ; i++) {
+    st.r[i] = load32_le(&k[i * 4]) & 0x0ffffffc;
+  }
+  for (int i = 0 ; i < 4 ; i++) {
+    st.rr[i] = (st.r[i] >> 2) * 5;
+    st.s[i]  = load32_le(&k[16 + i * 4]);
+  }
+}
+
+// h = (h + c) * r, as poly_block() in monocypher.c.
+constexpr void block(state &st, const std::uint8_t *m, std::uint32_t c4)
+{
+  using u64 = std::uint64_t;
+  const u64 s0 = st.h[0] + (u64)load32_le(m);
+  const u64 s1 = st.h[1] + (u64)load32_le(m + 4);
+  const u64 s2 = st.h[2] + (u64)load32_le(m + 8);
+  const u64 s3 = st.h[3] + (u64)load32_le(m + 12);
+  const std::uint32_t s4 = st.h[4] + c4;
+
+  const u64 r0  = st.r[0],  r1  = st.r[1],  r2  = st.r[2],  r3  = st.r[3];
+  const u64 rr0 = st.rr[0], rr1 = st.rr[1], rr2 = st.rr[2], rr3 = st.rr[3];
+
+  const u64 x0 = s0*r0 + s1*rr3 + s2*rr2 + s3*rr1 + s4*rr0;
+  const u64 x1 = s0*r1 + s1*r0  + s2*rr3 + s3*rr2 + s4*rr1;
+  const u64 x2 = s0*r2 + s1*r1  + s2*r0  + s3*rr3 + s4*rr2;
+  const u64 x3 = s0*r3 + s1*r2  + s2*r1  + s3*r0  + s4*rr3;
+  const std::uint32_t x4 = s4 * (st.r[0] & 3);
+
+  const std::uint32_t u5 = x4 + (std::uint32_t)(x3 >> 32);
+  const u64 u0 = (u5 >>  2) * 5 + (x0 & 0xffffffff);
+  const u64 u1 = (u0 >> 32)     + (x1 & 0xffffffff) + (x0 >> 32);
+  const u64 u2 = (u1 >> 32)     + (x2 & 0xffffffff) + (x1 >> 32);
+  const u64 u3 = (u2 >> 32)     + (x3 & 0xffffffff) + (x2 >> 32);
+  const u64 u4 = (u3 >> 32)     + (u5 & 3);
+
+  st.h[0] = (std::uint32_t)u0;
+  st.h[1] = (std::uint32_t)u1;
+  st.h[2] = (std::uint32_t)u2;
+  st.h[3] = (std::uint32_t)u3;
+  st.h[4] = (std::uint32_t)u4;
+}
+
+// mac = (h + s) mod 2^128, as crypto_poly1305_final().
+constexpr tag finish(const state &st)
+{
+  using u64 = std::uint64_t;
+  const u64 u0 = (u64)5     + st.h[0];
+  const u64 u1 = (u0 >> 32) + st.h[1];
+  const u64 u2 = (u1 >> 32) + st.h[2];
+  const u64 u3 = (u2 >> 32) + st.h[3];
+  const u64 u4 = (u3 >> 32) + st.h[4];
+
+  u64 uu[4] = {};
+  uu[0] = (u4 >> 2) * 5 + st.h[0] + st.s[0];
+  for (int i = 1 ; i < 4 ; i++) {
+    uu[i] = (uu[i - 1] >> 32) + st.h[i] + st.s[i];
+  }
+
+  tag mac{};
+  for (int i = 0 ; i < 16 ; i++) {
+    mac[i] = (std::uint8_t)(uu[i / 4] >> ((i % 4) * 8));
+  }
+  return mac;
+}
+
+template <std::size_t N>
+constexpr tag mac_inline32(std::span<const std::uint8_t, N> message, key k)
+{
+  state st;
+  init(st, k);
+
+  const std::size_t size = message.size();
+  std::size_t i = 0;
+  for ( ; i + 16 <= size ; i += 16) {
+    block(st, &message[i], 1);
+  }
+  if (i < size) {
+    std::uint8_t last[16] = {};
+    for (std::size_t j = 0 ; i + j < size ; j++) {
+      last[j] = message[i + j];
+    }
+    last[size - i] = 1;
+    block(st, last, 0);
+  }
+
+  // Also used at run time. As the short message functions in
+  // monocypher.c, wipe r, s and h once the tag is out.
+  const tag mac = finish(st);
+  if (!std::is_constant_evaluated()) {
+    crypto_wipe(&st, sizeof st);
+  }
+  return mac;
+}
+
+// The C interface predates const, it does not write the message
+// or the key.
+inline std::uint8_t *unconst(const std::uint8_t *p)
+{
+  return const_cast<std::uint8_t *>(p);
+}
+
+template <std::size_t N>
+inline tag mac_library(std::span<const std::uint8_t, N> message, key k)
+{
+  tag mac;
+  if constexpr (N == 16) {
+    crypto_poly1305_16(mac.data(), unconst(message.data()), unconst(k.data()));
+  }
+  else if constexpr (N == 32) {
+    crypto_poly1305_32(mac.data(), unconst(message.data()), unconst(k.data()));
+  }
+  else if constexpr (N == 64) {
+    crypto_poly1305_64(mac.data(), unconst(message.data()), unconst(k.data()));
+  }
+  else {
+    crypto_poly1305(mac.data(), unconst(message.data()), message.size(),
+                    unconst(k.data()));
+  }
+  return mac;
+}
+
+} // namespace detail
+
+
+//------------------------------------------------------------------
+// mac()
+// One-shot MAC of a message. N is the extent of the span, fixed
+// size messages get the size as a compile time constant.
+//------------------------------------------------------------------
+template <kernel K = kernel::automatic, std::size_t N>
+constexpr tag mac(std::span<const std::uint8_t, N> message, key k)
+{
+  if (std::is_constant_evaluated() || K == kernel::inline32) {
+    return detail::mac_inline32(message, k);
+  }
+  return detail::mac_library(message, k);
+}
+
+template <kernel K = kernel::automatic, std::size_t N>
+constexpr tag mac(std::span<std::uint8_t, N> message, key k)
+{
+  return mac<K>(std::span<const std::uint8_t, N>(message), k);
+}
+
+template <kernel K = kernel::automatic, std::size_t N>
+constexpr tag mac(const std::array<std::uint8_t, N> &message, key k)
+{
+  return mac<K>(std::span<const std::uint8_t, N>(message), k);
+}
+
+
+//------------------------------------------------------------------
+// verify()
+// true if mac is the tag of the message, compared in constant time.
+//------------------------------------------------------------------
+inline bool verify(std::span<const std::uint8_t, 16> mac,
+                   std::span<const std::uint8_t> message, key k)
+{
+  return crypto_poly1305_verify(mac.data(), detail::unconst(message.data()),
+                                message.size(), detail::unconst(k.data())) == 0;
+}
+
+
+//------------------------------------------------------------------
+// key_schedule
+// Everything derived from a key, computed once and shared by any
+// number of contexts. Move-only, wiped on destruction.
+//------------------------------------------------------------------
+class key_schedule {
+public:
+  explicit key_schedule(key k)
+  {
+    crypto_poly1305_key_init(&ks_, detail::unconst(k.data()));
+  }
+
+  key_schedule(const key_schedule &) = delete;
+  key_schedule &operator=(const key_schedule &) = delete;
+
+  key_schedule(key_schedule &&other) noexcept : ks_(other.ks_)
+  {
+    crypto_wipe(&other.ks_, sizeof(other.ks_));
+  }
+
+  key_schedule &operator=(key_schedule &&other) noexcept
+  {
+    if (this != &other) {
+      ks_ = other.ks_;
+      crypto_wipe(&other.ks_, sizeof(other.ks_));
+    }
+    return *this;
+  }
+
+  ~key_schedule() { crypto_wipe(&ks_, sizeof(ks_)); }
+
+  const crypto_poly1305_key *get() const { return &ks_; }
+
+private:
+  crypto_poly1305_key ks_;
+};
+
+
+//------------------------------------------------------------------
+// context
+// Incremental MAC. Move-only, the moved from context and a context
+// that has been finished can not be used any more. The state is
+// wiped on destruction whether finished or not.
+//------------------------------------------------------------------
+class context {
+public:
+  explicit context(key k) : live_(true)
+  {
+    crypto_poly1305_init(&ctx_, detail::unconst(k.data()));
+  }
+
+  explicit context(const key_schedule &ks) : live_(true)
+  {
+    crypto_poly1305_init_key(&ctx_, ks.get());
+  }
+
+  context(const context &) = delete;
+  context &operator=(const context &) = delete;
+
+  context(context &&other) noexcept : ctx_(other.ctx_), live_(other.live_)
+  {
+    other.drop();
+  }
+
+  context &operator=(context &&other) noexcept
+  {
+    if (this != &other) {
+      ctx_  = other.ctx_;
+      live_ = other.live_;
+      other.drop();
+    }
+    return *this;
+  }
+
+  ~context() { drop(); }
+
+  context &update(std::span<const std::uint8_t> message)
+  {
+    assert(live_);
+    crypto_poly1305_update(&ctx_, detail::unconst(message.data()),
+                           message.size());
+    return *this;
+  }
+
+  tag finish()
+  {
+    assert(live_);
+    tag mac;
+    crypto_poly1305_final(&ctx_, mac.data());
+    live_ = false;
+    return mac;
+  }
+
+  bool finished() const { return !live_; }
+
+private:
+  void drop()
+  {
+    crypto_wipe(&ctx_, sizeof(ctx_));
+    live_ = false;
+  }
+
+  crypto_poly1305_ctx ctx_;
+  bool                live_;
+};
+
+} // namespace poly1305
+
+#endif // POLY1305_HPP
+
+//======================================================================
+// EOF poly1305.hpp
+//======================================================================
@@ -0,0 +1,328 @@
+//======================================================================
+//
+// poly1305_checkpoint.c
+// ---------------------
+// Checkpoint index of resumable MACs, see poly1305_checkpoint.h.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "poly1305_checkpoint.h"
+
+
+// Size of the read buffer, and of a checkpoint in the index.
+#define CHECKPOINT_BUFFER_SIZE (64 * 1024)
+#define CHECKPOINT_HEADER_SIZE 12
+#define CHECKPOINT_SIZE        (8 + CRYPTO_POLY1305_STATE_SIZE)
+
+
+static uint32_t get_word(const uint8_t *b)
+{
+  return b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static void set_word(uint8_t *b, uint32_t w)
+{
+  b[0] = (uint8_t)w;
+  b[1] = (uint8_t)(w >> 8);
+  b[2] = (uint8_t)(w >> 16);
+  b[3] = (uint8_t)(w >> 24);
+}
+
+
+//------------------------------------------------------------------
+// index_name()
+// Path of the index of the file, to be freed by the caller.
+//------------------------------------------------------------------
+static char *index_name(const char *path, const char *suffix)
+{
+  size_t size = strlen(path) + strlen(POLY1305_CHECKPOINT_SUFFIX) +
+                strlen(suffix) + 1;
+  char *name = malloc(size);
+  if (name != NULL) {
+    snprintf(name, size, "%s%s%s", path, POLY1305_CHECKPOINT_SUFFIX, suffix);
+  }
+  return name;
+}
+
+
+//------------------------------------------------------------------
+// index_load()
+// Read the checkpoints of the index. Returns the number of
+// checkpoints, 0 if there is no valid index. The caller wipes and
+// frees *checkpoints.
+//------------------------------------------------------------------
+static size_t index_load(const char *name, uint8_t **checkpoints)
+{
+  uint8_t header[CHECKPOINT_HEADER_SIZE];
+  struct stat st;
+  size_t  nb = 0;
+
+  *checkpoints = NULL;
+  FILE *f = fopen(name, "rb");
+  if (f == NULL) {
+    return 0;
+  }
+  // The number of checkpoints is not trusted before it matches the
+  // size of the file, that also bounds the allocation.
+  if (fstat(fileno(f), &st) == 0 &&
+      fread(header, 1, sizeof(header), f) == sizeof(header) &&
+      get_word(header    ) == POLY1305_CHECKPOINT_MAGIC &&
+      get_word(header + 4) == POLY1305_CHECKPOINT_VERSION &&
+      (uint64_t)get_word(header + 8) * CHECKPOINT_SIZE +
+        CHECKPOINT_HEADER_SIZE == (uint64_t)st.st_size &&
+      (uint64_t)st.st_size <= SIZE_MAX) {
+    nb = get_word(header + 8);
+    *checkpoints = nb ? malloc(nb * CHECKPOINT_SIZE) : NULL;
+    if (*checkpoints == NULL ||
+        fread(*checkpoints, CHECKPOINT_SIZE, nb, f) != nb ||
+        fgetc(f) != EOF) {
+      if (*checkpoints != NULL) {
+        crypto_wipe(*checkpoints, nb * CHECKPOINT_SIZE);
+        free(*checkpoints);
+        *checkpoints = NULL;
+      }
+      nb = 0;
+    }
+  }
+  fclose(f);
+  return nb;
+}
+
+
+//------------------------------------------------------------------
+// index_write()
+// Replace the index with the checkpoints, through a temporary file
+// renamed over it. Returns 0 on success.
+//------------------------------------------------------------------
+static int index_write(const char *name, const uint8_t *checkpoints,
+                       size_t nb)
+{
+  uint8_t header[CHECKPOINT_HEADER_SIZE];
+  char *tmp = index_name(name, ".tmp");
+  int res = -1;
+
+  if (tmp == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  // The states depend on r, they must not be readable by others.
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd >= 0) {
+    set_word(header,     POLY1305_CHECKPOINT_MAGIC);
+    set_word(header + 4, POLY1305_CHECKPOINT_VERSION);
+    set_word(header + 8, (uint32_t)nb);
+    if (write(fd, header, sizeof(header)) == (ssize_t)sizeof(header) &&
+        write(fd, checkpoints, nb * CHECKPOINT_SIZE) ==
+          (ssize_t)(nb * CHECKPOINT_SIZE) &&
+        fsync(fd) == 0) {
+      res = 0;
+    }
+    if (close(fd) != 0) {
+      res = -1;
+    }
+    if (res == 0) {
+      res = rename(tmp, name);
+    }
+    if (res != 0) {
+      int error = errno;
+      unlink(tmp);
+      errno = error;
+    }
+  }
+  free(tmp);
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// checkpoint_offset()
+//------------------------------------------------------------------
+static uint64_t checkpoint_offset(const uint8_t *checkpoint)
+{
+  return get_word(checkpoint) | (uint64_t)get_word(checkpoint + 4) << 32;
+}
+
+
+//------------------------------------------------------------------
+// checkpoint_add()
+// Append the state of ctx at offset to the checkpoints, growing the
+// array when full. Returns 0 on success.
+//------------------------------------------------------------------
+static int checkpoint_add(uint8_t **checkpoints, size_t *nb, size_t *max,
+                          uint64_t offset, const crypto_poly1305_ctx *ctx)
+{
+  if (*nb == *max) {
+    size_t   new_max = *max ? *max * 2 : 16;
+    uint8_t *grown   = malloc(new_max * CHECKPOINT_SIZE);
+    if (grown == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+    if (*nb > 0) {
+      memcpy(grown, *checkpoints, *nb * CHECKPOINT_SIZE);
+      crypto_wipe(*checkpoints, *max * CHECKPOINT_SIZE);
+    }
+    free(*checkpoints);
+    *checkpoints = grown;
+    *max         = new_max;
+  }
+  uint8_t *checkpoint = *checkpoints + *nb * CHECKPOINT_SIZE;
+  set_word(checkpoint,     (uint32_t)offset);
+  set_word(checkpoint + 4, (uint32_t)(offset >> 32));
+  crypto_poly1305_save(checkpoint + 8, ctx);
+  (*nb)++;
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// poly1305_checkpoint_mac()
+//------------------------------------------------------------------
+int poly1305_checkpoint_mac(uint8_t mac[16], const char *path,
+                            uint8_t key[32], uint64_t interval,
+                            uint64_t *resumed)
+{
+  crypto_poly1305_ctx ctx;
+  crypto_poly1305_ctx end;
+  uint8_t *checkpoints = NULL;
+  uint8_t *buffer      = NULL;
+  size_t   nb          = 0;
+  size_t   max         = 0;
+  uint64_t offset      = 0;
+  uint64_t start;
+  uint64_t size;
+  struct stat st;
+  int      res         = -1;
+
+  if (interval == 0) {
+    interval = POLY1305_CHECKPOINT_INTERVAL;
+  }
+  if (interval % 16 != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  char *name = index_name(path, "");
+  int   fd   = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    goto done;
+  }
+  buffer = malloc(CHECKPOINT_BUFFER_SIZE);
+  if (name == NULL || buffer == NULL) {
+    errno = ENOMEM;
+    goto done;
+  }
+  size = (uint64_t)st.st_size;
+
+  // Resume from the last checkpoint within the file with our key,
+  // dropping the checkpoints after it.
+  crypto_poly1305_init(&ctx, key);
+  nb = max = index_load(name, &checkpoints);
+  while (nb > 0) {
+    uint8_t *last = checkpoints + (nb - 1) * CHECKPOINT_SIZE;
+    if (checkpoint_offset(last) <= size &&
+        crypto_poly1305_restore(&ctx, last + 8, key) == 0) {
+      offset = checkpoint_offset(last);
+      break;
+    }
+    nb--;
+  }
+  // The end of the last run is rarely on an interval boundary. Drop
+  // it, there is at most one checkpoint off the boundaries, the end.
+  if (nb > 0 && offset % interval != 0) {
+    nb--;
+  }
+  start = offset;
+
+  // MAC the rest, with a checkpoint at every multiple of interval.
+  while (offset < size) {
+    uint64_t next = (offset / interval + 1) * interval;
+    size_t   want = CHECKPOINT_BUFFER_SIZE;
+    if (next - offset < want) {
+      want = (size_t)(next - offset);
+    }
+    if (size - offset < want) {
+      want = (size_t)(size - offset);
+    }
+    ssize_t got = pread(fd, buffer, want, (off_t)offset);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      if (got == 0) {
+        errno = EIO;  // the file shrank
+      }
+      goto done;
+    }
+    crypto_poly1305_update(&ctx, buffer, (size_t)got);
+    offset += (uint64_t)got;
+    if (offset % interval == 0 &&
+        checkpoint_add(&checkpoints, &nb, &max, offset, &ctx) != 0) {
+      goto done;
+    }
+  }
+  if ((nb == 0 || checkpoint_offset(checkpoints + (nb - 1) * CHECKPOINT_SIZE)
+                  != size) &&
+      checkpoint_add(&checkpoints, &nb, &max, size, &ctx) != 0) {
+    goto done;
+  }
+  if (resumed != NULL) {
+    *resumed = start;
+  }
+
+  end = ctx;
+  crypto_poly1305_final(&end, mac);
+  res = index_write(name, checkpoints, nb);
+
+ done:
+  if (fd >= 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+  }
+  crypto_wipe(&ctx, sizeof(ctx));
+  if (checkpoints != NULL) {
+    crypto_wipe(checkpoints, max * CHECKPOINT_SIZE);
+    free(checkpoints);
+  }
+  free(buffer);
+  free(name);
+  return res;
+}
+
+//======================================================================
+// EOF poly1305_checkpoint.c
+//======================================================================
@@ -0,0 +1,83 @@
+//======================================================================
+//
+// poly1305_checkpoint.h
+// ---------------------
+// Resumable MACs of append-only files. The serialized mid-state of
+// the MAC is stored at regular offsets in a checkpoint index next to
+// the file, so that MACing the file again after data has been
+// appended only processes the new data.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef POLY1305_CHECKPOINT_H
+#define POLY1305_CHECKPOINT_H
+
+#include <stdint.h>
+#include "monocypher.h"
+
+// The index of a file is named by appending the suffix to its path.
+// Everything is stored as little endian 32 bit words, the offset as
+// the low word followed by the high word.
+//
+//   header: magic, version, nb_checkpoints
+//   checkpoint: offset, CRYPTO_POLY1305_STATE_SIZE bytes of state
+//
+// Checkpoints are in increasing offset order. The index does not
+// hold the key, a checkpoint is matched with the key by the
+// fingerprint in the state. The states depend on r however, so the
+// index is created readable by the owner only.
+#define POLY1305_CHECKPOINT_MAGIC   0x4b333150 // "P13K"
+#define POLY1305_CHECKPOINT_VERSION 2
+#define POLY1305_CHECKPOINT_SUFFIX  ".p1305ck"
+
+// Default distance between checkpoints.
+#ifndef POLY1305_CHECKPOINT_INTERVAL
+#define POLY1305_CHECKPOINT_INTERVAL (64 * 1024 * 1024)
+#endif
+
+// MAC the file at path, resuming from the last checkpoint of the
+// index within the file and made with the same key. The index is
+// then rewritten with a checkpoint every interval bytes, a multiple
+// of 16 or 0 for the default, and one at the end of the file. The
+// offset resumed from is written to *resumed, if not NULL. A
+// missing, damaged or foreign index is ignored and replaced.
+//
+// Only appending to the file is detected: if the data before a
+// checkpoint is modified, the tag is wrong. Returns 0 on success,
+// -1 with errno set if the file can not be read or the index can
+// not be written.
+int poly1305_checkpoint_mac(uint8_t mac[16], const char *path,
+                            uint8_t key[32], uint64_t interval,
+                            uint64_t *resumed);
+
+#endif // POLY1305_CHECKPOINT_H
+
+//======================================================================
+// EOF poly1305_checkpoint.h
+//======================================================================
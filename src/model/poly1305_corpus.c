@@ -0,0 +1,274 @@
+//======================================================================
+//
+// poly1305_corpus.c
+// -----------------
+// Memory mapped test vector corpus and parallel runner, see
+// poly1305_corpus.h.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "monocypher.h"
+#include "poly1305_corpus.h"
+
+
+#define HEADER_SIZE 12
+#define RECORD_SIZE (4 + 32 + 16)
+
+struct poly1305_corpus {
+  const uint8_t *data;
+  size_t         size;
+  size_t         nb_vectors;
+  size_t        *offsets;   // of each vector record
+};
+
+
+static uint32_t get_word(const uint8_t *b)
+{
+  return b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+
+//------------------------------------------------------------------
+// poly1305_corpus_open()
+// Map the file and walk the records once to find their offsets,
+// checking that they exactly fill the file.
+//------------------------------------------------------------------
+poly1305_corpus *poly1305_corpus_open(const char *path)
+{
+  struct stat st;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = (size_t)st.st_size;
+  if (size < HEADER_SIZE) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+  const uint8_t *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  madvise((void *)data, size, MADV_SEQUENTIAL);
+
+  size_t nb = get_word(data + 8);
+  if (nb > (size - HEADER_SIZE) / RECORD_SIZE) {
+    munmap((void *)data, size);
+    errno = EINVAL;
+    return NULL;
+  }
+  poly1305_corpus *corpus = calloc(1, sizeof(poly1305_corpus));
+  if (corpus == NULL ||
+      (corpus->offsets = malloc((nb ? nb : 1) * sizeof(size_t))) == NULL) {
+    free(corpus);
+    munmap((void *)data, size);
+    errno = ENOMEM;
+    return NULL;
+  }
+  corpus->data       = data;
+  corpus->size       = size;
+  corpus->nb_vectors = nb;
+
+  int valid = get_word(data    ) == POLY1305_CORPUS_MAGIC &&
+              get_word(data + 4) == POLY1305_CORPUS_VERSION;
+  size_t offset = HEADER_SIZE;
+  for (size_t i = 0 ; i < nb && valid ; i++) {
+    if (size - offset < RECORD_SIZE ||
+        size - offset - RECORD_SIZE < get_word(data + offset)) {
+      valid = 0;
+      break;
+    }
+    corpus->offsets[i] = offset;
+    offset += RECORD_SIZE + get_word(data + offset);
+  }
+  if (!valid || offset != size) {
+    poly1305_corpus_close(corpus);
+    errno = EINVAL;
+    return NULL;
+  }
+  return corpus;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void poly1305_corpus_close(poly1305_corpus *corpus)
+{
+  if (!corpus) {
+    return;
+  }
+  munmap((void *)corpus->data, corpus->size);
+  free(corpus->offsets);
+  free(corpus);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+size_t poly1305_corpus_count(const poly1305_corpus *corpus)
+{
+  return corpus->nb_vectors;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int poly1305_corpus_get(const poly1305_corpus *corpus, size_t index,
+                        poly1305_vector *vector)
+{
+  if (index >= corpus->nb_vectors) {
+    return -1;
+  }
+  const uint8_t *record = corpus->data + corpus->offsets[index];
+  vector->message_size = get_word(record);
+  vector->key          = record + 4;
+  vector->tag          = record + 4 + 32;
+  vector->message      = record + RECORD_SIZE;
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// The range of vectors checked by one thread of the runner.
+//------------------------------------------------------------------
+typedef struct {
+  const poly1305_corpus *corpus;
+  size_t                 first;
+  size_t                 end;
+  size_t                 failures;
+  size_t                 first_failure;
+} corpus_range;
+
+
+static void *corpus_run_range(void *arg)
+{
+  corpus_range *range = arg;
+  poly1305_vector v;
+  uint8_t mac[16];
+
+  range->failures      = 0;
+  range->first_failure = SIZE_MAX;
+  for (size_t i = range->first ; i < range->end ; i++) {
+    poly1305_corpus_get(range->corpus, i, &v);
+    // The model does not write through these, the map is read only.
+    crypto_poly1305(mac, (uint8_t *)v.message, v.message_size,
+                    (uint8_t *)v.key);
+    if (crypto_verify16(mac, v.tag) != 0) {
+      if (range->failures++ == 0) {
+        range->first_failure = i;
+      }
+    }
+  }
+  return NULL;
+}
+
+
+//------------------------------------------------------------------
+// poly1305_corpus_run()
+// The calling thread checks the first range itself.
+//------------------------------------------------------------------
+size_t poly1305_corpus_run(const poly1305_corpus *corpus,
+                           unsigned nb_threads, size_t *first_failure)
+{
+  size_t nb = corpus->nb_vectors;
+  if (nb_threads == 0) {
+    nb_threads = 1;
+  }
+  if (nb_threads > nb) {
+    nb_threads = nb ? (unsigned)nb : 1;
+  }
+
+  corpus_range *ranges  = calloc(nb_threads, sizeof(corpus_range));
+  pthread_t    *threads = calloc(nb_threads, sizeof(pthread_t));
+  int          *started = calloc(nb_threads, sizeof(int));
+  if (!ranges || !threads || !started) {
+    // Run everything on this thread.
+    free(ranges);
+    free(threads);
+    free(started);
+    corpus_range all = {corpus, 0, nb, 0, SIZE_MAX};
+    corpus_run_range(&all);
+    if (first_failure) {
+      *first_failure = all.first_failure;
+    }
+    return all.failures;
+  }
+
+  for (unsigned t = 0 ; t < nb_threads ; t++) {
+    ranges[t].corpus = corpus;
+    ranges[t].first  = nb * t / nb_threads;
+    ranges[t].end    = nb * (t + 1) / nb_threads;
+  }
+  for (unsigned t = 1 ; t < nb_threads ; t++) {
+    started[t] = pthread_create(&threads[t], NULL, corpus_run_range,
+                                &ranges[t]) == 0;
+  }
+  corpus_run_range(&ranges[0]);
+
+  size_t failures = 0;
+  size_t first    = SIZE_MAX;
+  for (unsigned t = 0 ; t < nb_threads ; t++) {
+    if (t > 0) {
+      if (started[t]) {
+        pthread_join(threads[t], NULL);
+      }
+      else {
+        corpus_run_range(&ranges[t]);
+      }
+    }
+    failures += ranges[t].failures;
+    if (ranges[t].first_failure < first) {
+      first = ranges[t].first_failure;
+    }
+  }
+  if (first_failure) {
+    *first_failure = first;
+  }
+  free(ranges);
+  free(threads);
+  free(started);
+  return failures;
+}
+
+//======================================================================
+// EOF poly1305_corpus.c
+//======================================================================
@@ -0,0 +1,97 @@
+//======================================================================
+//
+// poly1305_corpus.h
+// -----------------
+// Binary corpus of test vectors. A corpus file is memory mapped and
+// indexed once, after which any vector can be read without copying.
+// The runner checks all vectors against the model on a number of
+// threads. Corpus files are written by utils/extract_vectors.py.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef POLY1305_CORPUS_H
+#define POLY1305_CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// File format. Everything is little endian.
+//
+//   header: magic (32 bits), version (32 bits), nb_vectors (32 bits)
+//   vector: message_size (32 bits), key (32 bytes), tag (16 bytes),
+//           message (message_size bytes)
+//
+// Vectors follow each other without padding.
+#define POLY1305_CORPUS_MAGIC   0x56333150 // "P13V"
+#define POLY1305_CORPUS_VERSION 1
+
+typedef struct poly1305_corpus poly1305_corpus;
+
+// A vector, pointing into the mapped file.
+typedef struct {
+  const uint8_t *key;
+  const uint8_t *tag;
+  const uint8_t *message;
+  size_t         message_size;
+} poly1305_vector;
+
+// Map and index the corpus at path. Returns NULL with errno set if
+// the file can not be mapped, or EINVAL if it is not a valid corpus.
+poly1305_corpus *poly1305_corpus_open(const char *path);
+
+// Unmap the corpus.
+void poly1305_corpus_close(poly1305_corpus *corpus);
+
+// Number of vectors in the corpus.
+size_t poly1305_corpus_count(const poly1305_corpus *corpus);
+
+// Vector number index. Returns 0 on success, -1 if out of range.
+int poly1305_corpus_get(const poly1305_corpus *corpus, size_t index,
+                        poly1305_vector *vector);
+
+// Check every vector with crypto_poly1305() on nb_threads threads,
+// each taking a contiguous range of the corpus. Returns the number
+// of vectors with a wrong tag, and the index of the first of them
+// in *first_failure if not NULL.
+size_t poly1305_corpus_run(const poly1305_corpus *corpus,
+                           unsigned nb_threads, size_t *first_failure);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POLY1305_CORPUS_H
+
+//======================================================================
+// EOF poly1305_corpus.h
+//======================================================================
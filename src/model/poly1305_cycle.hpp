@@ -0,0 +1,645 @@
+//======================================================================
+//
+// poly1305_cycle.hpp
+// ------------------
+// Header-only cycle accurate C++20 model of poly1305_core. The
+// control FSMs and datapath registers of poly1305_core,
+// poly1305_pblock, poly1305_mulacc and poly1305_final are clocked
+// one cycle at a time as in the RTL, with the timing parameters of
+// the pipelines taken from a timing struct instead of localparams.
+// The model gives the latency of every operation and the tag the
+// RTL would generate, so a change of the pipelines can be checked
+// against the C model without running an event simulator.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#ifndef POLY1305_CYCLE_HPP
+#define POLY1305_CYCLE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace poly1305::cycle {
+
+//------------------------------------------------------------------
+// timing
+// The timing parameters of the RTL. The defaults are the values in
+// the RTL. The cycle counters are four bits wide as in the RTL, so
+// pre_cycles, post_cycles and pipe_cycles must be at most 15.
+//   pre_cycles       PRE_CYCLES in poly1305_pblock.v
+//   post_cycles      POST_CYCLES in poly1305_pblock.v
+//   mulacc_products  Products added per cycle by poly1305_mulacc,
+//                    1 to 5. The RTL has one multiplier and adds
+//                    one product per cycle.
+//   pipe_cycles      PIPE_CYCLES in poly1305_final.v
+//------------------------------------------------------------------
+struct timing {
+  unsigned pre_cycles      = 1;
+  unsigned post_cycles     = 2;
+  unsigned mulacc_products = 1;
+  unsigned pipe_cycles     = 6;
+};
+
+constexpr bool valid(const timing &t)
+{
+  return (t.pre_cycles <= 15) && (t.post_cycles <= 15) &&
+         (t.pipe_cycles <= 15) &&
+         (t.mulacc_products >= 1) && (t.mulacc_products <= 5);
+}
+
+// Cycles of poly1305_mulacc from start to ready.
+constexpr unsigned mulacc_steps(const timing &t)
+{
+  return (5 + t.mulacc_products - 1) / t.mulacc_products;
+}
+
+
+//------------------------------------------------------------------
+// Latencies derived from the FSMs. The latency of an operation is
+// the number of cycles from the cycle the command is sampled in
+// to the cycle ready is set, both included, as measured by
+// wait_ready() in tb_poly1305_core.v.
+//------------------------------------------------------------------
+constexpr unsigned init_latency(const timing &)
+{
+  return 2;
+}
+
+// A next() of zero bytes goes straight to CTRL_READY.
+constexpr unsigned next_latency(const timing &t, unsigned blocklen = 16)
+{
+  if (blocklen == 0) {
+    return 2;
+  }
+  return 2 + (t.pre_cycles + 1) + mulacc_steps(t) + 1 +
+         (t.post_cycles + 1) + 2;
+}
+
+constexpr unsigned finish_latency(const timing &t)
+{
+  return (t.pipe_cycles + 1) + 2;
+}
+
+// Cycles for a whole message with the commands issued back to
+// back, one next() per block and a single next() of zero bytes for
+// the empty message, as test_corpus in tb_poly1305_core.v.
+constexpr std::uint64_t message_cycles(const timing &t, std::size_t size)
+{
+  const std::uint64_t full = size / 16;
+  std::uint64_t cycles = init_latency(t) + finish_latency(t);
+  cycles += full * next_latency(t);
+  if ((size % 16) || (size == 0)) {
+    cycles += next_latency(t, size % 16);
+  }
+  return cycles;
+}
+
+static_assert(init_latency(timing{})   == 2,  "init latency of the RTL");
+static_assert(next_latency(timing{})   == 15, "next latency of the RTL");
+static_assert(finish_latency(timing{}) == 9,  "finish latency of the RTL");
+
+
+namespace detail {
+
+constexpr std::uint32_t load32_le(const std::uint8_t *p)
+{
+  return  (std::uint32_t)p[0]        | ((std::uint32_t)p[1] <<  8) |
+         ((std::uint32_t)p[2] << 16) | ((std::uint32_t)p[3] << 24);
+}
+
+//------------------------------------------------------------------
+// mulacc
+// poly1305_mulacc. Sum of opa[i] * opb[i], i = 0..4, adding
+// mulacc_products products per cycle.
+//------------------------------------------------------------------
+class mulacc {
+public:
+  bool          ready() const { return ready_reg_; }
+  std::uint64_t sum()   const { return sum_reg_; }
+
+  void clock(const timing &t, bool start,
+             const std::uint32_t opa[5], const std::uint64_t opb[5])
+  {
+    const unsigned steps = mulacc_steps(t);
+
+    auto products = [&](unsigned step) {
+      std::uint64_t p = 0;
+      for (unsigned i = step * t.mulacc_products ;
+           (i < (step + 1) * t.mulacc_products) && (i < 5) ; i++) {
+        p += (std::uint64_t)opa[i] * opb[i];
+      }
+      return p;
+    };
+
+    if (ctrl_reg_ == 0) {
+      if (start) {
+        mul_reg_   = products(0);
+        sum_reg_   = 0;
+        ready_reg_ = false;
+        ctrl_reg_  = 1;
+      }
+    }
+    else if (ctrl_reg_ < steps) {
+      sum_reg_  += mul_reg_;
+      mul_reg_   = products(ctrl_reg_);
+      ctrl_reg_ += 1;
+    }
+    else {
+      sum_reg_  += mul_reg_;
+      ready_reg_ = true;
+      ctrl_reg_  = 0;
+    }
+  }
+
+private:
+  std::uint64_t mul_reg_   = 0;
+  std::uint64_t sum_reg_   = 0;
+  bool          ready_reg_ = false;
+  unsigned      ctrl_reg_  = 0;  // 0 idle, 1..steps-1 op, steps sum
+};
+
+
+//------------------------------------------------------------------
+// pblock
+// poly1305_pblock. h = (h + c) * r with four mulacc units. The
+// datapath registers are clocked every cycle as in the RTL, the
+// result is only correct if the timing gives the carry chain
+// enough cycles to settle.
+//------------------------------------------------------------------
+class pblock {
+public:
+  bool ready() const { return ready_reg_; }
+
+  void h_new(std::uint32_t h[5]) const
+  {
+    h[0] = (std::uint32_t)u0_reg_;
+    h[1] = (std::uint32_t)u1_reg_;
+    h[2] = (std::uint32_t)u2_reg_;
+    h[3] = (std::uint32_t)u3_reg_;
+    h[4] = u4_reg_;
+  }
+
+  void clock(const timing &t, bool start, const std::uint32_t h[5],
+             const std::uint32_t c[5], const std::uint32_t r[4])
+  {
+    using u64 = std::uint64_t;
+    const u64 x0 = mulacc_[0].sum();
+    const u64 x1 = mulacc_[1].sum();
+    const u64 x2 = mulacc_[2].sum();
+    const u64 x3 = mulacc_[3].sum();
+    const u64 lo = 0xffffffff;
+
+    // pblock_logic
+    u64 s_new[5];
+    for (int i = 0 ; i < 5 ; i++) {
+      s_new[i] = (u64)h[i] + c[i];
+    }
+    const std::uint32_t rr_new[4] = {(r[0] >> 2) * 5,
+                                     (r[1] >> 2) + r[1],
+                                     (r[2] >> 2) + r[2],
+                                     (r[3] >> 2) + r[3]};
+    const u64 x4_new = s_reg_[4] * (r[0] & 3);
+    const u64 u5_new = x4_reg_ + (x3 >> 32);
+    const u64 u0_new = ((u5_reg_ & lo) >> 2) * 5 + (x0 & lo);
+    const u64 u1_new = (u0_reg_ >> 32) + (x1 & lo) + (x0 >> 32);
+    const u64 u2_new = (u1_reg_ >> 32) + (x2 & lo) + (x1 >> 32);
+    const u64 u3_new = (u2_reg_ >> 32) + (x3 & lo) + (x2 >> 32);
+    const std::uint32_t u4_new = (std::uint32_t)(u3_reg_ >> 32) +
+                                 (std::uint32_t)(u5_reg_ & 3);
+
+    // pblock_ctrl
+    bool mulacc_start = false;
+    switch (ctrl_reg_) {
+    case ctrl_idle:
+      if (start) {
+        ready_reg_ = false;
+        ctr_reg_   = 0;
+        ctrl_reg_  = ctrl_pre_wait;
+      }
+      break;
+
+    case ctrl_pre_wait:
+      if (ctr_reg_ == t.pre_cycles) {
+        mulacc_start = true;
+        ctrl_reg_    = ctrl_mulacc;
+      }
+      ctr_reg_ = (ctr_reg_ + 1) & 0xf;
+      break;
+
+    case ctrl_mulacc:
+      if (mulacc_[0].ready() || mulacc_[1].ready() ||
+          mulacc_[2].ready() || mulacc_[3].ready()) {
+        ctr_reg_  = 0;
+        ctrl_reg_ = ctrl_post_wait;
+      }
+      break;
+
+    case ctrl_post_wait:
+      if (ctr_reg_ == t.post_cycles) {
+        ready_reg_ = true;
+        ctrl_reg_  = ctrl_idle;
+      }
+      ctr_reg_ = (ctr_reg_ + 1) & 0xf;
+      break;
+    }
+
+    // The operands of the four mulacc units, as connected in the RTL.
+    const std::uint32_t opa[4][5] = {
+      {r[0], rr_reg_[3], rr_reg_[2], rr_reg_[1], rr_reg_[0]},
+      {r[1], r[0],       rr_reg_[3], rr_reg_[2], rr_reg_[1]},
+      {r[2], r[1],       r[0],       rr_reg_[3], rr_reg_[2]},
+      {r[3], r[2],       r[1],       r[0],       rr_reg_[3]}};
+    for (int i = 0 ; i < 4 ; i++) {
+      mulacc_[i].clock(t, mulacc_start, opa[i], s_reg_);
+    }
+
+    for (int i = 0 ; i < 5 ; i++) {
+      s_reg_[i] = s_new[i];
+    }
+    for (int i = 0 ; i < 4 ; i++) {
+      rr_reg_[i] = rr_new[i];
+    }
+    x4_reg_ = x4_new;
+    u0_reg_ = u0_new;
+    u1_reg_ = u1_new;
+    u2_reg_ = u2_new;
+    u3_reg_ = u3_new;
+    u4_reg_ = u4_new;
+    u5_reg_ = u5_new;
+  }
+
+private:
+  enum { ctrl_idle, ctrl_pre_wait, ctrl_mulacc, ctrl_post_wait };
+
+  mulacc        mulacc_[4];
+  std::uint64_t s_reg_[5]  = {};
+  std::uint32_t rr_reg_[4] = {};
+  std::uint64_t x4_reg_    = 0;
+  std::uint64_t u0_reg_    = 0;
+  std::uint64_t u1_reg_    = 0;
+  std::uint64_t u2_reg_    = 0;
+  std::uint64_t u3_reg_    = 0;
+  std::uint32_t u4_reg_    = 0;
+  std::uint64_t u5_reg_    = 0;
+  unsigned      ctr_reg_   = 0;
+  bool          ready_reg_ = true;
+  unsigned      ctrl_reg_  = ctrl_idle;
+};
+
+
+//------------------------------------------------------------------
+// final_pipe
+// poly1305_final. (h + s) mod 2^128 in a free running pipeline,
+// ready pipe_cycles + 1 cycles after start.
+//------------------------------------------------------------------
+class final_pipe {
+public:
+  bool ready() const { return ready_reg_; }
+
+  void hres(std::uint32_t res[4]) const
+  {
+    for (int i = 0 ; i < 4 ; i++) {
+      res[i] = (std::uint32_t)uu_reg_[i];
+    }
+  }
+
+  void clock(const timing &t, bool start, const std::uint32_t h[5],
+             const std::uint32_t s[4])
+  {
+    using u64 = std::uint64_t;
+
+    // final_logic
+    u64 u_new[5];
+    u_new[0] = (u64)5 + h[0];
+    for (int i = 1 ; i < 5 ; i++) {
+      u_new[i] = (u_reg_[i - 1] >> 32) + h[i];
+    }
+    u64 uu_new[4];
+    uu_new[0] = (u_reg_[4] >> 2) * 5 + h[0] + s[0];
+    for (int i = 1 ; i < 4 ; i++) {
+      uu_new[i] = (uu_reg_[i - 1] >> 32) + h[i] + s[i];
+    }
+
+    // final_ctrl
+    if (!pipe_wait_) {
+      if (start) {
+        ready_reg_ = false;
+        ctr_reg_   = 0;
+        pipe_wait_ = true;
+      }
+    }
+    else {
+      if (ctr_reg_ == t.pipe_cycles) {
+        ready_reg_ = true;
+        pipe_wait_ = false;
+      }
+      ctr_reg_ = (ctr_reg_ + 1) & 0xf;
+    }
+
+    for (int i = 0 ; i < 5 ; i++) {
+      u_reg_[i] = u_new[i];
+    }
+    for (int i = 0 ; i < 4 ; i++) {
+      uu_reg_[i] = uu_new[i];
+    }
+  }
+
+private:
+  std::uint64_t u_reg_[5]  = {};
+  std::uint64_t uu_reg_[4] = {};
+  unsigned      ctr_reg_   = 0;
+  bool          ready_reg_ = true;
+  bool          pipe_wait_ = false;
+};
+
+} // namespace detail
+
+
+//------------------------------------------------------------------
+// core
+// poly1305_core. clock() is one rising edge of clk with the given
+// inputs, the transaction functions drive a command for one cycle
+// and wait for ready as the tasks in tb_poly1305_core.v do, and
+// return the latency of the operation. block is the 16 bytes of
+// the block port in message order, blocklen is 0 to 16.
+//------------------------------------------------------------------
+class core {
+public:
+  explicit core(const timing &t = timing{}) : timing_(t) {}
+
+  const timing &params() const { return timing_; }
+  bool          ready()  const { return ready_reg_; }
+  std::uint64_t cycles() const { return cycles_; }
+
+  std::array<std::uint8_t, 16> mac() const
+  {
+    std::array<std::uint8_t, 16> tag;
+    for (int i = 0 ; i < 16 ; i++) {
+      tag[i] = (std::uint8_t)(mac_reg_[i / 4] >> ((i % 4) * 8));
+    }
+    return tag;
+  }
+
+  void clock(bool init, bool next, bool finish,
+             std::span<const std::uint8_t, 32> key,
+             std::span<const std::uint8_t, 16> block, unsigned blocklen)
+  {
+    bool state_init   = false;
+    bool load_block   = false;
+    bool state_update = false;
+    bool pblock_start = false;
+    bool final_start  = false;
+    bool mac_update   = false;
+    unsigned ctrl_new = ctrl_reg_;
+
+    // poly1305_core_ctrl. The commands are not exclusive in the
+    // RTL, the last one sampled sets the next state.
+    switch (ctrl_reg_) {
+    case ctrl_idle:
+      if (init) {
+        state_init = true;
+        ready_reg_ = false;
+        ctrl_new  = ctrl_ready;
+      }
+      if (next) {
+        load_block = true;
+        ready_reg_ = false;
+        ctrl_new  = (blocklen & 0x1f) ? ctrl_next : ctrl_ready;
+      }
+      if (finish) {
+        final_start = true;
+        ready_reg_  = false;
+        ctrl_new   = ctrl_final;
+      }
+      break;
+
+    case ctrl_next:
+      pblock_start = true;
+      ctrl_new    = ctrl_next_wait;
+      break;
+
+    case ctrl_next_wait:
+      if (pblock_.ready()) {
+        state_update = true;
+        ctrl_new    = ctrl_ready;
+      }
+      break;
+
+    case ctrl_final:
+      if (final_.ready()) {
+        mac_update = true;
+        ready_reg_ = true;
+        ctrl_new  = ctrl_idle;
+      }
+      break;
+
+    case ctrl_ready:
+      ready_reg_ = true;
+      ctrl_new  = ctrl_idle;
+      break;
+    }
+
+    // The outputs of the submodules are read before they are
+    // clocked with the core registers as inputs.
+    std::uint32_t pblock_h[5];
+    std::uint32_t hres[4];
+    pblock_.h_new(pblock_h);
+    final_.hres(hres);
+    pblock_.clock(timing_, pblock_start, h_reg_, c_reg_, r_reg_);
+    final_.clock(timing_, final_start, h_reg_, s_reg_);
+
+    // poly1305_core_logic
+    if (state_init) {
+      for (int i = 0 ; i < 5 ; i++) {
+        h_reg_[i] = 0;
+        c_reg_[i] = 0;
+      }
+      for (int i = 0 ; i < 4 ; i++) {
+        r_reg_[i] = detail::load32_le(&key[i * 4]) &
+                    (i == 0 ? 0x0fffffff : 0x0ffffffc);
+        s_reg_[i] = detail::load32_le(&key[16 + i * 4]);
+      }
+    }
+
+    // Only bits 0..3 of blocklen are used, 0 and 16 are both
+    // loaded as a full block.
+    if (load_block) {
+      const unsigned len = blocklen & 0xf;
+      std::uint8_t padded[16] = {};
+      for (unsigned i = 0 ; i < (len ? len : 16) ; i++) {
+        padded[i] = block[i];
+      }
+      if (len) {
+        padded[len] = 1;
+      }
+      for (int i = 0 ; i < 4 ; i++) {
+        c_reg_[i] = detail::load32_le(&padded[i * 4]);
+      }
+      c_reg_[4] = len ? 0 : 1;
+    }
+
+    if (state_update) {
+      for (int i = 0 ; i < 5 ; i++) {
+        h_reg_[i] = pblock_h[i];
+      }
+    }
+
+    if (mac_update) {
+      for (int i = 0 ; i < 4 ; i++) {
+        mac_reg_[i] = hres[i];
+      }
+    }
+
+    ctrl_reg_ = ctrl_new;
+    cycles_  += 1;
+  }
+
+  // One idle cycle with no command.
+  void idle()
+  {
+    clock(false, false, false, key_, block_, 0);
+  }
+
+  unsigned init(std::span<const std::uint8_t, 32> key)
+  {
+    for (int i = 0 ; i < 32 ; i++) {
+      key_[i] = key[i];
+    }
+    clock(true, false, false, key_, block_, 0);
+    return wait_ready();
+  }
+
+  unsigned next(std::span<const std::uint8_t> block)
+  {
+    const std::size_t len = block.size() < 16 ? block.size() : 16;
+    block_ = {};
+    for (std::size_t i = 0 ; i < len ; i++) {
+      block_[i] = block[i];
+    }
+    clock(false, true, false, key_, block_, (unsigned)len);
+    return wait_ready();
+  }
+
+  unsigned finish()
+  {
+    clock(false, false, true, key_, block_, 0);
+    return wait_ready();
+  }
+
+private:
+  enum {
+    ctrl_idle      = 0,
+    ctrl_init      = 1,
+    ctrl_next      = 2,
+    ctrl_next_wait = 3,
+    ctrl_final     = 4,
+    ctrl_ready     = 7
+  };
+
+  unsigned wait_ready()
+  {
+    unsigned latency = 1;
+    while (!ready_reg_) {
+      idle();
+      latency++;
+    }
+    return latency;
+  }
+
+  timing         timing_;
+  detail::pblock pblock_;
+  detail::final_pipe final_;
+
+  std::uint32_t h_reg_[5]   = {};
+  std::uint32_t c_reg_[5]   = {};
+  std::uint32_t r_reg_[4]   = {};
+  std::uint32_t s_reg_[4]   = {};
+  std::uint32_t mac_reg_[4] = {};
+  bool          ready_reg_  = true;
+  unsigned      ctrl_reg_   = ctrl_idle;
+  std::uint64_t cycles_     = 0;
+
+  std::array<std::uint8_t, 32> key_   = {};
+  std::array<std::uint8_t, 16> block_ = {};
+};
+
+
+//------------------------------------------------------------------
+// latency
+// Latencies of the operations of one message.
+//------------------------------------------------------------------
+struct latency {
+  unsigned      init   = 0;
+  unsigned      next   = 0;  // of the first block
+  unsigned      finish = 0;
+  std::uint64_t total  = 0;
+};
+
+//------------------------------------------------------------------
+// mac()
+// MAC of a message on the model, with the commands issued back to
+// back as test_corpus in tb_poly1305_core.v. The empty message is
+// a single next() of zero bytes.
+//------------------------------------------------------------------
+inline std::array<std::uint8_t, 16> mac(core &dut,
+                                        std::span<const std::uint8_t> message,
+                                        std::span<const std::uint8_t, 32> key,
+                                        latency *lat = nullptr)
+{
+  latency l;
+  l.init = dut.init(key);
+  l.total = l.init;
+  std::size_t i = 0;
+  do {
+    const std::size_t len = message.size() - i < 16 ? message.size() - i : 16;
+    const unsigned n = dut.next(message.subspan(i, len));
+    if (i == 0) {
+      l.next = n;
+    }
+    l.total += n;
+    i += 16;
+  } while (i < message.size());
+  l.finish = dut.finish();
+  l.total += l.finish;
+  if (lat) {
+    *lat = l;
+  }
+  return dut.mac();
+}
+
+} // namespace poly1305::cycle
+
+#endif // POLY1305_CYCLE_HPP
+
+//======================================================================
+// EOF poly1305_cycle.hpp
+//======================================================================
@@ -0,0 +1,283 @@
+//======================================================================
+//
+// poly1305_flow.c
+// ---------------
+// Flow table of incremental MACs, see poly1305_flow.h.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "monocypher.h"
+#include "poly1305_flow.h"
+
+
+//------------------------------------------------------------------
+// The hot state of a flow, one cache line. The generation is odd
+// while the flow is open and is bumped on open and finish. A free
+// slot links to the next free slot.
+//------------------------------------------------------------------
+typedef struct {
+  uint32_t h[5];        // accumulated hash
+  uint32_t r[4];        // clamped multiplier
+  uint32_t c[4];        // partial block, c_idx bytes
+  uint32_t c_idx;
+  uint32_t generation;
+  uint32_t next_free;
+} __attribute__((aligned(64))) flow_slot;
+
+_Static_assert(sizeof(flow_slot) == 64, "flow_slot is one cache line");
+
+#define NO_SLOT 0xffffffff
+
+struct poly1305_flow_table {
+  flow_slot *slots;
+  uint32_t (*s)[4];     // nonce of each slot, only read by finish
+  size_t     max_flows;
+  size_t     used;      // slots[used..] have never been used
+  size_t     count;
+  uint32_t   free_list;
+
+  // Context the kernels run on. Each update loads a slot into it,
+  // so only the fields of the slot are ever used.
+  crypto_poly1305_ctx ctx;
+};
+
+
+//------------------------------------------------------------------
+// flow_slot_of()
+// The slot of an open flow, or NULL for a stale or bad handle.
+//------------------------------------------------------------------
+static flow_slot *flow_slot_of(const poly1305_flow_table *table,
+                               poly1305_flow flow)
+{
+  uint32_t index      = (uint32_t)flow;
+  uint32_t generation = (uint32_t)(flow >> 32);
+  if (index >= table->used || (generation & 1) == 0 ||
+      table->slots[index].generation != generation) {
+    return NULL;
+  }
+  return &table->slots[index];
+}
+
+
+//------------------------------------------------------------------
+// flow_load() and flow_store()
+// Move the mid-state between a slot and the context. The slot only
+// holds r, so each load derives rr again and leaves the powers of r
+// to the kernels. That costs about as much as a few blocks, which
+// is why the kernels keep runs shorter than their cold threshold
+// on the scalar path.
+//------------------------------------------------------------------
+static void flow_load(crypto_poly1305_ctx *ctx, const flow_slot *slot)
+{
+  memcpy(ctx->h, slot->h, sizeof(slot->h));
+  memcpy(ctx->c, slot->c, sizeof(slot->c));
+  ctx->c[4]  = 1;
+  ctx->c_idx = slot->c_idx;
+  crypto_poly1305_set_r(ctx, slot->r);
+}
+
+static void flow_store(flow_slot *slot, const crypto_poly1305_ctx *ctx)
+{
+  memcpy(slot->h, ctx->h, sizeof(slot->h));
+  memcpy(slot->c, ctx->c, sizeof(slot->c));
+  slot->c_idx = (uint32_t)ctx->c_idx;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+poly1305_flow_table *poly1305_flow_table_create(size_t max_flows)
+{
+  if (max_flows == 0 || max_flows >= NO_SLOT) {
+    return NULL;
+  }
+  poly1305_flow_table *table = calloc(1, sizeof(poly1305_flow_table));
+  if (!table) {
+    return NULL;
+  }
+  if (posix_memalign((void **)&table->slots, 64,
+                     max_flows * sizeof(flow_slot)) != 0) {
+    free(table);
+    return NULL;
+  }
+  table->s = malloc(max_flows * sizeof(table->s[0]));
+  if (!table->s) {
+    free(table->slots);
+    free(table);
+    return NULL;
+  }
+  table->max_flows = max_flows;
+  table->free_list = NO_SLOT;
+  return table;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void poly1305_flow_table_destroy(poly1305_flow_table *table)
+{
+  if (!table) {
+    return;
+  }
+  crypto_wipe(table->slots, table->used * sizeof(flow_slot));
+  crypto_wipe(table->s, table->used * sizeof(table->s[0]));
+  crypto_wipe(&table->ctx, sizeof(table->ctx));
+  free(table->slots);
+  free(table->s);
+  free(table);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+size_t poly1305_flow_table_count(const poly1305_flow_table *table)
+{
+  return table->count;
+}
+
+
+//------------------------------------------------------------------
+// poly1305_flow_open()
+// Take a recycled slot if there is one, keeping the slots in use
+// dense, otherwise the next slot never used.
+//------------------------------------------------------------------
+poly1305_flow poly1305_flow_open(poly1305_flow_table *table,
+                                 uint8_t key[32])
+{
+  uint32_t   index;
+  flow_slot *slot;
+
+  if (table->free_list != NO_SLOT) {
+    index = table->free_list;
+    slot  = &table->slots[index];
+    table->free_list = slot->next_free;
+  }
+  else if (table->used < table->max_flows) {
+    index = (uint32_t)table->used++;
+    slot  = &table->slots[index];
+    slot->generation = 0;
+  }
+  else {
+    return 0;
+  }
+
+  // The same parsing as crypto_poly1305_init().
+  crypto_poly1305_init(&table->ctx, key);
+  memset(slot->h, 0, sizeof(slot->h));
+  memset(slot->c, 0, sizeof(slot->c));
+  memcpy(slot->r, table->ctx.r, sizeof(slot->r));
+  memcpy(table->s[index], table->ctx.s, sizeof(table->s[index]));
+  slot->c_idx     = 0;
+  slot->next_free = NO_SLOT;
+  slot->generation++;
+  table->count++;
+  return (uint64_t)slot->generation << 32 | index;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int poly1305_flow_update(poly1305_flow_table *table, poly1305_flow flow,
+                         uint8_t *message, size_t message_size)
+{
+  flow_slot *slot = flow_slot_of(table, flow);
+  if (!slot) {
+    return -1;
+  }
+  flow_load(&table->ctx, slot);
+  crypto_poly1305_update(&table->ctx, message, message_size);
+  flow_store(slot, &table->ctx);
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int poly1305_flow_finish(poly1305_flow_table *table, poly1305_flow flow,
+                         uint8_t mac[16])
+{
+  flow_slot *slot = flow_slot_of(table, flow);
+  if (!slot) {
+    return -1;
+  }
+  uint32_t index = (uint32_t)flow;
+
+  flow_load(&table->ctx, slot);
+  memcpy(table->ctx.s, table->s[index], sizeof(table->ctx.s));
+  crypto_poly1305_final(&table->ctx, mac);
+
+  crypto_wipe(slot->h, sizeof(slot->h));
+  crypto_wipe(slot->r, sizeof(slot->r));
+  crypto_wipe(slot->c, sizeof(slot->c));
+  crypto_wipe(table->s[index], sizeof(table->s[index]));
+  slot->generation++;
+  slot->next_free  = table->free_list;
+  table->free_list = index;
+  table->count--;
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// poly1305_flow_update_batch()
+// With many flows the slots are cache misses, and so are the
+// messages when they were written by another core. Both are
+// prefetched POLY1305_FLOW_PREFETCH updates ahead, so the misses
+// overlap with the MAC of the current update.
+//------------------------------------------------------------------
+size_t poly1305_flow_update_batch(poly1305_flow_table *table,
+                                  const poly1305_flow flows[],
+                                  uint8_t *messages[],
+                                  const size_t message_sizes[],
+                                  size_t nb_updates)
+{
+  size_t stale = 0;
+
+  for (size_t i = 0 ; i < nb_updates ; i++) {
+    size_t ahead = i + POLY1305_FLOW_PREFETCH;
+    if (ahead < nb_updates) {
+      uint32_t index = (uint32_t)flows[ahead];
+      if (index < table->used) {
+        __builtin_prefetch(&table->slots[index], 1);
+      }
+      if (message_sizes[ahead] > 0) {
+        __builtin_prefetch(messages[ahead]);
+      }
+    }
+    stale += poly1305_flow_update(table, flows[i], messages[i],
+                                  message_sizes[i]) != 0;
+  }
+  return stale;
+}
+
+//======================================================================
+// EOF poly1305_flow.c
+//======================================================================
@@ -0,0 +1,98 @@
+//======================================================================
+//
+// poly1305_flow.h
+// ---------------
+// Flow table for large numbers of concurrent incremental MACs, such
+// as one per stream in a proxy. The mid-state of each flow is kept
+// in one cache line of a packed pool, with s, only needed for the
+// tag, in a separate array. Flows are referred to by generational
+// handles, so a handle of a finished flow is detected even after
+// its slot has been reused.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef POLY1305_FLOW_H
+#define POLY1305_FLOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Updates ahead of the current one that are prefetched by
+// poly1305_flow_update_batch().
+#ifndef POLY1305_FLOW_PREFETCH
+#define POLY1305_FLOW_PREFETCH 8
+#endif
+
+typedef struct poly1305_flow_table poly1305_flow_table;
+
+// Handle of an open flow. 0 is never a valid handle.
+typedef uint64_t poly1305_flow;
+
+// Create a table for up to max_flows open flows. Memory for the
+// slots is only touched when first used. Returns NULL on failure.
+// A table must only be used by one thread at a time.
+poly1305_flow_table *poly1305_flow_table_create(size_t max_flows);
+
+// Wipe and free the table, including any flows still open.
+void poly1305_flow_table_destroy(poly1305_flow_table *table);
+
+// Number of open flows.
+size_t poly1305_flow_table_count(const poly1305_flow_table *table);
+
+// Start the MAC of a flow with a one-time key. Returns 0 if the
+// table is full.
+poly1305_flow poly1305_flow_open(poly1305_flow_table *table,
+                                 uint8_t key[32]);
+
+// Add message bytes to a flow. Returns 0 on success, -1 if the
+// handle is not of an open flow.
+int poly1305_flow_update(poly1305_flow_table *table, poly1305_flow flow,
+                         uint8_t *message, size_t message_size);
+
+// Write the tag of the flow to mac and close it, wiping its state.
+// Returns 0 on success, -1 if the handle is not of an open flow.
+int poly1305_flow_finish(poly1305_flow_table *table, poly1305_flow flow,
+                         uint8_t mac[16]);
+
+// Same as poly1305_flow_update() for each of nb_updates updates, in
+// order, with the slots and messages of the following updates
+// prefetched. The same flow may appear more than once. Returns the
+// number of updates with a handle that is not of an open flow,
+// which are skipped.
+size_t poly1305_flow_update_batch(poly1305_flow_table *table,
+                                  const poly1305_flow flows[],
+                                  uint8_t *messages[],
+                                  const size_t message_sizes[],
+                                  size_t nb_updates);
+
+#endif // POLY1305_FLOW_H
+
+//======================================================================
+// EOF poly1305_flow.h
+//======================================================================
@@ -0,0 +1,263 @@
+//======================================================================
+//
+// poly1305_parallel.c
+// -------------------
+// Multi-threaded MAC of a single large message using a pool of
+// worker threads and the partial evaluation interface.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "monocypher.h"
+#include "poly1305_parallel.h"
+
+
+//------------------------------------------------------------------
+// A job evaluates one chunk of a message. The jobs of a call are
+// queued in the pool, and the call waits until its pending count
+// reaches zero.
+//------------------------------------------------------------------
+typedef struct poly1305_job {
+  struct poly1305_job     *next;
+  uint8_t                 *chunk;
+  size_t                   chunk_size;
+  uint8_t                 *key;
+  size_t                  *pending;
+  crypto_poly1305_partial  partial;
+} poly1305_job;
+
+struct poly1305_pool {
+  pthread_mutex_t  lock;
+  pthread_cond_t   work;   // jobs have been queued, or stop
+  pthread_cond_t   done;   // a job has been completed
+  poly1305_job    *head;
+  poly1305_job    *tail;
+  int              stop;
+  unsigned         nb_threads;
+  pthread_t        threads[];
+};
+
+
+//------------------------------------------------------------------
+// pool_pop()
+// Take the next job from the queue. Called with the lock held.
+//------------------------------------------------------------------
+static poly1305_job *pool_pop(poly1305_pool *pool)
+{
+  poly1305_job *job = pool->head;
+  if (job) {
+    pool->head = job->next;
+    if (!pool->head) {
+      pool->tail = NULL;
+    }
+  }
+  return job;
+}
+
+
+//------------------------------------------------------------------
+// pool_run()
+// Evaluate the chunk of the job and report it as done.
+// Called without the lock.
+//------------------------------------------------------------------
+static void pool_run(poly1305_pool *pool, poly1305_job *job)
+{
+  crypto_poly1305_chunk(&job->partial, job->key,
+                        job->chunk, job->chunk_size);
+
+  pthread_mutex_lock(&pool->lock);
+  if (--*job->pending == 0) {
+    pthread_cond_broadcast(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+
+//------------------------------------------------------------------
+// pool_worker()
+//------------------------------------------------------------------
+static void *pool_worker(void *arg)
+{
+  poly1305_pool *pool = arg;
+
+  pthread_mutex_lock(&pool->lock);
+  while (!pool->stop) {
+    poly1305_job *job = pool_pop(pool);
+    if (!job) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+      continue;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pool_run(pool, job);
+    pthread_mutex_lock(&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+poly1305_pool *poly1305_pool_create(unsigned nb_threads)
+{
+  poly1305_pool *pool = calloc(1, sizeof(*pool) +
+                               nb_threads * sizeof(pthread_t));
+  if (!pool) {
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (unsigned i = 0 ; i < nb_threads ; i++) {
+    if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+      poly1305_pool_destroy(pool);
+      return NULL;
+    }
+    pool->nb_threads++;
+  }
+  return pool;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void poly1305_pool_destroy(poly1305_pool *pool)
+{
+  if (!pool) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (unsigned i = 0 ; i < pool->nb_threads ; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+
+//------------------------------------------------------------------
+// crypto_poly1305_parallel()
+//
+// The message is split into one chunk per worker plus one for the
+// caller, each a multiple of 16 bytes except the last, and never
+// smaller than POLY1305_PARALLEL_MIN_CHUNK. While waiting the
+// caller also takes jobs from the queue.
+//------------------------------------------------------------------
+int crypto_poly1305_parallel(poly1305_pool *pool, uint8_t mac[16],
+                             uint8_t *message, size_t message_size,
+                             uint8_t key[32])
+{
+  size_t nb_chunks = pool ? pool->nb_threads + 1 : 1;
+  size_t max_chunks = (message_size + POLY1305_PARALLEL_MIN_CHUNK - 1) /
+                      POLY1305_PARALLEL_MIN_CHUNK;
+  if (nb_chunks > max_chunks) {
+    nb_chunks = max_chunks;
+  }
+
+  if (nb_chunks <= 1) {
+    crypto_poly1305(mac, message, message_size, key);
+    return 0;
+  }
+
+  size_t nb_blocks  = (message_size + 15) / 16;
+  size_t chunk_size = (nb_blocks + nb_chunks - 1) / nb_chunks * 16;
+  nb_chunks = (message_size + chunk_size - 1) / chunk_size;
+
+  poly1305_job *jobs = calloc(nb_chunks, sizeof(poly1305_job));
+  if (!jobs) {
+    return -1;
+  }
+
+  size_t pending = nb_chunks - 1;
+  for (size_t i = 0 ; i < nb_chunks ; i++) {
+    size_t offset = i * chunk_size;
+    jobs[i].chunk      = message + offset;
+    jobs[i].chunk_size = message_size - offset < chunk_size ?
+                         message_size - offset : chunk_size;
+    jobs[i].key        = key;
+    jobs[i].pending    = &pending;
+  }
+
+  // Queue all chunks but the first, which we process ourselves.
+  pthread_mutex_lock(&pool->lock);
+  for (size_t i = 1 ; i < nb_chunks ; i++) {
+    if (pool->tail) {
+      pool->tail->next = &jobs[i];
+    }
+    else {
+      pool->head = &jobs[i];
+    }
+    pool->tail = &jobs[i];
+  }
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  crypto_poly1305_chunk(&jobs[0].partial, key, jobs[0].chunk,
+                        jobs[0].chunk_size);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pending > 0) {
+    poly1305_job *job = pool_pop(pool);
+    if (job) {
+      pthread_mutex_unlock(&pool->lock);
+      pool_run(pool, job);
+      pthread_mutex_lock(&pool->lock);
+    }
+    else {
+      pthread_cond_wait(&pool->done, &pool->lock);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  // Combine the partials in message order.
+  for (size_t i = 1 ; i < nb_chunks ; i++) {
+    crypto_poly1305_combine(&jobs[0].partial, &jobs[i].partial, key);
+  }
+  crypto_poly1305_partial_final(mac, &jobs[0].partial, key);
+
+  crypto_wipe(jobs, nb_chunks * sizeof(poly1305_job));
+  free(jobs);
+  return 0;
+}
+
+//======================================================================
+// EOF poly1305_parallel.c
+//======================================================================
@@ -0,0 +1,68 @@
+//======================================================================
+//
+// poly1305_parallel.h
+// -------------------
+// Multi-threaded MAC of a single large message, built on the
+// partial evaluation interface in monocypher.h.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#ifndef POLY1305_PARALLEL_H
+#define POLY1305_PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Messages are never split into chunks smaller than this.
+#ifndef POLY1305_PARALLEL_MIN_CHUNK
+#define POLY1305_PARALLEL_MIN_CHUNK (64 * 1024)
+#endif
+
+typedef struct poly1305_pool poly1305_pool;
+
+// Create a pool of nb_threads worker threads. Returns NULL on
+// failure. The pool can be shared by any number of callers.
+poly1305_pool *poly1305_pool_create(unsigned nb_threads);
+void           poly1305_pool_destroy(poly1305_pool *pool);
+
+// MAC a message split over the threads in the pool. The calling
+// thread processes one of the chunks itself. The tag is identical
+// to the one from crypto_poly1305(). A NULL pool processes the
+// message on the calling thread. Returns 0 on success, -1 if
+// memory for the chunk jobs could not be allocated.
+int crypto_poly1305_parallel(poly1305_pool *pool, uint8_t mac[16],
+                             uint8_t *message, size_t message_size,
+                             uint8_t key[32]);
+
+#endif // POLY1305_PARALLEL_H
+
+//======================================================================
+// EOF poly1305_parallel.h
+//======================================================================
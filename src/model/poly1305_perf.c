@@ -0,0 +1,564 @@
+//======================================================================
+//
+// poly1305_perf.c
+// ---------------
+// Hardware performance counter instrumentation of the C model,
+// using perf_event_open(). Only active in libraries built with
+// POLY1305_PERF defined, other builds get stubs.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "poly1305_perf.h"
+
+#ifdef POLY1305_PERF
+#include <linux/perf_event.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+static const char *counter_names[POLY1305_PERF_NB_COUNTERS] = {
+  "cycles", "instructions", "branch-misses", "L1D-misses", "task-clock"
+};
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+const char *poly1305_perf_counter_name(size_t counter)
+{
+  return counter < POLY1305_PERF_NB_COUNTERS ? counter_names[counter] : NULL;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+size_t poly1305_perf_bucket_size(size_t bucket)
+{
+  return bucket == 0 ? 0 : (size_t)16 << bucket;
+}
+
+
+#ifdef POLY1305_PERF
+static size_t perf_bucket(size_t bytes)
+{
+  size_t bucket = 0;
+  while (bucket + 1 < POLY1305_PERF_NB_BUCKETS &&
+         bytes >= poly1305_perf_bucket_size(bucket + 1)) {
+    bucket++;
+  }
+  return bucket;
+}
+
+
+//------------------------------------------------------------------
+// Aggregated counts. Kernels are told apart by the address of
+// their name, which is a string constant of the library, and get
+// the index of their first use in perf_kernels[].
+//
+// Every thread adds up its calls in its own table, without taking
+// a lock. The stores are relaxed atomics, so that the tables can be
+// merged by the readers while the threads keep running. The tables
+// of threads that have exited are added to perf_retired. A reset
+// bumps perf_generation, and each thread clears its own table the
+// next time it records a call. Until then its table is left out.
+//------------------------------------------------------------------
+#define PERF_MAX_KERNELS 8
+
+typedef struct {
+  atomic_uint_least64_t calls;
+  atomic_uint_least64_t bytes;
+  atomic_uint_least64_t counts[POLY1305_PERF_NB_COUNTERS];
+  atomic_uint           valid;
+} perf_cell;
+
+//------------------------------------------------------------------
+// Counters and counts of one thread, opened on first use and closed
+// when the thread exits. The first counter that could be opened
+// leads the group, so that all of them are read with one read()
+// call. nested[] counts the measured calls that have finished,
+// including those inside others, for the calls around them to
+// leave out.
+//------------------------------------------------------------------
+typedef struct perf_thread {
+  struct perf_thread *next;                    // in perf_threads
+  int         fds[POLY1305_PERF_NB_COUNTERS];  // fds[0] leads
+  size_t      nb_open;
+  size_t      order[POLY1305_PERF_NB_COUNTERS];// counter of each value
+  uint64_t    nested[POLY1305_PERF_NB_COUNTERS];
+  const char *kernels[PERF_MAX_KERNELS];       // seen by this thread
+  atomic_uint_least64_t generation;            // of the table
+  perf_cell   table[PERF_MAX_KERNELS][POLY1305_PERF_NB_BUCKETS];
+} perf_thread;
+
+static pthread_mutex_t       perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t        perf_once = PTHREAD_ONCE_INIT;
+static pthread_key_t         perf_key;
+static const char           *perf_kernels[PERF_MAX_KERNELS];
+static perf_thread          *perf_threads;
+static poly1305_perf_stats   perf_retired[PERF_MAX_KERNELS]
+                                         [POLY1305_PERF_NB_BUCKETS];
+static atomic_uint_least64_t perf_generation;
+
+static _Thread_local perf_thread *perf_self;
+
+
+static int perf_open(size_t counter, int group)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.read_format    = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  switch (counter) {
+  case POLY1305_PERF_CYCLES:
+    attr.type   = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case POLY1305_PERF_INSTRUCTIONS:
+    attr.type   = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case POLY1305_PERF_BRANCH_MISSES:
+    attr.type   = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    break;
+  case POLY1305_PERF_L1D_MISSES:
+    attr.type   = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ      <<  8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS  << 16);
+    break;
+  default:
+    attr.type   = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_TASK_CLOCK;
+    break;
+  }
+
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+
+//------------------------------------------------------------------
+// perf_thread_open()
+// Open the counters of the calling thread and register its table.
+// Returns NULL if it could not be allocated, the calls of the
+// thread are then not recorded.
+//------------------------------------------------------------------
+static perf_thread *perf_thread_open(void)
+{
+  perf_thread *t = calloc(1, sizeof(*t));
+  if (t == NULL) {
+    return NULL;
+  }
+
+  for (size_t i = 0 ; i < POLY1305_PERF_NB_COUNTERS ; i++) {
+    int fd = perf_open(i, t->nb_open ? t->fds[0] : -1);
+    if (fd < 0) {
+      continue;
+    }
+    t->fds  [t->nb_open] = fd;
+    t->order[t->nb_open] = i;
+    t->nb_open++;
+  }
+
+  pthread_mutex_lock(&perf_lock);
+  atomic_init(&t->generation, atomic_load(&perf_generation));
+  t->next      = perf_threads;
+  perf_threads = t;
+  pthread_mutex_unlock(&perf_lock);
+
+  pthread_setspecific(perf_key, t);
+  return t;
+}
+
+
+//------------------------------------------------------------------
+// perf_thread_exit()
+// Destructor of perf_key. Move the counts of the exiting thread to
+// perf_retired and close its counters.
+//------------------------------------------------------------------
+static void perf_thread_exit(void *arg)
+{
+  perf_thread *t = arg;
+
+  pthread_mutex_lock(&perf_lock);
+  perf_thread **p = &perf_threads;
+  while (*p != t) {
+    p = &(*p)->next;
+  }
+  *p = t->next;
+
+  if (atomic_load(&t->generation) == atomic_load(&perf_generation)) {
+    for (size_t k = 0 ; k < PERF_MAX_KERNELS ; k++) {
+      for (size_t b = 0 ; b < POLY1305_PERF_NB_BUCKETS ; b++) {
+        poly1305_perf_stats *s = &perf_retired[k][b];
+        perf_cell           *c = &t->table[k][b];
+        s->calls += atomic_load(&c->calls);
+        s->bytes += atomic_load(&c->bytes);
+        s->valid |= atomic_load(&c->valid);
+        for (size_t i = 0 ; i < POLY1305_PERF_NB_COUNTERS ; i++) {
+          s->counts[i] += atomic_load(&c->counts[i]);
+        }
+      }
+    }
+  }
+  pthread_mutex_unlock(&perf_lock);
+
+  for (size_t i = t->nb_open ; i > 0 ; i--) {
+    close(t->fds[i - 1]);
+  }
+  free(t);
+  perf_self = NULL;
+}
+
+
+//------------------------------------------------------------------
+// perf_read()
+// Read the counters of the thread. Returns the valid mask.
+//------------------------------------------------------------------
+static uint32_t perf_read(perf_thread *t,
+                          uint64_t counts[POLY1305_PERF_NB_COUNTERS])
+{
+  uint64_t buf[1 + POLY1305_PERF_NB_COUNTERS];
+  uint32_t valid = 0;
+
+  if (t->nb_open == 0 ||
+      read(t->fds[0], buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t)) {
+    return 0;
+  }
+  for (size_t i = 0 ; i < buf[0] && i < t->nb_open ; i++) {
+    counts[t->order[i]] = buf[1 + i];
+    valid |= (uint32_t)1 << t->order[i];
+  }
+  return valid;
+}
+
+
+//------------------------------------------------------------------
+// perf_kernel()
+// Index of the kernel, registering it the first time any thread
+// sees it. Returns PERF_MAX_KERNELS if the table is full.
+//------------------------------------------------------------------
+static size_t perf_kernel(perf_thread *t, const char *kernel)
+{
+  for (size_t k = 0 ; k < PERF_MAX_KERNELS && t->kernels[k] ; k++) {
+    if (t->kernels[k] == kernel) {
+      return k;
+    }
+  }
+
+  pthread_mutex_lock(&perf_lock);
+  size_t k = 0;
+  while (k < PERF_MAX_KERNELS && perf_kernels[k] != NULL &&
+         perf_kernels[k] != kernel) {
+    k++;
+  }
+  if (k < PERF_MAX_KERNELS) {
+    perf_kernels[k] = kernel;
+  }
+  memcpy(t->kernels, perf_kernels, sizeof(perf_kernels));
+  pthread_mutex_unlock(&perf_lock);
+  return k;
+}
+
+
+// Add to a count only written by the owning thread.
+static void perf_add(atomic_uint_least64_t *count, uint64_t x)
+{
+  atomic_store_explicit(count,
+                        atomic_load_explicit(count, memory_order_relaxed) + x,
+                        memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------
+// perf_merge()
+// Counts of kernel k in bucket b, of the exited threads and of the
+// running threads since the last reset. Called with perf_lock held.
+//------------------------------------------------------------------
+static void perf_merge(size_t k, size_t b, poly1305_perf_stats *s)
+{
+  uint64_t generation = atomic_load(&perf_generation);
+
+  *s = perf_retired[k][b];
+  for (perf_thread *t = perf_threads ; t != NULL ; t = t->next) {
+    if (atomic_load_explicit(&t->generation, memory_order_acquire)
+        != generation) {
+      continue;
+    }
+    perf_cell *c = &t->table[k][b];
+    s->calls += atomic_load_explicit(&c->calls, memory_order_relaxed);
+    s->bytes += atomic_load_explicit(&c->bytes, memory_order_relaxed);
+    s->valid |= atomic_load_explicit(&c->valid, memory_order_relaxed);
+    for (size_t i = 0 ; i < POLY1305_PERF_NB_COUNTERS ; i++) {
+      s->counts[i] += atomic_load_explicit(&c->counts[i],
+                                           memory_order_relaxed);
+    }
+  }
+}
+
+
+static void perf_atexit(void)
+{
+  const char *name = getenv("POLY1305_PERF_DUMP");
+  FILE       *out  = stderr;
+
+  if (name != NULL && name[0] != '\0') {
+    out = fopen(name, "w");
+    if (out == NULL) {
+      perror(name);
+      return;
+    }
+  }
+  poly1305_perf_dump(out);
+  if (out != stderr) {
+    fclose(out);
+  }
+}
+
+static void perf_init(void)
+{
+  pthread_key_create(&perf_key, perf_thread_exit);
+  atexit(perf_atexit);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void poly1305_perf_begin(poly1305_perf_sample *sample)
+{
+  pthread_once(&perf_once, perf_init);
+  if (perf_self == NULL) {
+    perf_self = perf_thread_open();
+  }
+
+  perf_thread *t = perf_self;
+  sample->running = t != NULL && perf_read(t, sample->counts) != 0;
+  if (sample->running) {
+    memcpy(sample->nested, t->nested, sizeof(sample->nested));
+  }
+}
+
+
+//------------------------------------------------------------------
+// poly1305_perf_end()
+// Record the call in the table of the thread. Only the counts of
+// the call itself are recorded, without the calls measured inside
+// it, while nested[] gets all of them for the calls around it.
+//------------------------------------------------------------------
+void poly1305_perf_end(poly1305_perf_sample *sample,
+                       const char *kernel, size_t bytes)
+{
+  perf_thread *t = perf_self;
+  uint64_t counts[POLY1305_PERF_NB_COUNTERS] = {0};
+  uint32_t valid = 0;
+
+  if (t == NULL) {
+    return;
+  }
+  if (sample->running) {
+    valid = perf_read(t, counts);
+  }
+
+  size_t k = perf_kernel(t, kernel);
+  if (k == PERF_MAX_KERNELS) {
+    return;
+  }
+
+  uint64_t generation = atomic_load_explicit(&perf_generation,
+                                             memory_order_relaxed);
+  if (atomic_load_explicit(&t->generation, memory_order_relaxed)
+      != generation) {
+    for (size_t j = 0 ; j < PERF_MAX_KERNELS ; j++) {
+      for (size_t b = 0 ; b < POLY1305_PERF_NB_BUCKETS ; b++) {
+        perf_cell *c = &t->table[j][b];
+        atomic_store_explicit(&c->calls, 0, memory_order_relaxed);
+        atomic_store_explicit(&c->bytes, 0, memory_order_relaxed);
+        atomic_store_explicit(&c->valid, 0, memory_order_relaxed);
+        for (size_t i = 0 ; i < POLY1305_PERF_NB_COUNTERS ; i++) {
+          atomic_store_explicit(&c->counts[i], 0, memory_order_relaxed);
+        }
+      }
+    }
+    atomic_store_explicit(&t->generation, generation, memory_order_release);
+  }
+
+  perf_cell *c = &t->table[k][perf_bucket(bytes)];
+  perf_add(&c->calls, 1);
+  perf_add(&c->bytes, bytes);
+  atomic_store_explicit(&c->valid,
+                        atomic_load_explicit(&c->valid, memory_order_relaxed)
+                        | valid, memory_order_relaxed);
+  for (size_t i = 0 ; i < POLY1305_PERF_NB_COUNTERS ; i++) {
+    if (valid & ((uint32_t)1 << i)) {
+      uint64_t all    = counts[i] - sample->counts[i];
+      uint64_t inside = t->nested[i] - sample->nested[i];
+      perf_add(&c->counts[i], all - inside);
+      t->nested[i] = sample->nested[i] + all;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int poly1305_perf_enabled(void)
+{
+  return 1;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int poly1305_perf_get(const char *kernel, size_t bucket,
+                      poly1305_perf_stats *stats)
+{
+  int res = -1;
+  if (bucket >= POLY1305_PERF_NB_BUCKETS) {
+    return res;
+  }
+
+  pthread_mutex_lock(&perf_lock);
+  for (size_t k = 0 ; k < PERF_MAX_KERNELS && perf_kernels[k] ; k++) {
+    if (strcmp(perf_kernels[k], kernel) == 0) {
+      perf_merge(k, bucket, stats);
+      res = stats->calls > 0 ? 0 : -1;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&perf_lock);
+  return res;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void poly1305_perf_reset(void)
+{
+  pthread_mutex_lock(&perf_lock);
+  memset(perf_retired, 0, sizeof(perf_retired));
+  atomic_fetch_add(&perf_generation, 1);
+  pthread_mutex_unlock(&perf_lock);
+}
+
+
+//------------------------------------------------------------------
+// poly1305_perf_dump()
+// One line per kernel and bucket with calls, with the counts per
+// byte or per call. Counters that could not be read show as n/a.
+//------------------------------------------------------------------
+static void perf_field(FILE *out, const poly1305_perf_stats *s,
+                       size_t counter, double scale)
+{
+  if (s->valid & ((uint32_t)1 << counter)) {
+    fprintf(out, " %11.3f", (double)s->counts[counter] * scale);
+  }
+  else {
+    fprintf(out, " %11s", "n/a");
+  }
+}
+
+void poly1305_perf_dump(FILE *out)
+{
+  fprintf(out, "%-8s %9s %10s %12s %11s %11s %11s %11s %11s\n",
+          "kernel", "size", "calls", "bytes", "cycles/B", "insns/B",
+          "brmiss/call", "L1Dmiss/kB", "ns/B");
+
+  pthread_mutex_lock(&perf_lock);
+  for (size_t k = 0 ; k < PERF_MAX_KERNELS && perf_kernels[k] ; k++) {
+    for (size_t b = 0 ; b < POLY1305_PERF_NB_BUCKETS ; b++) {
+      poly1305_perf_stats s;
+      perf_merge(k, b, &s);
+      if (s.calls == 0) {
+        continue;
+      }
+      double per_byte = s.bytes ? 1.0 / (double)s.bytes : 0.0;
+      fprintf(out, "%-8s %8zu+ %10" PRIu64 " %12" PRIu64, perf_kernels[k],
+              poly1305_perf_bucket_size(b), s.calls, s.bytes);
+      perf_field(out, &s, POLY1305_PERF_CYCLES,        per_byte);
+      perf_field(out, &s, POLY1305_PERF_INSTRUCTIONS,  per_byte);
+      perf_field(out, &s, POLY1305_PERF_BRANCH_MISSES, 1.0 / (double)s.calls);
+      perf_field(out, &s, POLY1305_PERF_L1D_MISSES,    1024.0 * per_byte);
+      perf_field(out, &s, POLY1305_PERF_TASK_CLOCK,    per_byte);
+      fprintf(out, "\n");
+    }
+  }
+  pthread_mutex_unlock(&perf_lock);
+}
+
+#else // POLY1305_PERF
+
+void poly1305_perf_begin(poly1305_perf_sample *sample)
+{
+  sample->running = 0;
+}
+
+void poly1305_perf_end(poly1305_perf_sample *sample,
+                       const char *kernel, size_t bytes)
+{
+  (void)sample;
+  (void)kernel;
+  (void)bytes;
+}
+
+int poly1305_perf_enabled(void)
+{
+  return 0;
+}
+
+int poly1305_perf_get(const char *kernel, size_t bucket,
+                      poly1305_perf_stats *stats)
+{
+  (void)kernel;
+  (void)bucket;
+  (void)stats;
+  return -1;
+}
+
+void poly1305_perf_reset(void)
+{
+}
+
+void poly1305_perf_dump(FILE *out)
+{
+  fprintf(out, "poly1305_perf: library built without POLY1305_PERF\n");
+}
+
+#endif // POLY1305_PERF
+
+//======================================================================
+// EOF poly1305_perf.c
+//======================================================================
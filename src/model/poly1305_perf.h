@@ -0,0 +1,111 @@
+//======================================================================
+//
+// poly1305_perf.h
+// ---------------
+// Hardware performance counter instrumentation of the C model.
+// When the library is built with POLY1305_PERF defined, every call
+// of the block kernels, crypto_poly1305_update() and the batch
+// interface is measured with perf_event_open() counters, and the
+// counts are aggregated per kernel and message size bucket.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#ifndef POLY1305_PERF_H
+#define POLY1305_PERF_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Counters, in the order of poly1305_perf_stats.counts[].
+enum {
+    POLY1305_PERF_CYCLES,        // CPU cycles in user space
+    POLY1305_PERF_INSTRUCTIONS,  // retired instructions
+    POLY1305_PERF_BRANCH_MISSES, // mispredicted branches
+    POLY1305_PERF_L1D_MISSES,    // L1 data cache read misses
+    POLY1305_PERF_TASK_CLOCK,    // ns on the CPU, always available
+    POLY1305_PERF_NB_COUNTERS
+};
+
+// Size buckets. Bucket 0 holds calls of less than 32 bytes, bucket
+// b calls of 16 << b up to 32 << b bytes, and the last bucket
+// everything from 1 MB up.
+#define POLY1305_PERF_NB_BUCKETS 17
+
+typedef struct {
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t counts[POLY1305_PERF_NB_COUNTERS];
+    uint32_t valid;  // bit i set if counter i could be read
+} poly1305_perf_stats;
+
+// Measurement in progress, internal to the library.
+typedef struct {
+    uint64_t counts[POLY1305_PERF_NB_COUNTERS];
+    uint64_t nested[POLY1305_PERF_NB_COUNTERS]; // of calls measured inside
+    int      running;
+} poly1305_perf_sample;
+
+// Names of the counters, for printing.
+const char *poly1305_perf_counter_name(size_t counter);
+
+// Smallest size in bytes of the calls in a bucket.
+size_t poly1305_perf_bucket_size(size_t bucket);
+
+// 1 if the library was built with POLY1305_PERF, 0 otherwise.
+int poly1305_perf_enabled(void);
+
+// Aggregated counts of the named kernel, or pseudo kernel "update"
+// or "batch", in the given bucket, summed over all threads. Calls
+// measured inside another, such as the kernel calls of an update,
+// are not counted again in the outer one: "update" and "batch" only
+// count their own overhead, with bytes still counting the whole
+// call. Returns 0 on success, -1 if nothing has been recorded for it.
+int poly1305_perf_get(const char *kernel, size_t bucket,
+                      poly1305_perf_stats *stats);
+
+// Clear all aggregated counts.
+void poly1305_perf_reset(void);
+
+// Print a table of everything recorded so far. The perf build does
+// this at exit to stderr, or to the file named by the environment
+// variable POLY1305_PERF_DUMP.
+void poly1305_perf_dump(FILE *out);
+
+// Used by the library around the measured calls.
+void poly1305_perf_begin(poly1305_perf_sample *sample);
+void poly1305_perf_end  (poly1305_perf_sample *sample,
+                         const char *kernel, size_t bytes);
+
+#endif // POLY1305_PERF_H
+
+//======================================================================
+// EOF poly1305_perf.h
+//======================================================================
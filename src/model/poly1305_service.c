@@ -0,0 +1,598 @@
+//======================================================================
+//
+// poly1305_service.c
+// ------------------
+// Work stealing MAC service, see poly1305_service.h.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "monocypher.h"
+#include "poly1305_service.h"
+
+
+// Free requests kept by each worker for reuse.
+#define POOL_MAX 4096
+
+// Index of the queue item of a message that is not split.
+#define WHOLE ((size_t)-1)
+
+
+//------------------------------------------------------------------
+// A submitted message. Split messages also have the partials of
+// their chunks, the last chunk to finish combines them.
+//------------------------------------------------------------------
+typedef struct {
+  atomic_size_t            pending;   // chunks not done yet
+  size_t                   nb_chunks;
+  crypto_poly1305_partial  partials[];
+} svc_split;
+
+struct poly1305_future {
+  atomic_int        done;
+  poly1305_service *service;
+};
+
+typedef struct svc_request {
+  struct svc_request *next;       // free list of the pool
+  uint8_t            *mac;
+  const uint8_t      *message;
+  size_t              message_size;
+  uint8_t             key[32];
+  poly1305_callback   callback;
+  void               *arg;
+  poly1305_future    *future;
+  svc_split          *split;
+} svc_request;
+
+// Work queue entry, a whole message or one chunk of one.
+typedef struct {
+  svc_request *request;
+  size_t       chunk;
+} svc_item;
+
+
+//------------------------------------------------------------------
+// Every worker owns a double ended queue and a pool of requests.
+// The owner works from the tail, newest first, thieves take from
+// the head, oldest first.
+//------------------------------------------------------------------
+typedef struct {
+  pthread_mutex_t   lock;
+  svc_item         *items;      // ring buffer
+  size_t            capacity;   // power of two
+  size_t            head;
+  size_t            tail;       // head + number of items
+  svc_request      *pool;
+  size_t            pool_size;
+  pthread_t         thread;
+  poly1305_service *service;
+  unsigned          index;
+} svc_worker;
+
+struct poly1305_service {
+  pthread_mutex_t   sleep_lock;
+  pthread_cond_t    work;       // items have been queued, or stop
+  pthread_mutex_t   done_lock;
+  pthread_cond_t    done;       // a future or the last request is done
+  atomic_size_t     queued;     // items in all queues
+  atomic_size_t     outstanding;// requests not done yet
+  atomic_uint       sleepers;
+  atomic_uint       next;       // round robin for submissions
+  int               stop;
+  unsigned          nb_workers;
+  svc_worker        workers[];
+};
+
+
+//------------------------------------------------------------------
+// Queue operations, called with the lock of the worker held.
+//------------------------------------------------------------------
+static int queue_push(svc_worker *w, svc_item item)
+{
+  if (w->tail - w->head == w->capacity) {
+    size_t    capacity = w->capacity ? w->capacity * 2 : 64;
+    svc_item *items    = malloc(capacity * sizeof(svc_item));
+    if (!items) {
+      return -1;
+    }
+    for (size_t i = w->head ; i < w->tail ; i++) {
+      items[i - w->head] = w->items[i & (w->capacity - 1)];
+    }
+    free(w->items);
+    w->items    = items;
+    w->tail    -= w->head;
+    w->head     = 0;
+    w->capacity = capacity;
+  }
+  w->items[w->tail++ & (w->capacity - 1)] = item;
+  return 0;
+}
+
+static int item_small(const svc_item *item)
+{
+  return item->chunk == WHOLE &&
+         item->request->message_size <= POLY1305_SERVICE_SMALL;
+}
+
+// Take one item, or a group of small whole messages, from the tail
+// (own queue) or the head (stealing).
+static size_t queue_take(svc_worker *w, svc_item *out, int from_tail)
+{
+  size_t n = 0;
+  while (w->tail != w->head && n < POLY1305_SERVICE_GROUP) {
+    svc_item *item = from_tail ? &w->items[(w->tail - 1) & (w->capacity - 1)]
+                               : &w->items[ w->head      & (w->capacity - 1)];
+    if (n > 0 && (!item_small(item) || !item_small(&out[0]))) {
+      break;
+    }
+    out[n++] = *item;
+    if (from_tail) { w->tail--; } else { w->head++; }
+  }
+  return n;
+}
+
+
+//------------------------------------------------------------------
+// Request pools. Requests are taken from the pool of the worker the
+// message is queued on, and returned to the pool of the worker that
+// completed them.
+//------------------------------------------------------------------
+static svc_request *pool_get(svc_worker *w)
+{
+  svc_request *request = w->pool;
+  if (request) {
+    w->pool = request->next;
+    w->pool_size--;
+    return request;
+  }
+  return malloc(sizeof(svc_request));
+}
+
+static void pool_put(svc_worker *w, svc_request *request)
+{
+  crypto_wipe(request, sizeof(svc_request));
+  pthread_mutex_lock(&w->lock);
+  if (w->pool_size < POOL_MAX) {
+    request->next = w->pool;
+    w->pool       = request;
+    w->pool_size++;
+    request       = NULL;
+  }
+  pthread_mutex_unlock(&w->lock);
+  free(request);
+}
+
+
+//------------------------------------------------------------------
+// Completion.
+//------------------------------------------------------------------
+static void svc_complete(svc_worker *w, svc_request *request)
+{
+  poly1305_service *service = w->service;
+  poly1305_future  *future  = request->future;
+
+  if (request->callback) {
+    request->callback(request->arg, request->mac);
+  }
+  if (request->split) {
+    size_t size = sizeof(svc_split) +
+                  request->split->nb_chunks * sizeof(crypto_poly1305_partial);
+    crypto_wipe(request->split, size);
+    free(request->split);
+  }
+  pool_put(w, request);
+
+  int last = atomic_fetch_sub(&service->outstanding, 1) == 1;
+  if (future) {
+    atomic_store(&future->done, 1);
+  }
+  if (future || last) {
+    pthread_mutex_lock(&service->done_lock);
+    pthread_cond_broadcast(&service->done);
+    pthread_mutex_unlock(&service->done_lock);
+  }
+}
+
+
+static void svc_run(svc_worker *w, svc_item *item)
+{
+  svc_request *request = item->request;
+  uint8_t     *message = (uint8_t *)request->message;
+
+  if (item->chunk == WHOLE) {
+    crypto_poly1305(request->mac, message, request->message_size,
+                    request->key);
+    svc_complete(w, request);
+    return;
+  }
+
+  svc_split *split  = request->split;
+  size_t     offset = item->chunk * POLY1305_SERVICE_CHUNK;
+  size_t     size   = request->message_size - offset;
+  if (size > POLY1305_SERVICE_CHUNK) {
+    size = POLY1305_SERVICE_CHUNK;
+  }
+  crypto_poly1305_chunk(&split->partials[item->chunk], request->key,
+                        message + offset, size);
+
+  // The last chunk done combines the partials in message order.
+  if (atomic_fetch_sub(&split->pending, 1) == 1) {
+    for (size_t i = 1 ; i < split->nb_chunks ; i++) {
+      crypto_poly1305_combine(&split->partials[0], &split->partials[i],
+                              request->key);
+    }
+    crypto_poly1305_partial_final(request->mac, &split->partials[0],
+                                  request->key);
+    svc_complete(w, request);
+  }
+}
+
+
+//------------------------------------------------------------------
+// svc_run_group()
+// Run the items taken at once. A group of more than one item only
+// has small whole messages, they are MACed with one batch call.
+//------------------------------------------------------------------
+static void svc_run_group(svc_worker *w, svc_item *items, size_t n)
+{
+  if (n == 1) {
+    svc_run(w, &items[0]);
+    return;
+  }
+
+  uint8_t *macs    [POLY1305_SERVICE_GROUP];
+  uint8_t *messages[POLY1305_SERVICE_GROUP];
+  size_t   sizes   [POLY1305_SERVICE_GROUP];
+  uint8_t *keys    [POLY1305_SERVICE_GROUP];
+  for (size_t i = 0 ; i < n ; i++) {
+    svc_request *request = items[i].request;
+    macs    [i] = request->mac;
+    messages[i] = (uint8_t *)request->message;
+    sizes   [i] = request->message_size;
+    keys    [i] = request->key;
+  }
+  crypto_poly1305_batch(macs, messages, sizes, keys, n);
+  for (size_t i = 0 ; i < n ; i++) {
+    svc_complete(w, items[i].request);
+  }
+}
+
+
+//------------------------------------------------------------------
+// Worker thread. Works through its own queue, steals from the
+// others when it is empty, and sleeps when there is nothing left.
+//------------------------------------------------------------------
+static size_t svc_find_work(svc_worker *self, svc_item *items)
+{
+  poly1305_service *service = self->service;
+  size_t n;
+
+  pthread_mutex_lock(&self->lock);
+  n = queue_take(self, items, 1);
+  pthread_mutex_unlock(&self->lock);
+
+  for (unsigned i = 1 ; n == 0 && i < service->nb_workers ; i++) {
+    svc_worker *victim = &service->workers[(self->index + i) %
+                                           service->nb_workers];
+    pthread_mutex_lock(&victim->lock);
+    n = queue_take(victim, items, 0);
+    pthread_mutex_unlock(&victim->lock);
+  }
+
+  if (n > 0) {
+    atomic_fetch_sub(&service->queued, n);
+  }
+  return n;
+}
+
+static void *svc_worker_main(void *arg)
+{
+  svc_worker       *self    = arg;
+  poly1305_service *service = self->service;
+  svc_item          items[POLY1305_SERVICE_GROUP];
+
+  for (;;) {
+    size_t n = svc_find_work(self, items);
+    if (n > 0) {
+      svc_run_group(self, items, n);
+      continue;
+    }
+
+    // Nothing anywhere. Submitters check the sleepers after adding
+    // to queued, so one of us sees the other.
+    pthread_mutex_lock(&service->sleep_lock);
+    atomic_fetch_add(&service->sleepers, 1);
+    while (atomic_load(&service->queued) == 0 && !service->stop) {
+      pthread_cond_wait(&service->work, &service->sleep_lock);
+    }
+    atomic_fetch_sub(&service->sleepers, 1);
+    int stop = service->stop && atomic_load(&service->queued) == 0;
+    pthread_mutex_unlock(&service->sleep_lock);
+    if (stop) {
+      return NULL;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------
+// svc_stop()
+// Stop the first nb_threads workers, which must have been started,
+// once the queues are empty.
+//------------------------------------------------------------------
+static void svc_stop(poly1305_service *service, unsigned nb_threads)
+{
+  pthread_mutex_lock(&service->sleep_lock);
+  service->stop = 1;
+  pthread_cond_broadcast(&service->work);
+  pthread_mutex_unlock(&service->sleep_lock);
+
+  for (unsigned i = 0 ; i < nb_threads ; i++) {
+    pthread_join(service->workers[i].thread, NULL);
+  }
+}
+
+
+//------------------------------------------------------------------
+// svc_free()
+// Free the pools and locks of all workers, and the service.
+//------------------------------------------------------------------
+static void svc_free(poly1305_service *service)
+{
+  for (unsigned i = 0 ; i < service->nb_workers ; i++) {
+    svc_worker *w = &service->workers[i];
+    while (w->pool) {
+      svc_request *next = w->pool->next;
+      free(w->pool);
+      w->pool = next;
+    }
+    free(w->items);
+    pthread_mutex_destroy(&w->lock);
+  }
+  pthread_mutex_destroy(&service->sleep_lock);
+  pthread_cond_destroy (&service->work);
+  pthread_mutex_destroy(&service->done_lock);
+  pthread_cond_destroy (&service->done);
+  free(service);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+poly1305_service *poly1305_service_create(unsigned nb_workers)
+{
+  if (nb_workers == 0) {
+    nb_workers = 1;
+  }
+
+  poly1305_service *service = calloc(1, sizeof(poly1305_service) +
+                                        nb_workers * sizeof(svc_worker));
+  if (!service) {
+    return NULL;
+  }
+  pthread_mutex_init(&service->sleep_lock, NULL);
+  pthread_cond_init (&service->work, NULL);
+  pthread_mutex_init(&service->done_lock, NULL);
+  pthread_cond_init (&service->done, NULL);
+  atomic_init(&service->queued, 0);
+  atomic_init(&service->outstanding, 0);
+  atomic_init(&service->sleepers, 0);
+  atomic_init(&service->next, 0);
+  service->nb_workers = nb_workers;
+
+  for (unsigned i = 0 ; i < nb_workers ; i++) {
+    svc_worker *w = &service->workers[i];
+    pthread_mutex_init(&w->lock, NULL);
+    w->service = service;
+    w->index   = i;
+  }
+
+  // The workers already started keep stealing from all of them, so
+  // nb_workers is left as is and every lock is destroyed.
+  for (unsigned i = 0 ; i < nb_workers ; i++) {
+    if (pthread_create(&service->workers[i].thread, NULL,
+                       svc_worker_main, &service->workers[i]) != 0) {
+      svc_stop(service, i);
+      svc_free(service);
+      return NULL;
+    }
+  }
+  return service;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void poly1305_service_destroy(poly1305_service *service)
+{
+  poly1305_service_drain(service);
+  svc_stop(service, service->nb_workers);
+  svc_free(service);
+}
+
+
+//------------------------------------------------------------------
+// svc_submit()
+// Queue the message on the next worker in turn, split in chunks if
+// it is large.
+//------------------------------------------------------------------
+static int svc_submit(poly1305_service *service, uint8_t mac[16],
+                      const uint8_t *message, size_t message_size,
+                      const uint8_t key[32], poly1305_callback callback,
+                      void *arg, poly1305_future *future)
+{
+  svc_split *split     = NULL;
+  size_t     nb_chunks = 1;
+
+  if (message_size >= POLY1305_SERVICE_SPLIT) {
+    nb_chunks = (message_size + POLY1305_SERVICE_CHUNK - 1) /
+                POLY1305_SERVICE_CHUNK;
+    split = malloc(sizeof(svc_split) +
+                   nb_chunks * sizeof(crypto_poly1305_partial));
+    if (!split) {
+      return -1;
+    }
+    atomic_init(&split->pending, nb_chunks);
+    split->nb_chunks = nb_chunks;
+  }
+
+  unsigned    index = atomic_fetch_add(&service->next, 1) % service->nb_workers;
+  svc_worker *w     = &service->workers[index];
+
+  pthread_mutex_lock(&w->lock);
+  svc_request *request = pool_get(w);
+  int          res     = request ? 0 : -1;
+  if (request) {
+    request->mac          = mac;
+    request->message      = message;
+    request->message_size = message_size;
+    memcpy(request->key, key, 32);
+    request->callback     = callback;
+    request->arg          = arg;
+    request->future       = future;
+    request->split        = split;
+
+    // Chunks go in reverse order, so that the owner works through
+    // them from the start and thieves take them from the end.
+    atomic_fetch_add(&service->outstanding, 1);
+    for (size_t i = nb_chunks ; res == 0 && i-- > 0 ; ) {
+      svc_item item = {request, split ? i : WHOLE};
+      res = queue_push(w, item);
+    }
+    if (res != 0) {
+      // Growing the queue failed, take back what was queued.
+      while (w->tail != w->head &&
+             w->items[(w->tail - 1) & (w->capacity - 1)].request == request) {
+        w->tail--;
+      }
+      atomic_fetch_sub(&service->outstanding, 1);
+    }
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  if (res != 0) {
+    free(request);
+    free(split);
+    return -1;
+  }
+
+  atomic_fetch_add(&service->queued, nb_chunks);
+  if (atomic_load(&service->sleepers) > 0) {
+    pthread_mutex_lock(&service->sleep_lock);
+    if (nb_chunks > 1) {
+      pthread_cond_broadcast(&service->work);
+    }
+    else {
+      pthread_cond_signal(&service->work);
+    }
+    pthread_mutex_unlock(&service->sleep_lock);
+  }
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int poly1305_service_submit(poly1305_service *service, uint8_t mac[16],
+                            const uint8_t *message, size_t message_size,
+                            const uint8_t key[32],
+                            poly1305_callback callback, void *arg)
+{
+  return svc_submit(service, mac, message, message_size, key,
+                    callback, arg, NULL);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+poly1305_future *poly1305_service_async(poly1305_service *service,
+                                        uint8_t mac[16],
+                                        const uint8_t *message,
+                                        size_t message_size,
+                                        const uint8_t key[32])
+{
+  poly1305_future *future = malloc(sizeof(poly1305_future));
+  if (!future) {
+    return NULL;
+  }
+  atomic_init(&future->done, 0);
+  future->service = service;
+
+  if (svc_submit(service, mac, message, message_size, key,
+                 NULL, NULL, future) != 0) {
+    free(future);
+    return NULL;
+  }
+  return future;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int poly1305_future_ready(const poly1305_future *future)
+{
+  return atomic_load(&((poly1305_future *)future)->done);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void poly1305_future_wait(poly1305_future *future)
+{
+  poly1305_service *service = future->service;
+  if (!atomic_load(&future->done)) {
+    pthread_mutex_lock(&service->done_lock);
+    while (!atomic_load(&future->done)) {
+      pthread_cond_wait(&service->done, &service->done_lock);
+    }
+    pthread_mutex_unlock(&service->done_lock);
+  }
+  free(future);
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void poly1305_service_drain(poly1305_service *service)
+{
+  pthread_mutex_lock(&service->done_lock);
+  while (atomic_load(&service->outstanding) > 0) {
+    pthread_cond_wait(&service->done, &service->done_lock);
+  }
+  pthread_mutex_unlock(&service->done_lock);
+}
+
+//======================================================================
+// EOF poly1305_service.c
+//======================================================================
@@ -0,0 +1,108 @@
+//======================================================================
+//
+// poly1305_service.h
+// ------------------
+// In-process MAC service for large numbers of independent messages
+// of any length. A pool of worker threads with one work queue each
+// steal work from each other when idle. Large messages are split
+// into chunks processed in parallel, small ones are taken from the
+// queues in groups and MACed with crypto_poly1305_batch().
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#ifndef POLY1305_SERVICE_H
+#define POLY1305_SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Messages of at least this size are split into chunks of
+// POLY1305_SERVICE_CHUNK bytes, processed by any worker.
+#ifndef POLY1305_SERVICE_SPLIT
+#define POLY1305_SERVICE_SPLIT (256 * 1024)
+#endif
+#ifndef POLY1305_SERVICE_CHUNK
+#define POLY1305_SERVICE_CHUNK (64 * 1024)
+#endif
+
+// Messages up to this size are small. A worker takes up to
+// POLY1305_SERVICE_GROUP small messages from a queue at a time and
+// MACs them as one batch.
+#ifndef POLY1305_SERVICE_SMALL
+#define POLY1305_SERVICE_SMALL 4096
+#endif
+#ifndef POLY1305_SERVICE_GROUP
+#define POLY1305_SERVICE_GROUP 16
+#endif
+
+typedef struct poly1305_service poly1305_service;
+typedef struct poly1305_future  poly1305_future;
+
+// Called by a worker thread when the tag is in mac.
+typedef void (*poly1305_callback)(void *arg, uint8_t mac[16]);
+
+// Create a service with nb_workers threads. Returns NULL on
+// failure. The service can be used from any number of threads.
+poly1305_service *poly1305_service_create(unsigned nb_workers);
+
+// Wait for all submitted messages, then stop the workers.
+void poly1305_service_destroy(poly1305_service *service);
+
+// Submit a message. The tag is written to mac, then callback is
+// called with arg, if not NULL. The message and mac must stay
+// valid until then, the key is copied. Returns 0 on success, -1 if
+// out of memory.
+int poly1305_service_submit(poly1305_service *service, uint8_t mac[16],
+                            const uint8_t *message, size_t message_size,
+                            const uint8_t key[32],
+                            poly1305_callback callback, void *arg);
+
+// Submit a message and get a future for it. Returns NULL if out of
+// memory. Every future must be waited for exactly once.
+poly1305_future *poly1305_service_async(poly1305_service *service,
+                                        uint8_t mac[16],
+                                        const uint8_t *message,
+                                        size_t message_size,
+                                        const uint8_t key[32]);
+
+// 1 if the tag of the future is ready, 0 otherwise.
+int poly1305_future_ready(const poly1305_future *future);
+
+// Wait for the tag and release the future.
+void poly1305_future_wait(poly1305_future *future);
+
+// Wait until every message submitted so far is done.
+void poly1305_service_drain(poly1305_service *service);
+
+#endif // POLY1305_SERVICE_H
+
+//======================================================================
+// EOF poly1305_service.h
+//======================================================================
@@ -0,0 +1,131 @@
+//======================================================================
+//
+// poly1305_trace.c
+// ----------------
+// Binary trace writer, see poly1305_trace.h. Only active in
+// libraries built with POLY1305_TRACE defined, other builds get
+// stubs.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include "poly1305_trace.h"
+
+
+#ifdef POLY1305_TRACE
+// The traced build is single threaded, one trace file at a time.
+static FILE    *trace_file  = NULL;
+static uint32_t block_index = 0;
+static uint32_t mac_index   = 0;
+
+
+static void put_word(uint32_t w)
+{
+  uint8_t b[4] = { (uint8_t)w, (uint8_t)(w >> 8),
+                   (uint8_t)(w >> 16), (uint8_t)(w >> 24) };
+  fwrite(b, 1, 4, trace_file);
+}
+
+
+static void trace_binary_record(int kind, const uint64_t *values,
+                                size_t nb_values)
+{
+  if (trace_file == NULL) {
+    return;
+  }
+  put_word((uint32_t)kind);
+  if (kind == CRYPTO_POLY1305_TRACE_BLOCK) {
+    put_word(block_index++);
+  }
+  else {
+    put_word(mac_index++);
+    block_index = 0;
+  }
+  put_word((uint32_t)nb_values);
+  for (size_t i = 0 ; i < nb_values ; i++) {
+    put_word((uint32_t)values[i]);
+    put_word((uint32_t)(values[i] >> 32));
+  }
+}
+
+
+const crypto_poly1305_trace_hooks poly1305_trace_binary = {
+  NULL,
+  NULL,
+  NULL,
+  trace_binary_record,
+};
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int poly1305_trace_open(const char *path)
+{
+  poly1305_trace_close();
+  trace_file = fopen(path, "wb");
+  if (trace_file == NULL) {
+    return -1;
+  }
+  block_index = 0;
+  mac_index   = 0;
+  put_word(POLY1305_TRACE_MAGIC);
+  put_word(POLY1305_TRACE_VERSION);
+  crypto_poly1305_set_trace_hooks(&poly1305_trace_binary);
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+void poly1305_trace_close(void)
+{
+  if (trace_file != NULL) {
+    fclose(trace_file);
+    trace_file = NULL;
+    crypto_poly1305_set_trace_hooks(&crypto_poly1305_trace_print);
+  }
+}
+
+#else // POLY1305_TRACE
+
+int poly1305_trace_open(const char *path)
+{
+  (void)path;
+  return -1;
+}
+
+void poly1305_trace_close(void)
+{
+}
+
+#endif // POLY1305_TRACE
+
+//======================================================================
+// EOF poly1305_trace.c
+//======================================================================
@@ -0,0 +1,77 @@
+//======================================================================
+//
+// poly1305_trace.h
+// ----------------
+// Binary trace of the intermediate values in the C model, for
+// automated comparison against the RTL. The testbenches of the
+// pblock, final and core modules write the same records when run
+// with +trace=<file>, through src/tb/tb_poly1305_trace.vh, and
+// utils/trace_compare.py reports the first block and value where
+// two traces diverge.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef POLY1305_TRACE_H
+#define POLY1305_TRACE_H
+
+#include "monocypher.h"
+
+// File format. Everything is stored as little endian 32 bit words,
+// 64 bit values as the low word followed by the high word.
+//
+//   header: magic, version
+//   record: kind, index, nb_values, nb_values 64 bit values
+//
+// kind is CRYPTO_POLY1305_TRACE_BLOCK or CRYPTO_POLY1305_TRACE_FINAL
+// from monocypher.h. The index of a block record counts the blocks
+// of the current MAC from 0, the index of a final record counts
+// the MACs in the file from 0.
+#define POLY1305_TRACE_MAGIC   0x54333150 // "P13T"
+#define POLY1305_TRACE_VERSION 1
+
+// Start writing the trace to the file at path, replacing the
+// installed trace hooks. Returns 0 on success, -1 if the file can
+// not be created or the library is not built with POLY1305_TRACE.
+int poly1305_trace_open(const char *path);
+
+// Flush and close the trace file, and reinstall the default
+// crypto_poly1305_trace_print hooks.
+void poly1305_trace_close(void);
+
+#ifdef POLY1305_TRACE
+// The hooks installed by poly1305_trace_open(). Only the record
+// hook is set.
+extern const crypto_poly1305_trace_hooks poly1305_trace_binary;
+#endif
+
+#endif // POLY1305_TRACE_H
+
+//======================================================================
+// EOF poly1305_trace.h
+//======================================================================
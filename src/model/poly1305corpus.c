@@ -0,0 +1,120 @@
+//======================================================================
+//
+// poly1305corpus.c
+// ----------------
+// Command line tool checking the C model against binary test vector
+// corpus files, on all CPUs.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+//======================================================================
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "monocypher.h"
+#include "poly1305_corpus.h"
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s [-j N] CORPUS...\n"
+          "Check the model against every vector of each CORPUS, as\n"
+          "written by utils/extract_vectors.py --corpus.\n"
+          "  -j N  Number of threads, default all CPUs.\n",
+          name);
+}
+
+
+//------------------------------------------------------------------
+// main()
+//------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  long nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int  opt;
+
+  while ((opt = getopt(argc, argv, "j:h")) != -1) {
+    switch (opt) {
+    case 'j':
+      nb_threads = atol(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (optind == argc || nb_threads < 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  int status = 0;
+  for (int i = optind ; i < argc ; i++) {
+    double start = now();
+    poly1305_corpus *corpus = poly1305_corpus_open(argv[i]);
+    if (!corpus) {
+      fprintf(stderr, "%s: %s: %s\n", argv[0], argv[i], strerror(errno));
+      status = 2;
+      continue;
+    }
+
+    size_t first;
+    size_t failures = poly1305_corpus_run(corpus, (unsigned)nb_threads, &first);
+    double elapsed  = now() - start;
+    printf("%s: %zu vectors, %zu failed, %.3f s on %ld threads\n", argv[i],
+           poly1305_corpus_count(corpus), failures, elapsed, nb_threads);
+    if (failures > 0) {
+      printf("%s: first failing vector: %zu\n", argv[i], first);
+      status = status ? status : 1;
+    }
+    poly1305_corpus_close(corpus);
+  }
+  return status;
+}
+
+//======================================================================
+// EOF poly1305corpus.c
+//======================================================================
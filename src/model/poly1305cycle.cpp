@@ -0,0 +1,390 @@
+//======================================================================
+//
+// poly1305cycle.cpp
+// -----------------
+// Command line tool running the cycle accurate model of
+// poly1305_core in poly1305_cycle.hpp. Replays the scenarios of
+// tb_poly1305_core.v, checks random messages and corpus files
+// against the C model, and reports the latency and throughput of
+// the core for the given timing parameters.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+#include "monocypher.h"
+#include "poly1305_corpus.h"
+#include "poly1305_cycle.hpp"
+
+namespace cycle = poly1305::cycle;
+
+
+//------------------------------------------------------------------
+// Scenarios of tb_poly1305_core.v. Keys, blocks and tags are
+// written as the 256 and 128 bit constants in the testbench, first
+// byte first.
+//------------------------------------------------------------------
+struct scenario_block {
+  const char *data;
+  unsigned    len;
+};
+
+struct scenario {
+  const char                  *name;
+  const char                  *key;
+  std::vector<scenario_block>  blocks;
+  const char                  *mac;
+};
+
+static const char *rfc_key =
+  "85d6be78_57556d33_7f4452fe_42d506a8_0103808a_fb0db2fd_4abff6af_4149f51b";
+
+static const std::vector<scenario> scenarios = {
+  {"test_rfc8439", rfc_key,
+   {{"43727970_746f6772_61706869_6320466f", 16},
+    {"72756d20_52657365_61726368_2047726f", 16},
+    {"75700000_00000000_00000000_00000000", 2}},
+   "a8061dc1_305136c6_c22b8baf_0c0127a9"},
+  {"test_p1305_bytes0", rfc_key,
+   {{"00000000_00000000_00000000_00000000", 0}},
+   "0103808a_fb0db2fd_4abff6af_4149f51b"},
+  {"test_p1305_bytes1", rfc_key,
+   {{"31000000_00000000_00000000_00000000", 1}},
+   "8097ddf5_19b7f412_0b57fabf_925a19ac"},
+  {"test_p1305_bytes2", rfc_key,
+   {{"31320000_00000000_00000000_00000000", 2}},
+   "74187253_85d59d55_201792c3_a2ab2ad0"},
+  {"test_p1305_bytes6", rfc_key,
+   {{"31323334_35360000_00000000_00000000", 6}},
+   "c4ef06ab_0fd215f9_cc64736f_70878c0f"},
+  {"test_p1305_bytes9", rfc_key,
+   {{"31323334_35363738_39000000_00000000", 9}},
+   "ba5f904c_5238c997_a4446b82_e97e22d3"},
+  {"test_p1305_bytes12", rfc_key,
+   {{"31323334_35363738_393a3b3c_00000000", 12}},
+   "14932346_2d5cf043_e2be3aa9_a3c94b90"},
+  {"test_p1305_bytes15", rfc_key,
+   {{"31323334_35363738_393a3b3c_3d3e3f00", 15}},
+   "9c222589_184ef089_a06b50be_e4c9c124"},
+  {"test_p1305_bytes16", rfc_key,
+   {{"31323334_35363738_393a3b3c_3d3e3f40", 16}},
+   "3b63c42d_c1da46b4_cc0f9f44_8e6e42ec"},
+  {"test_p1305_bytes32", rfc_key,
+   {{"31323334_35363738_393a3b3c_3d3e3f40", 16},
+    {"41424344_45464748_494a4b4c_4d4e4f50", 16}},
+   "d76301a8_d0b1ef2b_60ca65f7_c565189d"},
+  {"testcase_0",
+   "00000000_00000000_00000000_00000000_00000000_00000000_00000000_00000000",
+   {{"00000000_00000000_00000000_00000000", 0}},
+   "00000000_00000000_00000000_00000000"},
+  {"testcase_1",
+   "36e5f6b5_c5e06070_f0efca96_227a863e_00000000_00000000_00000000_00000000",
+   {{"00000000_00000000_00000000_00000000", 0}},
+   "00000000_00000000_00000000_00000000"},
+  {"testcase_2",
+   "00000000_00000000_00000000_00000000_36e5f6b5_c5e06070_f0efca96_227a863e",
+   {{"00000000_00000000_00000000_00000000", 0}},
+   "36e5f6b5_c5e06070_f0efca96_227a863e"},
+  {"testcase_8",
+   "02000000_00000000_00000000_00000000_00000000_00000000_00000000_00000000",
+   {{"ffffffff_ffffffff_ffffffff_ffffffff", 16}},
+   "03000000_00000000_00000000_00000000"},
+  {"testcase_9",
+   "02000000_00000000_00000000_00000000_ffffffff_ffffffff_ffffffff_ffffffff",
+   {{"02000000_00000000_00000000_00000000", 16}},
+   "03000000_00000000_00000000_00000000"},
+  {"testcase_10",
+   "01000000_00000000_00000000_00000000_00000000_00000000_00000000_00000000",
+   {{"ffffffff_ffffffff_ffffffff_ffffffff", 16},
+    {"f0ffffff_ffffffff_ffffffff_ffffffff", 16},
+    {"11000000_00000000_00000000_00000000", 16}},
+   "05000000_00000000_00000000_00000000"},
+  {"testcase_11",
+   "01000000_00000000_00000000_00000000_00000000_00000000_00000000_00000000",
+   {{"ffffffff_ffffffff_ffffffff_ffffffff", 16},
+    {"fbfefefe_fefefefe_fefefefe_fefefefe", 16},
+    {"01010101_01010101_01010101_01010101", 16}},
+   "00000000_00000000_00000000_00000000"},
+  {"testcase_12",
+   "02000000_00000000_00000000_00000000_00000000_00000000_00000000_00000000",
+   {{"fdffffff_ffffffff_ffffffff_ffffffff", 16}},
+   "faffffff_ffffffff_ffffffff_ffffffff"},
+};
+
+// testcase_long: 64 blocks of all ones and a final block of one byte.
+static scenario testcase_long()
+{
+  scenario s = {"testcase_long",
+                "f3000000_00000000_00000000_0000003f_3f000000_00000000_00000000_000000f3",
+                {}, "dc0964e5_ce9cd7d9_a7571faf_a5dc0473"};
+  for (int i = 0 ; i < 64 ; i++) {
+    s.blocks.push_back({"ffffffff_ffffffff_ffffffff_ffffffff", 16});
+  }
+  s.blocks.push_back({"01000000_00000000_00000000_00000000", 1});
+  return s;
+}
+
+// Bytes of a testbench constant, skipping the underscores.
+static std::vector<std::uint8_t> hex(std::string_view text)
+{
+  std::vector<std::uint8_t> bytes;
+  int nibbles = 0;
+  unsigned byte = 0;
+  for (char ch : text) {
+    if (ch == '_') {
+      continue;
+    }
+    byte = (byte << 4) | (unsigned)(ch <= '9' ? ch - '0' : ch - 'a' + 10);
+    if (++nibbles == 2) {
+      bytes.push_back((std::uint8_t)byte);
+      nibbles = 0;
+      byte    = 0;
+    }
+  }
+  return bytes;
+}
+
+
+//------------------------------------------------------------------
+// run_scenario()
+// Drive the model as the testbench task does, one next() per
+// block, and check the tag against the testbench and the C model.
+//------------------------------------------------------------------
+static int run_scenario(const cycle::timing &t, const scenario &s, bool quiet)
+{
+  cycle::core dut(t);
+  const std::vector<std::uint8_t> key = hex(s.key);
+  std::vector<std::uint8_t> message;
+  cycle::latency lat;
+
+  lat.init  = dut.init(std::span<const std::uint8_t, 32>(key.data(), 32));
+  lat.total = lat.init;
+  for (std::size_t i = 0 ; i < s.blocks.size() ; i++) {
+    const std::vector<std::uint8_t> block = hex(s.blocks[i].data);
+    const std::span<const std::uint8_t> b(block.data(), s.blocks[i].len);
+    const unsigned n = dut.next(b);
+    if (i == 0) {
+      lat.next = n;
+    }
+    lat.total += n;
+    message.insert(message.end(), b.begin(), b.end());
+  }
+  lat.finish = dut.finish();
+  lat.total += lat.finish;
+
+  std::uint8_t model[16];
+  crypto_poly1305(model, message.data(), message.size(),
+                  const_cast<std::uint8_t *>(key.data()));
+  const std::vector<std::uint8_t> expected = hex(s.mac);
+  const auto tag = dut.mac();
+  const bool ok = (std::memcmp(tag.data(), expected.data(), 16) == 0) &&
+                  (std::memcmp(tag.data(), model, 16) == 0);
+
+  if (!quiet || !ok) {
+    std::printf("%s: init %u, next %u, finish %u, total %llu cycles.%s\n",
+                s.name, lat.init, lat.next, lat.finish,
+                (unsigned long long)lat.total, ok ? "" : " Incorrect MAC.");
+  }
+  return ok ? 0 : 1;
+}
+
+
+//------------------------------------------------------------------
+// check_message()
+// MAC of one message on the model against the C model, and the
+// cycles taken against cycle::message_cycles().
+//------------------------------------------------------------------
+static int check_message(cycle::core &dut, const std::uint8_t *message,
+                         std::size_t size, const std::uint8_t key[32],
+                         const std::uint8_t *expected)
+{
+  const std::uint64_t start = dut.cycles();
+  const auto tag = cycle::mac(dut, std::span<const std::uint8_t>(message, size),
+                              std::span<const std::uint8_t, 32>(key, 32));
+  std::uint8_t model[16];
+  if (!expected) {
+    crypto_poly1305(model, const_cast<std::uint8_t *>(message), size,
+                    const_cast<std::uint8_t *>(key));
+    expected = model;
+  }
+  if (dut.cycles() - start != cycle::message_cycles(dut.params(), size)) {
+    return 1;
+  }
+  return std::memcmp(tag.data(), expected, 16) != 0;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static void usage(const char *name)
+{
+  std::fprintf(stderr,
+               "Usage: %s [-a N] [-b N] [-m N] [-f N] [-n N] [-s N] [-z MHZ] [-q]"
+               " [CORPUS...]\n"
+               "Run the cycle accurate model of poly1305_core: the testbench\n"
+               "scenarios, N random messages and every vector of each CORPUS\n"
+               "are checked against the C model.\n"
+               "  -a N    PRE_CYCLES of poly1305_pblock, default 1.\n"
+               "  -b N    POST_CYCLES of poly1305_pblock, default 2.\n"
+               "  -m N    Products per cycle in poly1305_mulacc, 1 to 5, default 1.\n"
+               "  -f N    PIPE_CYCLES of poly1305_final, default 6.\n"
+               "  -n N    Number of random messages, default 100000.\n"
+               "  -s N    Largest random message in bytes, default 1024.\n"
+               "  -z MHZ  Clock frequency for the throughput, default 100.\n"
+               "  -q      Only print failing scenarios.\n",
+               name);
+}
+
+
+//------------------------------------------------------------------
+// main()
+//------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  cycle::timing t;
+  unsigned long nb_random = 100000;
+  std::size_t   max_size  = 1024;
+  double        mhz       = 100.0;
+  bool          quiet     = false;
+  int           opt;
+
+  while ((opt = getopt(argc, argv, "a:b:m:f:n:s:z:qh")) != -1) {
+    switch (opt) {
+    case 'a': t.pre_cycles      = (unsigned)std::atoi(optarg); break;
+    case 'b': t.post_cycles     = (unsigned)std::atoi(optarg); break;
+    case 'm': t.mulacc_products = (unsigned)std::atoi(optarg); break;
+    case 'f': t.pipe_cycles     = (unsigned)std::atoi(optarg); break;
+    case 'n': nb_random         = std::strtoul(optarg, nullptr, 0); break;
+    case 's': max_size          = std::strtoul(optarg, nullptr, 0); break;
+    case 'z': mhz               = std::atof(optarg); break;
+    case 'q': quiet             = true; break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!cycle::valid(t) || mhz <= 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  int failures = 0;
+  std::printf("Timing: PRE_CYCLES %u, POST_CYCLES %u, %u mulacc product%s per cycle,"
+              " PIPE_CYCLES %u\n", t.pre_cycles, t.post_cycles, t.mulacc_products,
+              t.mulacc_products == 1 ? "" : "s", t.pipe_cycles);
+  std::printf("Latency: init %u, next %u, finish %u cycles\n",
+              cycle::init_latency(t), cycle::next_latency(t),
+              cycle::finish_latency(t));
+
+  // Sustained rate of long messages, and the rate of short ones
+  // including init and finish.
+  const double bytes_per_cycle = 16.0 / cycle::next_latency(t);
+  std::printf("Sustained: %.3f bytes/cycle, %.1f Mbit/s at %.0f MHz\n",
+              bytes_per_cycle, bytes_per_cycle * 8 * mhz, mhz);
+  for (std::size_t size : {16, 64, 256, 1024, 1500, 9000}) {
+    const std::uint64_t c = cycle::message_cycles(t, size);
+    std::printf("  %5zu bytes: %6llu cycles, %.1f Mbit/s\n", size,
+                (unsigned long long)c, (double)size * 8 * mhz / (double)c);
+  }
+  std::printf("\n");
+
+  // The testbench scenarios.
+  int scenario_failures = 0;
+  for (const scenario &s : scenarios) {
+    scenario_failures += run_scenario(t, s, quiet);
+  }
+  scenario_failures += run_scenario(t, testcase_long(), quiet);
+  std::printf("Scenarios: %zu, %d failed.\n\n", scenarios.size() + 1,
+              scenario_failures);
+  failures += scenario_failures;
+
+  // Random messages and keys, sizes uniform in 0..max_size.
+  {
+    std::mt19937_64 rng(1305);
+    std::vector<std::uint8_t> message(max_size);
+    std::uint8_t key[32];
+    cycle::core dut(t);
+    unsigned long random_failures = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0 ; i < nb_random ; i++) {
+      const std::size_t size = rng() % (max_size + 1);
+      for (std::size_t j = 0 ; j < size ; j++) {
+        message[j] = (std::uint8_t)rng();
+      }
+      for (int j = 0 ; j < 32 ; j++) {
+        key[j] = (std::uint8_t)rng();
+      }
+      random_failures += check_message(dut, message.data(), size, key, nullptr);
+    }
+    const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    std::printf("Random: %lu messages, %lu failed, %llu cycles in %.3f s,"
+                " %.1f Mcycles/s\n", nb_random, random_failures,
+                (unsigned long long)dut.cycles(), elapsed.count(),
+                (double)dut.cycles() / elapsed.count() * 1e-6);
+    failures += random_failures > 0;
+  }
+
+  // Corpus files.
+  for (int i = optind ; i < argc ; i++) {
+    poly1305_corpus *corpus = poly1305_corpus_open(argv[i]);
+    if (!corpus) {
+      std::fprintf(stderr, "%s: %s: %s\n", argv[0], argv[i], std::strerror(errno));
+      return 2;
+    }
+    cycle::core dut(t);
+    std::size_t corpus_failures = 0;
+    const std::size_t count = poly1305_corpus_count(corpus);
+    for (std::size_t j = 0 ; j < count ; j++) {
+      poly1305_vector v;
+      poly1305_corpus_get(corpus, j, &v);
+      corpus_failures += check_message(dut, v.message, v.message_size,
+                                       v.key, v.tag);
+    }
+    std::printf("%s: %zu vectors, %zu failed, %llu cycles\n", argv[i], count,
+                corpus_failures, (unsigned long long)dut.cycles());
+    failures += corpus_failures > 0;
+    poly1305_corpus_close(corpus);
+  }
+
+  return failures ? 1 : 0;
+}
+
+//======================================================================
+// EOF poly1305cycle.cpp
+//======================================================================
@@ -0,0 +1,416 @@
+//======================================================================
+//
+// poly1305sum.c
+// -------------
+// Command line tool computing the Poly1305 MAC of files, or of
+// standard input, using the C model.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#include <stdio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "monocypher.h"
+#include "poly1305_checkpoint.h"
+
+
+// Size of each of the two stdin buffers.
+#define STDIN_BUFFER_SIZE (1024 * 1024)
+
+
+//------------------------------------------------------------------
+// Double buffered reader. The reader thread fills one buffer while
+// the main thread MACs the other one.
+//------------------------------------------------------------------
+typedef struct {
+  uint8_t *data;
+  size_t   size;
+  int      full;  // filled by the reader, not yet consumed
+  int      last;  // end of input (or error) after this buffer
+} stdin_buffer;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t  changed;
+  stdin_buffer    buffers[2];
+  int             fd;
+  int             error;
+} stdin_reader;
+
+
+//------------------------------------------------------------------
+// reader_thread()
+//------------------------------------------------------------------
+static void *reader_thread(void *arg)
+{
+  stdin_reader *reader = arg;
+  int last = 0;
+
+  for (int i = 0 ; !last ; i ^= 1) {
+    stdin_buffer *buffer = &reader->buffers[i];
+
+    pthread_mutex_lock(&reader->lock);
+    while (buffer->full) {
+      pthread_cond_wait(&reader->changed, &reader->lock);
+    }
+    pthread_mutex_unlock(&reader->lock);
+
+    size_t size = 0;
+    while (size < STDIN_BUFFER_SIZE) {
+      ssize_t n = read(reader->fd, buffer->data + size,
+                       STDIN_BUFFER_SIZE - size);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        last = 1;
+        if (n < 0) {
+          reader->error = errno;
+        }
+        break;
+      }
+      size += (size_t)n;
+    }
+
+    pthread_mutex_lock(&reader->lock);
+    buffer->size = size;
+    buffer->last = last;
+    buffer->full = 1;
+    pthread_cond_signal(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+  }
+  return NULL;
+}
+
+
+//------------------------------------------------------------------
+// mac_stream()
+// MAC everything read from fd. Returns 0 on success.
+//------------------------------------------------------------------
+static int mac_stream(int fd, uint8_t key[32], uint8_t mac[16],
+                      uint64_t *total)
+{
+  stdin_reader reader;
+  pthread_t thread;
+  crypto_poly1305_ctx ctx;
+
+  memset(&reader, 0, sizeof(reader));
+  reader.fd = fd;
+  reader.buffers[0].data = malloc(STDIN_BUFFER_SIZE);
+  reader.buffers[1].data = malloc(STDIN_BUFFER_SIZE);
+  if (!reader.buffers[0].data || !reader.buffers[1].data) {
+    free(reader.buffers[0].data);
+    free(reader.buffers[1].data);
+    return -1;
+  }
+  pthread_mutex_init(&reader.lock, NULL);
+  pthread_cond_init(&reader.changed, NULL);
+
+  if (pthread_create(&thread, NULL, reader_thread, &reader) != 0) {
+    free(reader.buffers[0].data);
+    free(reader.buffers[1].data);
+    return -1;
+  }
+
+  crypto_poly1305_init(&ctx, key);
+  *total = 0;
+
+  int last = 0;
+  for (int i = 0 ; !last ; i ^= 1) {
+    stdin_buffer *buffer = &reader.buffers[i];
+
+    pthread_mutex_lock(&reader.lock);
+    while (!buffer->full) {
+      pthread_cond_wait(&reader.changed, &reader.lock);
+    }
+    pthread_mutex_unlock(&reader.lock);
+
+    crypto_poly1305_update(&ctx, buffer->data, buffer->size);
+    *total += buffer->size;
+    last = buffer->last;
+
+    pthread_mutex_lock(&reader.lock);
+    buffer->full = 0;
+    pthread_cond_signal(&reader.changed);
+    pthread_mutex_unlock(&reader.lock);
+  }
+
+  pthread_join(thread, NULL);
+  crypto_poly1305_final(&ctx, mac);
+
+  pthread_cond_destroy(&reader.changed);
+  pthread_mutex_destroy(&reader.lock);
+  free(reader.buffers[0].data);
+  free(reader.buffers[1].data);
+
+  if (reader.error) {
+    errno = reader.error;
+    return -1;
+  }
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// mac_file()
+// MAC a regular file through a read only mapping. Other kinds of
+// files (pipes, devices) are read as a stream. Returns 0 on success.
+//------------------------------------------------------------------
+static int mac_file(const char *name, uint8_t key[32], uint8_t mac[16],
+                    uint64_t *total)
+{
+  int fd = open(name, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  if (!S_ISREG(st.st_mode)) {
+    int res = mac_stream(fd, key, mac, total);
+    close(fd);
+    return res;
+  }
+
+  size_t size = (size_t)st.st_size;
+  uint8_t *data = NULL;
+  if (size > 0) {
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+  }
+
+  crypto_poly1305_ctx ctx;
+  crypto_poly1305_init(&ctx, key);
+  crypto_poly1305_update(&ctx, data, size);
+  crypto_poly1305_final(&ctx, mac);
+  *total = size;
+
+  if (data) {
+    munmap(data, size);
+  }
+  close(fd);
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// parse_key()
+// Parse 64 hex digits. Returns 0 on success.
+//------------------------------------------------------------------
+static int parse_key(const char *hex, uint8_t key[32])
+{
+  if (strlen(hex) != 64) {
+    return -1;
+  }
+  for (int i = 0 ; i < 32 ; i++) {
+    unsigned int byte;
+    if (sscanf(&hex[i * 2], "%2x", &byte) != 1) {
+      return -1;
+    }
+    key[i] = (uint8_t)byte;
+  }
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// read_key_file()
+// Read a raw 32 byte key. Returns 0 on success.
+//------------------------------------------------------------------
+static int read_key_file(const char *name, uint8_t key[32])
+{
+  FILE *f = fopen(name, "rb");
+  if (!f) {
+    return -1;
+  }
+  size_t n = fread(key, 1, 32, f);
+  fclose(f);
+  return n == 32 ? 0 : -1;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s (-k HEXKEY | -K KEYFILE) [-c] [-v] [FILE...]\n"
+          "MAC each FILE with Poly1305. With no FILE, or when FILE\n"
+          "is -, read standard input.\n"
+          "  -k HEXKEY   32 byte one-time key as 64 hex digits.\n"
+          "  -K KEYFILE  File holding the raw 32 byte key.\n"
+          "  -c          Resume from and update a checkpoint index next to\n"
+          "              each FILE, to only MAC data appended since.\n"
+          "  -v          Report size, time and throughput on stderr.\n",
+          name);
+}
+
+
+//------------------------------------------------------------------
+// main()
+//------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  uint8_t key[32];
+  int have_key = 0;
+  int resume   = 0;
+  int verbose  = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "k:K:cvh")) != -1) {
+    switch (opt) {
+    case 'k':
+      if (parse_key(optarg, key) != 0) {
+        fprintf(stderr, "%s: the key must be 64 hex digits.\n", argv[0]);
+        return 2;
+      }
+      have_key = 1;
+      break;
+    case 'K':
+      if (read_key_file(optarg, key) != 0) {
+        fprintf(stderr, "%s: could not read 32 bytes from %s.\n",
+                argv[0], optarg);
+        return 2;
+      }
+      have_key = 1;
+      break;
+    case 'c':
+      resume = 1;
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (!have_key) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  char *stdin_name = "-";
+  char **files = &argv[optind];
+  int nb_files = argc - optind;
+  if (nb_files == 0) {
+    files = &stdin_name;
+    nb_files = 1;
+  }
+
+  int status = 0;
+  uint64_t all_bytes = 0;
+  double all_time = 0.0;
+
+  for (int i = 0 ; i < nb_files ; i++) {
+    uint8_t mac[16];
+    uint64_t bytes = 0;
+    double start = now();
+    int res;
+
+    if (strcmp(files[i], "-") == 0) {
+      res = mac_stream(STDIN_FILENO, key, mac, &bytes);
+    }
+    else if (resume) {
+      // Only the data after the checkpoint resumed from is MACed.
+      uint64_t resumed = 0;
+      struct stat st;
+      res = poly1305_checkpoint_mac(mac, files[i], key, 0, &resumed);
+      if (res == 0 && stat(files[i], &st) == 0) {
+        bytes = (uint64_t)st.st_size - resumed;
+      }
+    }
+    else {
+      res = mac_file(files[i], key, mac, &bytes);
+    }
+    double elapsed = now() - start;
+
+    if (res != 0) {
+      fprintf(stderr, "%s: %s: %s\n", argv[0], files[i], strerror(errno));
+      status = 1;
+      continue;
+    }
+
+    for (int j = 0 ; j < 16 ; j++) {
+      printf("%02x", mac[j]);
+    }
+    printf("  %s\n", files[i]);
+
+    if (verbose) {
+      fflush(stdout);
+      fprintf(stderr, "%s: %llu bytes in %.3f s, %.1f MB/s\n", files[i],
+              (unsigned long long)bytes, elapsed,
+              elapsed > 0.0 ? (double)bytes / elapsed / 1e6 : 0.0);
+    }
+    all_bytes += bytes;
+    all_time  += elapsed;
+  }
+
+  if (verbose && nb_files > 1) {
+    fprintf(stderr, "total: %llu bytes in %.3f s, %.1f MB/s\n",
+            (unsigned long long)all_bytes, all_time,
+            all_time > 0.0 ? (double)all_bytes / all_time / 1e6 : 0.0);
+  }
+
+  crypto_wipe(key, sizeof(key));
+  return status;
+}
+
+//======================================================================
+// EOF poly1305sum.c
+//======================================================================
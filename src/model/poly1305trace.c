@@ -0,0 +1,170 @@
+//======================================================================
+//
+// poly1305trace.c
+// ---------------
+// Command line tool writing the binary trace of the intermediate
+// values of the C model while MACing files, for comparison with
+// traces from the RTL testbenches. See poly1305_trace.h.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "monocypher.h"
+#include "poly1305_trace.h"
+
+
+//------------------------------------------------------------------
+// parse_key()
+// Parse 64 hex digits. Returns 0 on success.
+//------------------------------------------------------------------
+static int parse_key(const char *hex, uint8_t key[32])
+{
+  if (strlen(hex) != 64) {
+    return -1;
+  }
+  for (int i = 0 ; i < 32 ; i++) {
+    unsigned int byte;
+    if (sscanf(&hex[i * 2], "%2x", &byte) != 1) {
+      return -1;
+    }
+    key[i] = (uint8_t)byte;
+  }
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// trace_file()
+// MAC one file, or standard input for "-", and print the tag.
+// Returns 0 on success.
+//------------------------------------------------------------------
+static int trace_file(const char *name, uint8_t key[32])
+{
+  FILE *f = strcmp(name, "-") == 0 ? stdin : fopen(name, "rb");
+  if (f == NULL) {
+    perror(name);
+    return -1;
+  }
+
+  crypto_poly1305_ctx ctx;
+  uint8_t buffer[4096];
+  uint8_t mac[16];
+  size_t  n;
+  crypto_poly1305_init(&ctx, key);
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    crypto_poly1305_update(&ctx, buffer, n);
+  }
+  int error = ferror(f);
+  if (f != stdin) {
+    fclose(f);
+  }
+  crypto_poly1305_final(&ctx, mac);
+  if (error) {
+    fprintf(stderr, "%s: read error\n", name);
+    return -1;
+  }
+
+  for (int i = 0 ; i < 16 ; i++) {
+    printf("%02x", mac[i]);
+  }
+  printf("  %s\n", name);
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s -k HEXKEY -o TRACE [FILE...]\n"
+          "MAC each FILE with the traced model and write the block and\n"
+          "final step intermediates to TRACE. With no FILE, or when\n"
+          "FILE is -, read standard input.\n"
+          "  -k HEXKEY   32 byte one-time key as 64 hex digits.\n"
+          "  -o TRACE    Binary trace file to write.\n",
+          name);
+}
+
+
+//------------------------------------------------------------------
+// main()
+//------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  uint8_t     key[32];
+  int         have_key = 0;
+  const char *output   = NULL;
+  int         opt;
+
+  while ((opt = getopt(argc, argv, "k:o:h")) != -1) {
+    switch (opt) {
+    case 'k':
+      if (parse_key(optarg, key) != 0) {
+        fprintf(stderr, "%s: the key must be 64 hex digits.\n", argv[0]);
+        return 2;
+      }
+      have_key = 1;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!have_key || output == NULL) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if (poly1305_trace_open(output) != 0) {
+    fprintf(stderr, "%s: cannot write %s\n", argv[0], output);
+    return 1;
+  }
+
+  int status = 0;
+  if (optind == argc) {
+    status |= trace_file("-", key);
+  }
+  for (int i = optind ; i < argc ; i++) {
+    status |= trace_file(argv[i], key);
+  }
+  poly1305_trace_close();
+  crypto_wipe(key, sizeof(key));
+  return status ? 1 : 0;
+}
+
+//======================================================================
+// EOF poly1305trace.c
+//======================================================================
@@ -0,0 +1,863 @@
+//======================================================================
+//
+// poly1305tree.c
+// --------------
+// Command line tool computing the Poly1305 MAC of every regular
+// file in directory trees, writing a manifest with one tag per file.
+// Files are read with io_uring into a pool of aligned buffers and
+// the buffers are MACed by a pool of worker threads, each buffer as
+// an independent chunk. The chunks of a file are combined by the
+// worker finishing the last one. Without io_uring the files are
+// read with pread().
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "monocypher.h"
+
+
+// Defaults. The buffer size must be a multiple of TREE_ALIGN, which
+// keeps every chunk but the last of a file a multiple of 16 bytes,
+// and allows O_DIRECT reads.
+#define TREE_BUFFER_SIZE (256 * 1024)
+#define TREE_QUEUE_DEPTH 64
+#define TREE_ALIGN       4096
+
+
+//------------------------------------------------------------------
+// A file in the manifest. nb_chunks buffers of the file are read
+// and MACed independently into partials[].
+//------------------------------------------------------------------
+typedef struct {
+  char       *path;
+  uint64_t    size;
+  int         fd;
+  uint32_t    nb_chunks;
+  uint32_t    next_chunk;   // next chunk to read, I/O thread only
+  uint32_t    reading;      // reads in flight, I/O thread only
+  atomic_uint chunks_left;  // chunks not MACed yet
+  atomic_int  error;        // errno of the first failure, 0 if none
+  crypto_poly1305_partial *partials;
+  uint8_t     mac[16];
+} tree_file;
+
+
+//------------------------------------------------------------------
+// A read of one chunk into one of the pooled buffers.
+//------------------------------------------------------------------
+typedef struct tree_read {
+  tree_file        *file;
+  uint32_t          chunk;
+  uint8_t          *buffer;
+  size_t            size;   // bytes in the chunk
+  size_t            done;   // bytes read so far
+  struct iovec      iov;
+  struct tree_read *next;   // in the free list or the work queue
+} tree_read;
+
+
+typedef struct {
+  uint8_t          key[32];
+  tree_file       *files;
+  size_t           nb_files;
+  size_t           max_files;
+  size_t           buffer_size;
+  int              direct;
+  int              walk_error;
+
+  // Buffer pool and work queue, shared with the workers.
+  pthread_mutex_t  lock;
+  pthread_cond_t   work_ready;
+  pthread_cond_t   buffer_free;
+  tree_read       *reads;
+  tree_read       *free_list;
+  tree_read       *work_head;
+  tree_read       *work_tail;
+  int              stop;
+
+  // io_uring, ring_fd < 0 when not available.
+  int                  ring_fd;
+  unsigned             entries;
+  void                *sq_ptr;
+  void                *cq_ptr;
+  size_t               sq_size;
+  size_t               cq_size;
+  struct io_uring_sqe *sqes;
+  size_t               sqes_size;
+  unsigned            *sq_head;
+  unsigned            *sq_tail;
+  unsigned            *sq_array;
+  unsigned             sq_mask;
+  unsigned            *cq_head;
+  unsigned            *cq_tail;
+  unsigned             cq_mask;
+  struct io_uring_cqe *cqes;
+} tree;
+
+
+//------------------------------------------------------------------
+// ring_setup()
+// Set up an io_uring with the raw system calls. Returns 0 on
+// success, -1 if io_uring is not available.
+//------------------------------------------------------------------
+static int ring_setup(tree *t, unsigned entries)
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (fd < 0) {
+    return -1;
+  }
+
+  t->sq_size   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  t->cq_size   = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  t->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  int single   = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single) {
+    t->sq_size = t->cq_size = t->sq_size > t->cq_size ? t->sq_size : t->cq_size;
+  }
+
+  t->sq_ptr = mmap(NULL, t->sq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  t->cq_ptr = single || t->sq_ptr == MAP_FAILED ? t->sq_ptr :
+    mmap(NULL, t->cq_size, PROT_READ | PROT_WRITE,
+         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  t->sqes = mmap(NULL, t->sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (t->sq_ptr == MAP_FAILED || t->cq_ptr == MAP_FAILED ||
+      t->sqes == MAP_FAILED) {
+    if (t->sqes != MAP_FAILED) {
+      munmap(t->sqes, t->sqes_size);
+    }
+    if (!single && t->cq_ptr != MAP_FAILED) {
+      munmap(t->cq_ptr, t->cq_size);
+    }
+    if (t->sq_ptr != MAP_FAILED) {
+      munmap(t->sq_ptr, t->sq_size);
+    }
+    close(fd);
+    return -1;
+  }
+
+  uint8_t *sq = t->sq_ptr;
+  uint8_t *cq = t->cq_ptr;
+  t->sq_head  = (unsigned *)(sq + p.sq_off.head);
+  t->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+  t->sq_array = (unsigned *)(sq + p.sq_off.array);
+  t->sq_mask  = *(unsigned *)(sq + p.sq_off.ring_mask);
+  t->cq_head  = (unsigned *)(cq + p.cq_off.head);
+  t->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+  t->cq_mask  = *(unsigned *)(cq + p.cq_off.ring_mask);
+  t->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  t->entries  = p.sq_entries;
+  t->ring_fd  = fd;
+  return 0;
+}
+
+
+static void ring_free(tree *t)
+{
+  if (t->ring_fd < 0) {
+    return;
+  }
+  munmap(t->sqes, t->sqes_size);
+  if (t->cq_ptr != t->sq_ptr) {
+    munmap(t->cq_ptr, t->cq_size);
+  }
+  munmap(t->sq_ptr, t->sq_size);
+  close(t->ring_fd);
+  t->ring_fd = -1;
+}
+
+
+//------------------------------------------------------------------
+// ring_read()
+// Queue a read of the rest of the chunk. Only called with room in
+// the submission queue.
+//------------------------------------------------------------------
+static void ring_read(tree *t, tree_read *rd, size_t length)
+{
+  unsigned tail  = *t->sq_tail;
+  unsigned index = tail & t->sq_mask;
+  struct io_uring_sqe *sqe = &t->sqes[index];
+
+  rd->iov.iov_base = rd->buffer + rd->done;
+  rd->iov.iov_len  = length;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode    = IORING_OP_READV;
+  sqe->fd        = rd->file->fd;
+  sqe->addr      = (uint64_t)(uintptr_t)&rd->iov;
+  sqe->len       = 1;
+  sqe->off       = (uint64_t)rd->chunk * t->buffer_size + rd->done;
+  sqe->user_data = (uint64_t)(uintptr_t)rd;
+  t->sq_array[index] = index;
+  __atomic_store_n(t->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+//------------------------------------------------------------------
+// ring_enter()
+// Submit the queued reads and wait for at least min_complete
+// completions. Returns 0 on success.
+//------------------------------------------------------------------
+static int ring_enter(tree *t, unsigned min_complete)
+{
+  for (;;) {
+    unsigned pending = *t->sq_tail -
+                       __atomic_load_n(t->sq_head, __ATOMIC_ACQUIRE);
+    long res = syscall(__NR_io_uring_enter, t->ring_fd, pending,
+                       min_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (res >= 0) {
+      return 0;
+    }
+    if (errno != EINTR && errno != EAGAIN) {
+      return -1;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------
+// Buffer pool. buffer_get() blocks for a free buffer if wait is
+// set, and returns NULL otherwise.
+//------------------------------------------------------------------
+static tree_read *buffer_get(tree *t, int wait)
+{
+  pthread_mutex_lock(&t->lock);
+  while (t->free_list == NULL && wait) {
+    pthread_cond_wait(&t->buffer_free, &t->lock);
+  }
+  tree_read *rd = t->free_list;
+  if (rd != NULL) {
+    t->free_list = rd->next;
+  }
+  pthread_mutex_unlock(&t->lock);
+  return rd;
+}
+
+static void buffer_put(tree *t, tree_read *rd)
+{
+  pthread_mutex_lock(&t->lock);
+  rd->next     = t->free_list;
+  t->free_list = rd;
+  pthread_cond_signal(&t->buffer_free);
+  pthread_mutex_unlock(&t->lock);
+}
+
+
+//------------------------------------------------------------------
+// chunks_done()
+// Account for n chunks of the file. The thread accounting for the
+// last chunk combines the partials into the tag.
+//------------------------------------------------------------------
+static void chunks_done(tree *t, tree_file *f, uint32_t n)
+{
+  if (n == 0 || atomic_fetch_sub(&f->chunks_left, n) != n) {
+    return;
+  }
+  if (atomic_load(&f->error) == 0) {
+    for (uint32_t i = 1 ; i < f->nb_chunks ; i++) {
+      crypto_poly1305_combine(&f->partials[0], &f->partials[i], t->key);
+    }
+    crypto_poly1305_partial_final(f->mac, &f->partials[0], t->key);
+  }
+  crypto_wipe(f->partials, f->nb_chunks * sizeof(crypto_poly1305_partial));
+  free(f->partials);
+  f->partials = NULL;
+}
+
+
+//------------------------------------------------------------------
+// file_fail()
+// Record the error and give up on the chunks not read yet.
+//------------------------------------------------------------------
+static void file_fail(tree *t, tree_file *f, int error)
+{
+  int expected = 0;
+  atomic_compare_exchange_strong(&f->error, &expected, error);
+  uint32_t left = f->nb_chunks - f->next_chunk;
+  f->next_chunk = f->nb_chunks;
+  chunks_done(t, f, left);
+}
+
+
+//------------------------------------------------------------------
+// tree_worker()
+// MAC the chunks in the work queue.
+//------------------------------------------------------------------
+static void *tree_worker(void *arg)
+{
+  tree *t = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&t->lock);
+    while (t->work_head == NULL && !t->stop) {
+      pthread_cond_wait(&t->work_ready, &t->lock);
+    }
+    tree_read *rd = t->work_head;
+    if (rd == NULL) {
+      pthread_mutex_unlock(&t->lock);
+      return NULL;
+    }
+    t->work_head = rd->next;
+    if (t->work_head == NULL) {
+      t->work_tail = NULL;
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    tree_file *f = rd->file;
+    if (atomic_load(&f->error) == 0) {
+      crypto_poly1305_chunk(&f->partials[rd->chunk], t->key,
+                            rd->buffer, rd->size);
+    }
+    buffer_put(t, rd);
+    chunks_done(t, f, 1);
+  }
+}
+
+
+static void work_push(tree *t, tree_read *rd)
+{
+  rd->next = NULL;
+  pthread_mutex_lock(&t->lock);
+  if (t->work_tail != NULL) {
+    t->work_tail->next = rd;
+  }
+  else {
+    t->work_head = rd;
+  }
+  t->work_tail = rd;
+  pthread_cond_signal(&t->work_ready);
+  pthread_mutex_unlock(&t->lock);
+}
+
+
+//------------------------------------------------------------------
+// file_open()
+// Open the file and allocate its partials. Returns 0 on success.
+//------------------------------------------------------------------
+static int file_open(tree *t, tree_file *f)
+{
+  int flags = O_RDONLY | O_CLOEXEC;
+  f->fd = -1;
+  if (t->direct) {
+    f->fd = open(f->path, flags | O_DIRECT);
+  }
+  if (f->fd < 0) {
+    f->fd = open(f->path, flags);
+  }
+  if (f->fd < 0) {
+    return -1;
+  }
+  f->partials = calloc(f->nb_chunks, sizeof(crypto_poly1305_partial));
+  if (f->partials == NULL) {
+    close(f->fd);
+    f->fd = -1;
+    errno = ENOMEM;
+    return -1;
+  }
+  return 0;
+}
+
+
+static void file_close_if_done(tree_file *f)
+{
+  if (f->fd >= 0 && f->reading == 0 && f->next_chunk == f->nb_chunks) {
+    close(f->fd);
+    f->fd = -1;
+  }
+}
+
+
+//------------------------------------------------------------------
+// read_length()
+// Bytes to request for the rest of a chunk. O_DIRECT reads must be
+// a multiple of the block size, the end of the file is found by
+// the short read.
+//------------------------------------------------------------------
+static size_t read_length(const tree *t, const tree_read *rd)
+{
+  size_t length = rd->size - rd->done;
+  if (t->direct) {
+    length = (length + TREE_ALIGN - 1) & ~(size_t)(TREE_ALIGN - 1);
+  }
+  return length;
+}
+
+
+//------------------------------------------------------------------
+// read_done()
+// Handle the result of a read. Returns 1 if the rest of the chunk
+// must be read, 0 when the read is finished.
+//------------------------------------------------------------------
+static int read_done(tree *t, tree_read *rd, long res)
+{
+  tree_file *f = rd->file;
+
+  if (res > 0) {
+    size_t left = rd->size - rd->done;
+    rd->done += (size_t)res < left ? (size_t)res : left;
+    if (rd->done < rd->size) {
+      return 1;
+    }
+  }
+
+  f->reading--;
+  if (res <= 0) {
+    // An error, or the file shrank while reading it.
+    file_fail(t, f, res < 0 ? (int)-res : EIO);
+    buffer_put(t, rd);
+    chunks_done(t, f, 1);
+  }
+  else {
+    work_push(t, rd);
+  }
+  file_close_if_done(f);
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// next_read()
+// The next chunk to read, in a buffer from the pool, or NULL if
+// there is none or no buffer (and wait is not set). *index is the
+// first file that may have chunks left.
+//------------------------------------------------------------------
+static tree_read *next_read(tree *t, size_t *index, int wait)
+{
+  while (*index < t->nb_files) {
+    tree_file *f = &t->files[*index];
+    if (f->next_chunk == f->nb_chunks) {
+      (*index)++;
+      continue;
+    }
+
+    tree_read *rd = buffer_get(t, wait);
+    if (rd == NULL) {
+      return NULL;
+    }
+    if (f->fd < 0 && file_open(t, f) != 0) {
+      buffer_put(t, rd);
+      file_fail(t, f, errno);
+      continue;
+    }
+
+    uint64_t offset = (uint64_t)f->next_chunk * t->buffer_size;
+    rd->file  = f;
+    rd->chunk = f->next_chunk++;
+    rd->size  = f->size - offset < t->buffer_size ?
+                (size_t)(f->size - offset) : t->buffer_size;
+    rd->done  = 0;
+    f->reading++;
+    return rd;
+  }
+  return NULL;
+}
+
+
+//------------------------------------------------------------------
+// read_all_ring()
+// Keep the ring full of reads until every chunk has been read.
+//------------------------------------------------------------------
+static int read_all_ring(tree *t)
+{
+  size_t   index    = 0;
+  unsigned inflight = 0;
+
+  for (;;) {
+    tree_read *rd;
+    while (inflight < t->entries &&
+           (rd = next_read(t, &index, inflight == 0)) != NULL) {
+      ring_read(t, rd, read_length(t, rd));
+      inflight++;
+    }
+    if (inflight == 0) {
+      return 0;
+    }
+
+    if (ring_enter(t, 1) != 0) {
+      return -1;
+    }
+
+    unsigned head = *t->cq_head;
+    while (head != __atomic_load_n(t->cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = &t->cqes[head & t->cq_mask];
+      rd = (tree_read *)(uintptr_t)cqe->user_data;
+      long res = cqe->res;
+      head++;
+      __atomic_store_n(t->cq_head, head, __ATOMIC_RELEASE);
+
+      inflight--;
+      if (read_done(t, rd, res)) {
+        ring_read(t, rd, read_length(t, rd));
+        inflight++;
+      }
+    }
+  }
+}
+
+
+//------------------------------------------------------------------
+// read_all_pread()
+// Fallback without io_uring, one read at a time.
+//------------------------------------------------------------------
+static int read_all_pread(tree *t)
+{
+  size_t index = 0;
+  tree_read *rd;
+
+  while ((rd = next_read(t, &index, 1)) != NULL) {
+    long res;
+    do {
+      uint64_t offset = (uint64_t)rd->chunk * t->buffer_size + rd->done;
+      res = pread(rd->file->fd, rd->buffer + rd->done,
+                  read_length(t, rd), (off_t)offset);
+      if (res < 0) {
+        res = -errno;
+      }
+    } while (res == -EINTR || read_done(t, rd, res));
+  }
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// File tree walk. nftw() has no user argument.
+//------------------------------------------------------------------
+static tree *walk_tree;
+
+static int walk_entry(const char *path, const struct stat *st,
+                      int type, struct FTW *ftw)
+{
+  (void)ftw;
+  tree *t = walk_tree;
+
+  if (type == FTW_NS || type == FTW_DNR) {
+    fprintf(stderr, "poly1305tree: %s: cannot read\n", path);
+    t->walk_error = 1;
+    return 0;
+  }
+  if (type != FTW_F || !S_ISREG(st->st_mode)) {
+    return 0;
+  }
+
+  if (t->nb_files == t->max_files) {
+    size_t max = t->max_files ? t->max_files * 2 : 1024;
+    tree_file *files = realloc(t->files, max * sizeof(tree_file));
+    if (files == NULL) {
+      return -1;
+    }
+    t->files     = files;
+    t->max_files = max;
+  }
+
+  tree_file *f = &t->files[t->nb_files];
+  memset(f, 0, sizeof(*f));
+  f->path = strdup(path);
+  if (f->path == NULL) {
+    return -1;
+  }
+  f->size      = (uint64_t)st->st_size;
+  f->fd        = -1;
+  f->nb_chunks = (uint32_t)((f->size + t->buffer_size - 1) / t->buffer_size);
+  atomic_init(&f->chunks_left, f->nb_chunks);
+  atomic_init(&f->error, 0);
+  t->nb_files++;
+  return 0;
+}
+
+
+static int cmp_path(const void *a, const void *b)
+{
+  return strcmp(((const tree_file *)a)->path, ((const tree_file *)b)->path);
+}
+
+
+//------------------------------------------------------------------
+// parse_key()
+// Parse 64 hex digits. Returns 0 on success.
+//------------------------------------------------------------------
+static int parse_key(const char *hex, uint8_t key[32])
+{
+  if (strlen(hex) != 64) {
+    return -1;
+  }
+  for (int i = 0 ; i < 32 ; i++) {
+    unsigned int byte;
+    if (sscanf(&hex[i * 2], "%2x", &byte) != 1) {
+      return -1;
+    }
+    key[i] = (uint8_t)byte;
+  }
+  return 0;
+}
+
+
+//------------------------------------------------------------------
+// read_key_file()
+// Read a raw 32 byte key. Returns 0 on success.
+//------------------------------------------------------------------
+static int read_key_file(const char *name, uint8_t key[32])
+{
+  FILE *f = fopen(name, "rb");
+  if (!f) {
+    return -1;
+  }
+  size_t n = fread(key, 1, 32, f);
+  fclose(f);
+  return n == 32 ? 0 : -1;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s (-k HEXKEY | -K KEYFILE) [options] DIR...\n"
+          "MAC every regular file under each DIR with Poly1305 and\n"
+          "write a manifest with one tag per file, in path order.\n"
+          "  -k HEXKEY   32 byte one-time key as 64 hex digits.\n"
+          "  -K KEYFILE  File holding the raw 32 byte key.\n"
+          "  -o FILE     Write the manifest to FILE, not stdout.\n"
+          "  -j N        Number of worker threads, default all CPUs.\n"
+          "  -q N        Reads in flight, default %d.\n"
+          "  -b KB       Buffer size in kB, multiple of 4, default %d.\n"
+          "  -d          Read with O_DIRECT, bypassing the page cache.\n"
+          "  -p          Read with pread() even if io_uring is available.\n"
+          "  -v          Report files, bytes and GB/s on stderr.\n",
+          name, TREE_QUEUE_DEPTH, TREE_BUFFER_SIZE / 1024);
+}
+
+
+//------------------------------------------------------------------
+// main()
+//------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  tree        t;
+  const char *output      = NULL;
+  long        nb_threads  = sysconf(_SC_NPROCESSORS_ONLN);
+  long        queue_depth = TREE_QUEUE_DEPTH;
+  long        buffer_kb   = TREE_BUFFER_SIZE / 1024;
+  int         have_key    = 0;
+  int         use_pread   = 0;
+  int         verbose     = 0;
+  int         opt;
+
+  memset(&t, 0, sizeof(t));
+  t.ring_fd = -1;
+
+  while ((opt = getopt(argc, argv, "k:K:o:j:q:b:dpvh")) != -1) {
+    switch (opt) {
+    case 'k':
+      if (parse_key(optarg, t.key) != 0) {
+        fprintf(stderr, "%s: the key must be 64 hex digits.\n", argv[0]);
+        return 2;
+      }
+      have_key = 1;
+      break;
+    case 'K':
+      if (read_key_file(optarg, t.key) != 0) {
+        fprintf(stderr, "%s: could not read 32 bytes from %s.\n",
+                argv[0], optarg);
+        return 2;
+      }
+      have_key = 1;
+      break;
+    case 'o': output      = optarg;       break;
+    case 'j': nb_threads  = atol(optarg); break;
+    case 'q': queue_depth = atol(optarg); break;
+    case 'b': buffer_kb   = atol(optarg); break;
+    case 'd': t.direct    = 1;            break;
+    case 'p': use_pread   = 1;            break;
+    case 'v': verbose     = 1;            break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (!have_key || optind == argc || nb_threads < 1 || queue_depth < 1 ||
+      queue_depth > 4096 || buffer_kb < 4 || buffer_kb % 4 != 0 ||
+      buffer_kb > 1024 * 1024) {
+    usage(argv[0]);
+    return 2;
+  }
+  t.buffer_size = (size_t)buffer_kb * 1024;
+
+  FILE *manifest = stdout;
+  if (output != NULL && (manifest = fopen(output, "w")) == NULL) {
+    fprintf(stderr, "%s: %s: %s\n", argv[0], output, strerror(errno));
+    return 1;
+  }
+
+  // Walk the trees.
+  double start = now();
+  walk_tree = &t;
+  for (int i = optind ; i < argc ; i++) {
+    if (nftw(argv[i], walk_entry, 64, FTW_PHYS) != 0) {
+      fprintf(stderr, "%s: %s: %s\n", argv[0], argv[i], strerror(errno));
+      t.walk_error = 1;
+    }
+  }
+  if (t.nb_files > 0) {
+    qsort(t.files, t.nb_files, sizeof(tree_file), cmp_path);
+  }
+
+  // Reads in flight, then buffers for them and for the workers.
+  if (!use_pread) {
+    ring_setup(&t, (unsigned)queue_depth);
+  }
+  size_t nb_buffers = (t.ring_fd >= 0 ? t.entries : 1) + 2 * (size_t)nb_threads;
+  t.reads = calloc(nb_buffers, sizeof(tree_read));
+  if (t.reads == NULL) {
+    fprintf(stderr, "%s: out of memory\n", argv[0]);
+    return 1;
+  }
+  for (size_t i = 0 ; i < nb_buffers ; i++) {
+    if (posix_memalign((void **)&t.reads[i].buffer, TREE_ALIGN,
+                       t.buffer_size) != 0) {
+      fprintf(stderr, "%s: out of memory\n", argv[0]);
+      return 1;
+    }
+    t.reads[i].next = t.free_list;
+    t.free_list     = &t.reads[i];
+  }
+
+  pthread_mutex_init(&t.lock, NULL);
+  pthread_cond_init(&t.work_ready, NULL);
+  pthread_cond_init(&t.buffer_free, NULL);
+  pthread_t *threads = calloc((size_t)nb_threads, sizeof(pthread_t));
+  long started = 0;
+  while (threads != NULL && started < nb_threads &&
+         pthread_create(&threads[started], NULL, tree_worker, &t) == 0) {
+    started++;
+  }
+  if (started == 0) {
+    fprintf(stderr, "%s: could not start the workers\n", argv[0]);
+    return 1;
+  }
+
+  int res = t.ring_fd >= 0 ? read_all_ring(&t) : read_all_pread(&t);
+  if (res != 0) {
+    fprintf(stderr, "%s: io_uring: %s\n", argv[0], strerror(errno));
+  }
+
+  pthread_mutex_lock(&t.lock);
+  t.stop = 1;
+  pthread_cond_broadcast(&t.work_ready);
+  pthread_mutex_unlock(&t.lock);
+  for (long i = 0 ; i < started ; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double elapsed = now() - start;
+
+  // Empty files have no chunks, their tag is the tag of nothing.
+  uint8_t  empty_mac[16];
+  uint8_t  nothing[1] = {0};
+  uint64_t bytes  = 0;
+  int      status = t.walk_error || res != 0;
+  crypto_poly1305(empty_mac, nothing, 0, t.key);
+
+  for (size_t i = 0 ; i < t.nb_files ; i++) {
+    tree_file *f = &t.files[i];
+    int error = atomic_load(&f->error);
+    if (error == 0 && res != 0 && f->nb_chunks > 0 &&
+        atomic_load(&f->chunks_left) != 0) {
+      error = EIO;
+    }
+    if (error != 0) {
+      fprintf(stderr, "%s: %s: %s\n", argv[0], f->path, strerror(error));
+      status = 1;
+    }
+    else {
+      const uint8_t *mac = f->nb_chunks ? f->mac : empty_mac;
+      for (int j = 0 ; j < 16 ; j++) {
+        fprintf(manifest, "%02x", mac[j]);
+      }
+      fprintf(manifest, "  %s\n", f->path);
+      bytes += f->size;
+    }
+    free(f->path);
+  }
+  if (manifest != stdout) {
+    fclose(manifest);
+  }
+
+  if (verbose) {
+    fflush(stdout);
+    fprintf(stderr, "%zu files, %llu bytes in %.3f s, %.3f GB/s, "
+            "%ld workers, %s\n",
+            t.nb_files, (unsigned long long)bytes, elapsed,
+            elapsed > 0.0 ? (double)bytes / elapsed / 1e9 : 0.0, started,
+            t.ring_fd >= 0 ? "io_uring" : "pread");
+  }
+
+  ring_free(&t);
+  for (size_t i = 0 ; i < nb_buffers ; i++) {
+    free(t.reads[i].buffer);
+  }
+  free(t.reads);
+  free(t.files);
+  free(threads);
+  crypto_wipe(t.key, sizeof(t.key));
+  return status;
+}
+
+//======================================================================
+// EOF poly1305tree.c
+//======================================================================
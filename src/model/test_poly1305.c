@@ -35,7 +35,26 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "monocypher.h"
+#include "poly1305_checkpoint.h"
+#include "poly1305_corpus.h"
+#include "poly1305_flow.h"
+#include "poly1305_parallel.h"
+#include "poly1305_service.h"
+#include "poly1305_trace.h"
+
+
+// The tests with large messages would produce hundreds of MB of
+// output in the traced build. Tracing is turned off for them.
+#ifdef POLY1305_TRACE
+#define TRACE_OFF() crypto_poly1305_set_trace_hooks(NULL)
+#define TRACE_ON()  crypto_poly1305_set_trace_hooks(&crypto_poly1305_trace_print)
+#else
+#define TRACE_OFF()
+#define TRACE_ON()
+#endif
 
 
 //------------------------------------------------------------------
@@ -1235,6 +1254,1230 @@ int testcase_long() {
 
 
 
+//------------------------------------------------------------------
+// testcase_bulk
+// Testcase with a 16 KiB message, processed in chunks of different
+// sizes. Large chunks are processed by the vector kernel (if the
+// CPU has one), small chunks and the tail by the scalar kernels.
+//------------------------------------------------------------------
+int testcase_bulk() {
+  uint8_t my_key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+                        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+                        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+                        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+  uint8_t my_expected[16] = {0x27, 0x20, 0x92, 0xa0, 0xac, 0x80, 0xbc, 0x5c,
+                             0xb7, 0x00, 0x97, 0x01, 0xe0, 0x6e, 0x74, 0x57};
+
+  size_t my_chunks[5] = {16, 100, 1000, 4099, 16384};
+
+  static uint8_t my_message[16384];
+  uint8_t my_tag[16];
+  crypto_poly1305_ctx my_ctx;
+  int res = 0;
+
+  for (int i = 0 ; i < 16384 ; i++) {
+    my_message[i] = (uint8_t)(i * 7 + 3);
+  }
+
+  TRACE_OFF();
+  for (int i = 0 ; i < 5 ; i++) {
+    printf("testcase_bulk: Processing message in chunks of %zu bytes\n",
+           my_chunks[i]);
+    crypto_poly1305_init(&my_ctx, &my_key[0]);
+    for (size_t j = 0 ; j < 16384 ; j += my_chunks[i]) {
+      size_t my_size = 16384 - j < my_chunks[i] ? 16384 - j : my_chunks[i];
+      crypto_poly1305_update(&my_ctx, &my_message[j], my_size);
+    }
+    crypto_poly1305_final(&my_ctx, &my_tag[0]);
+    res += check_tag(&my_tag[0], &my_expected[0]);
+  }
+  TRACE_ON();
+
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_updatev
+// MAC the 16 KiB message from testcase_bulk as fragments of odd
+// sizes, in two scatter-gather updates with a normal update
+// in between.
+//------------------------------------------------------------------
+int testcase_updatev() {
+  uint8_t my_key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+                        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+                        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+                        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+  uint8_t my_expected[16] = {0x27, 0x20, 0x92, 0xa0, 0xac, 0x80, 0xbc, 0x5c,
+                             0xb7, 0x00, 0x97, 0x01, 0xe0, 0x6e, 0x74, 0x57};
+
+  size_t my_sizes[10] = {1, 15, 17, 3, 0, 1000, 31, 4096, 5, 2};
+
+  static uint8_t my_message[16384];
+  struct iovec my_iov[10];
+  uint8_t my_tag[16];
+  crypto_poly1305_ctx my_ctx;
+  size_t my_offset = 0;
+
+  for (int i = 0 ; i < 16384 ; i++) {
+    my_message[i] = (uint8_t)(i * 7 + 3);
+  }
+
+  for (int i = 0 ; i < 10 ; i++) {
+    my_iov[i].iov_base = &my_message[my_offset];
+    my_iov[i].iov_len  = my_sizes[i];
+    my_offset += my_sizes[i];
+  }
+
+  TRACE_OFF();
+  crypto_poly1305_init(&my_ctx, &my_key[0]);
+  printf("testcase_updatev: Processing the first 7 fragments.\n");
+  crypto_poly1305_updatev(&my_ctx, &my_iov[0], 7);
+  printf("testcase_updatev: Processing the last 3 fragments.\n");
+  crypto_poly1305_updatev(&my_ctx, &my_iov[7], 3);
+  printf("testcase_updatev: Processing the rest of the message.\n");
+  crypto_poly1305_update(&my_ctx, &my_message[my_offset], 16384 - my_offset);
+  crypto_poly1305_final(&my_ctx, &my_tag[0]);
+  TRACE_ON();
+
+  return check_tag(&my_tag[0], &my_expected[0]);
+}
+
+
+//------------------------------------------------------------------
+// testcase_update_copy
+// Copy and MAC messages after a 5 byte update, to an unaligned
+// destination, from empty to past the non-temporal threshold, and
+// check both the copy and the tag against memcpy() and
+// crypto_poly1305_update().
+//------------------------------------------------------------------
+int testcase_update_copy() {
+  uint8_t my_key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+                        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+                        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+                        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+  size_t my_sizes[5] = {0, 1, 100, 20000, POLY1305_COPY_NT_THRESHOLD + 77};
+
+  size_t max = POLY1305_COPY_NT_THRESHOLD + 77;
+  uint8_t *my_src = malloc(max);
+  uint8_t *my_dst = malloc(max + 3);
+  uint8_t my_tag[16];
+  uint8_t my_expected[16];
+  crypto_poly1305_ctx my_ctx;
+  int res = 0;
+
+  if (!my_src || !my_dst) {
+    printf("testcase_update_copy: Out of memory.\n");
+    free(my_src);
+    free(my_dst);
+    return 1;
+  }
+  for (size_t i = 0 ; i < max ; i++) {
+    my_src[i] = (uint8_t)(i * 11 + 9);
+  }
+
+  TRACE_OFF();
+  for (int i = 0 ; i < 5 ; i++) {
+    size_t size = my_sizes[i];
+    printf("testcase_update_copy: Copying %zu bytes\n", size);
+
+    crypto_poly1305_init(&my_ctx, &my_key[0]);
+    crypto_poly1305_update(&my_ctx, &my_key[0], 5);
+    crypto_poly1305_update(&my_ctx, my_src, size);
+    crypto_poly1305_final(&my_ctx, &my_expected[0]);
+
+    memset(my_dst, 0, max + 3);
+    crypto_poly1305_init(&my_ctx, &my_key[0]);
+    crypto_poly1305_update(&my_ctx, &my_key[0], 5);
+    crypto_poly1305_update_copy(&my_ctx, my_dst + 3, my_src, size);
+    crypto_poly1305_final(&my_ctx, &my_tag[0]);
+
+    res += check_tag(&my_tag[0], &my_expected[0]);
+    if (memcmp(my_dst + 3, my_src, size) != 0 || my_dst[size + 3] != 0) {
+      printf("testcase_update_copy: Bad copy.\n");
+      res++;
+    }
+  }
+  TRACE_ON();
+
+  free(my_src);
+  free(my_dst);
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_aead
+// Test with the AEAD test vector from RFC 8439, section 2.8.2.
+// The additional data and ciphertext are given in pieces.
+//------------------------------------------------------------------
+int testcase_aead() {
+  uint8_t my_key[32] = {0x7b, 0xac, 0x2b, 0x25, 0x2d, 0xb4, 0x47, 0xaf,
+                        0x09, 0xb6, 0x7a, 0x55, 0xa4, 0xe9, 0x55, 0x84,
+                        0x0a, 0xe1, 0xd6, 0x73, 0x10, 0x75, 0xd9, 0xeb,
+                        0x2a, 0x93, 0x75, 0x78, 0x3e, 0xd5, 0x53, 0xff};
+
+  uint8_t my_ad[12] = {0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3,
+                       0xc4, 0xc5, 0xc6, 0xc7};
+
+  uint8_t my_text[114] = {0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb,
+                          0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2,
+                          0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe,
+                          0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6,
+                          0x3d, 0xbe, 0xa4, 0x5e, 0x8c, 0xa9, 0x67, 0x12,
+                          0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+                          0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29,
+                          0x05, 0xd6, 0xa5, 0xb6, 0x7e, 0xcd, 0x3b, 0x36,
+                          0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c,
+                          0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58,
+                          0xfa, 0xb3, 0x24, 0xe4, 0xfa, 0xd6, 0x75, 0x94,
+                          0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+                          0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d,
+                          0xe5, 0x76, 0xd2, 0x65, 0x86, 0xce, 0xc6, 0x4b,
+                          0x61, 0x16};
+
+  uint8_t my_expected[16] = {0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+                             0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91};
+
+  uint8_t my_tag[16];
+  crypto_poly1305_aead_ctx my_ctx;
+
+  printf("testcase_aead: Additional data in 2 pieces, ciphertext in 3.\n");
+  crypto_poly1305_aead_init(&my_ctx, &my_key[0]);
+  crypto_poly1305_aead_ad(&my_ctx, &my_ad[0], 5);
+  crypto_poly1305_aead_ad(&my_ctx, &my_ad[5], 7);
+  crypto_poly1305_aead_text(&my_ctx, &my_text[0], 1);
+  crypto_poly1305_aead_text(&my_ctx, &my_text[1], 50);
+  crypto_poly1305_aead_text(&my_ctx, &my_text[51], 63);
+  crypto_poly1305_aead_final(&my_ctx, &my_tag[0]);
+  return check_tag(&my_tag[0], &my_expected[0]);
+}
+
+
+//------------------------------------------------------------------
+// testcase_small
+// Check the short message one-shots for all sizes from 0 to 64
+// bytes against the incremental interface.
+//------------------------------------------------------------------
+int testcase_small() {
+  uint8_t my_key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+                        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+                        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+                        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+  uint8_t my_message[64];
+  uint8_t my_tag[16];
+  uint8_t my_expected[65][16];
+  crypto_poly1305_ctx my_ctx;
+  int res = 0;
+
+  for (int i = 0 ; i < 64 ; i++) {
+    my_message[i] = (uint8_t)(i * 7 + 3);
+  }
+
+  TRACE_OFF();
+  for (int i = 0 ; i <= 64 ; i++) {
+    crypto_poly1305_init(&my_ctx, &my_key[0]);
+    crypto_poly1305_update(&my_ctx, &my_message[0], (size_t)i);
+    crypto_poly1305_final(&my_ctx, &my_expected[i][0]);
+  }
+  TRACE_ON();
+
+  printf("testcase_small: Checking sizes 0 to 64 bytes.\n");
+  for (int i = 0 ; i <= 64 ; i++) {
+    crypto_poly1305_small(&my_tag[0], &my_message[0], (size_t)i, &my_key[0]);
+    res += check_tag(&my_tag[0], &my_expected[i][0]);
+  }
+
+  printf("testcase_small: Checking the fixed size one-shots.\n");
+  crypto_poly1305_16(&my_tag[0], &my_message[0], &my_key[0]);
+  res += check_tag(&my_tag[0], &my_expected[16][0]);
+  crypto_poly1305_32(&my_tag[0], &my_message[0], &my_key[0]);
+  res += check_tag(&my_tag[0], &my_expected[32][0]);
+  crypto_poly1305_64(&my_tag[0], &my_message[0], &my_key[0]);
+  res += check_tag(&my_tag[0], &my_expected[64][0]);
+
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_batch
+// MAC 21 messages of 0 to 300 bytes, and every seventh of 1536 bytes
+// or more, with different keys using the batch interface, and check
+// the tags against crypto_poly1305().
+//------------------------------------------------------------------
+int testcase_batch() {
+  uint8_t my_data[4096];
+  uint8_t my_tags[21][16];
+  uint8_t my_expected[21][16];
+  uint8_t *my_macs[21];
+  uint8_t *my_messages[21];
+  uint8_t *my_keys[21];
+  size_t my_sizes[21];
+  int res = 0;
+
+  for (int i = 0 ; i < 4096 ; i++) {
+    my_data[i] = (uint8_t)(i * 13 + 5);
+  }
+
+  for (int i = 0 ; i < 21 ; i++) {
+    my_macs[i]     = &my_tags[i][0];
+    my_messages[i] = &my_data[i * 17];
+    my_keys[i]     = &my_data[3000 + i * 11];
+    my_sizes[i]    = (size_t)(i % 7 == 6 ? 1500 + i * 6 : (i * 15) % 301);
+    crypto_poly1305(&my_expected[i][0], my_messages[i], my_sizes[i],
+                    my_keys[i]);
+  }
+
+  printf("testcase_batch: Processing 21 messages in a batch\n");
+  crypto_poly1305_batch(my_macs, my_messages, my_sizes, my_keys, 21);
+
+  for (int i = 0 ; i < 21 ; i++) {
+    res += check_tag(&my_tags[i][0], &my_expected[i][0]);
+  }
+
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_verify
+// Compare tags with crypto_verify16(), and verify good and corrupted
+// tags, one at a time and as a batch of 70 messages, which needs two
+// words of the pass bitmask. Messages are up to 256 bytes, with two
+// in ten of more than 1536 bytes.
+//------------------------------------------------------------------
+int testcase_verify() {
+  uint8_t my_data[4096];
+  uint8_t my_tags[70][16];
+  uint8_t *my_macs[70];
+  uint8_t *my_messages[70];
+  uint8_t *my_keys[70];
+  size_t my_sizes[70];
+  uint64_t my_pass[2];
+  uint64_t my_expected[2] = {0, 0};
+  int res = 0;
+
+  for (int i = 0 ; i < 4096 ; i++) {
+    my_data[i] = (uint8_t)(i * 13 + 5);
+  }
+
+  for (int i = 0 ; i < 70 ; i++) {
+    my_macs[i]     = &my_tags[i][0];
+    my_messages[i] = &my_data[i * 5];
+    my_keys[i]     = &my_data[3000 + i * 3];
+    my_sizes[i]    = (size_t)(i % 10 >= 8 ? 1537 + i : (i * 23) % 257);
+    crypto_poly1305(&my_tags[i][0], my_messages[i], my_sizes[i],
+                    my_keys[i]);
+  }
+
+  // crypto_verify16() on its own, equal and with any one bit off.
+  res += crypto_verify16(&my_tags[0][0], &my_tags[0][0]) != 0;
+  for (int i = 0 ; i < 128 ; i++) {
+    uint8_t my_other[16];
+    memcpy(my_other, &my_tags[0][0], 16);
+    my_other[i / 8] ^= (uint8_t)(1 << (i % 8));
+    res += crypto_verify16(&my_tags[0][0], my_other) != -1;
+  }
+
+  printf("testcase_verify: Verifying 70 good tags\n");
+  for (int i = 0 ; i < 70 ; i++) {
+    res += crypto_poly1305_verify(&my_tags[i][0], my_messages[i],
+                                  my_sizes[i], my_keys[i]) != 0;
+  }
+  res += crypto_poly1305_batch_verify(my_pass, my_macs, my_messages,
+                                      my_sizes, my_keys, 70) != 0;
+  res += my_pass[0] != ~(uint64_t)0;
+  res += my_pass[1] != 0x3f;
+
+  // Flip one bit in every fifth tag, in a different byte each time
+  for (int i = 0 ; i < 70 ; i++) {
+    if (i % 5 == 3) {
+      my_tags[i][i % 16] ^= (uint8_t)(1 << (i % 8));
+    }
+    else {
+      my_expected[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+  }
+
+  printf("testcase_verify: Verifying 14 bad tags among 70\n");
+  for (int i = 0 ; i < 70 ; i++) {
+    int my_res = crypto_poly1305_verify(&my_tags[i][0], my_messages[i],
+                                        my_sizes[i], my_keys[i]);
+    res += my_res != (i % 5 == 3 ? -1 : 0);
+  }
+  res += crypto_poly1305_batch_verify(my_pass, my_macs, my_messages,
+                                      my_sizes, my_keys, 70) != -1;
+  res += my_pass[0] != my_expected[0];
+  res += my_pass[1] != my_expected[1];
+
+  if (res) {
+    printf("testcase_verify: %d checks failed.\n", res);
+  }
+  else {
+    printf("testcase_verify: All checks passed.\n");
+  }
+  return res != 0;
+}
+
+
+//------------------------------------------------------------------
+// testcase_partial
+// Evaluate the 16 KiB message from testcase_bulk as three chunks
+// and combine the partials in both possible orders.
+//------------------------------------------------------------------
+int testcase_partial() {
+  uint8_t my_key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+                        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+                        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+                        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+  uint8_t my_expected[16] = {0x27, 0x20, 0x92, 0xa0, 0xac, 0x80, 0xbc, 0x5c,
+                             0xb7, 0x00, 0x97, 0x01, 0xe0, 0x6e, 0x74, 0x57};
+
+  size_t my_splits[4][2] = {{0, 16}, {16, 16384}, {4096, 8000}, {8000, 8000}};
+
+  static uint8_t my_message[16384];
+  uint8_t my_tag[16];
+  crypto_poly1305_partial my_a, my_b, my_c;
+  int res = 0;
+
+  for (int i = 0 ; i < 16384 ; i++) {
+    my_message[i] = (uint8_t)(i * 7 + 3);
+  }
+
+  TRACE_OFF();
+  for (int i = 0 ; i < 4 ; i++) {
+    size_t s0 = my_splits[i][0];
+    size_t s1 = my_splits[i][1];
+    printf("testcase_partial: Chunks split at %zu and %zu\n", s0, s1);
+
+    // (a, b), c
+    crypto_poly1305_chunk(&my_a, &my_key[0], &my_message[0], s0);
+    crypto_poly1305_chunk(&my_b, &my_key[0], &my_message[s0], s1 - s0);
+    crypto_poly1305_chunk(&my_c, &my_key[0], &my_message[s1], 16384 - s1);
+    crypto_poly1305_combine(&my_a, &my_b, &my_key[0]);
+    crypto_poly1305_combine(&my_a, &my_c, &my_key[0]);
+    crypto_poly1305_partial_final(&my_tag[0], &my_a, &my_key[0]);
+    res += check_tag(&my_tag[0], &my_expected[0]);
+
+    // a, (b, c)
+    crypto_poly1305_chunk(&my_a, &my_key[0], &my_message[0], s0);
+    crypto_poly1305_chunk(&my_b, &my_key[0], &my_message[s0], s1 - s0);
+    crypto_poly1305_combine(&my_b, &my_c, &my_key[0]);
+    crypto_poly1305_combine(&my_a, &my_b, &my_key[0]);
+    crypto_poly1305_partial_final(&my_tag[0], &my_a, &my_key[0]);
+    res += check_tag(&my_tag[0], &my_expected[0]);
+  }
+
+  // With r = 1 and the 32 bit kernels this message evaluates to
+  // h = {0xfffffffb, 0x001fffff, 0, 0, 4}, h[4] = 4 and a run of
+  // ones across the first two 26 bit limbs, the edge of the range
+  // of h. Empty partials on either side must not change it.
+  uint8_t my_r1_key[32] = {0x01};
+  crypto_poly1305_partial my_e;
+
+  memset(&my_message[0], 0, 48);
+  memset(&my_message[20], 0xff, 4);
+  memset(&my_message[32], 0xff, 16);
+  my_message[32] = 0xfb;
+  my_message[36] = 0x00;
+  my_message[37] = 0x00;
+  my_message[38] = 0x20;
+  my_message[39] = 0x00;
+  crypto_poly1305(&my_expected[0], &my_message[0], 48, &my_r1_key[0]);
+
+  printf("testcase_partial: Empty chunks around an edge value of h\n");
+  crypto_poly1305_chunk(&my_b, &my_r1_key[0], &my_message[0], 48);
+  crypto_poly1305_partial_final(&my_tag[0], &my_b, &my_r1_key[0]);
+  res += check_tag(&my_tag[0], &my_expected[0]);
+
+  crypto_poly1305_chunk(&my_e, &my_r1_key[0], &my_message[0], 0);
+  crypto_poly1305_chunk(&my_a, &my_r1_key[0], &my_message[0], 0);
+  crypto_poly1305_combine(&my_a, &my_b, &my_r1_key[0]);
+  crypto_poly1305_combine(&my_a, &my_e, &my_r1_key[0]);
+  crypto_poly1305_partial_final(&my_tag[0], &my_a, &my_r1_key[0]);
+  res += check_tag(&my_tag[0], &my_expected[0]);
+
+  // Zero partial covering blocks of zeros
+  crypto_poly1305_chunk(&my_a, &my_r1_key[0], &my_message[0], 16);
+  crypto_poly1305_chunk(&my_b, &my_r1_key[0], &my_message[16], 32);
+  memset(my_c.h, 0, sizeof(my_c.h));
+  my_c.nb_blocks = 0;
+  crypto_poly1305_combine(&my_c, &my_a, &my_r1_key[0]);
+  crypto_poly1305_combine(&my_c, &my_b, &my_r1_key[0]);
+  crypto_poly1305_partial_final(&my_tag[0], &my_c, &my_r1_key[0]);
+  res += check_tag(&my_tag[0], &my_expected[0]);
+  TRACE_ON();
+
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_service
+// Submit 200 messages of up to 1 MB to a service with three
+// workers, half with callbacks and half with futures, and check
+// against crypto_poly1305(). The large ones are split in chunks.
+//------------------------------------------------------------------
+static void service_callback(void *arg, uint8_t mac[16]) {
+  (void)mac;
+  (*(int *)arg)++;
+}
+
+int testcase_service() {
+  static uint8_t my_message[1048576];
+  static uint8_t my_tags[200][16];
+  uint8_t my_key[32];
+  uint8_t my_expected[16];
+  size_t my_sizes[200];
+  poly1305_future *my_futures[200];
+  int my_called[200] = {0};
+  int res = 0;
+
+  for (int i = 0 ; i < 1048576 ; i++) {
+    my_message[i] = (uint8_t)(i * 7 + 3);
+  }
+  for (int i = 0 ; i < 32 ; i++) {
+    my_key[i] = (uint8_t)(i * 13 + 5);
+  }
+  for (int i = 0 ; i < 200 ; i++) {
+    my_sizes[i] = (size_t)(i * 977) % 5000;
+  }
+  my_sizes[17]  = 300000;
+  my_sizes[101] = 1000000;
+  my_sizes[150] = 262144 + 15;
+
+  poly1305_service *my_service = poly1305_service_create(3);
+  if (!my_service) {
+    printf("testcase_service: Could not create the service.\n");
+    return 1;
+  }
+
+  printf("testcase_service: Processing 200 messages\n");
+  TRACE_OFF();
+  for (int i = 0 ; i < 200 ; i++) {
+    if (i % 2) {
+      my_futures[i] = poly1305_service_async(my_service, &my_tags[i][0],
+                                             &my_message[i], my_sizes[i],
+                                             &my_key[0]);
+      res += my_futures[i] == NULL;
+    }
+    else {
+      res += poly1305_service_submit(my_service, &my_tags[i][0],
+                                     &my_message[i], my_sizes[i],
+                                     &my_key[0], service_callback,
+                                     &my_called[i]) != 0;
+    }
+  }
+
+  for (int i = 1 ; i < 200 ; i += 2) {
+    if (my_futures[i]) {
+      poly1305_future_wait(my_futures[i]);
+    }
+  }
+  poly1305_service_drain(my_service);
+
+  for (int i = 0 ; i < 200 ; i++) {
+    crypto_poly1305(&my_expected[0], &my_message[i], my_sizes[i],
+                    &my_key[0]);
+    res += memcmp(&my_tags[i][0], &my_expected[0], 16) != 0;
+    res += i % 2 == 0 && my_called[i] != 1;
+  }
+  TRACE_ON();
+  poly1305_service_destroy(my_service);
+
+  if (res) {
+    printf("testcase_service: %d checks failed.\n", res);
+  }
+  else {
+    printf("testcase_service: All messages correct.\n");
+  }
+  return res != 0;
+}
+
+
+//------------------------------------------------------------------
+// testcase_key_schedule
+// Start several contexts from one key schedule and check against
+// crypto_poly1305() and the expected tag of the 16 kB message.
+//------------------------------------------------------------------
+int testcase_key_schedule() {
+  uint8_t my_key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+                        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+                        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+                        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+  uint8_t my_expected[16] = {0x27, 0x20, 0x92, 0xa0, 0xac, 0x80, 0xbc, 0x5c,
+                             0xb7, 0x00, 0x97, 0x01, 0xe0, 0x6e, 0x74, 0x57};
+
+  size_t my_sizes[7] = {0, 15, 64, 100, 255, 1024, 16384};
+
+  static uint8_t my_message[16384];
+  uint8_t my_tag[16];
+  uint8_t my_ref[16];
+  crypto_poly1305_key my_ks;
+  crypto_poly1305_ctx my_ctx;
+  int res = 0;
+
+  for (int i = 0 ; i < 16384 ; i++) {
+    my_message[i] = (uint8_t)(i * 7 + 3);
+  }
+
+  TRACE_OFF();
+  crypto_poly1305_key_init(&my_ks, &my_key[0]);
+  for (int i = 0 ; i < 7 ; i++) {
+    printf("testcase_key_schedule: Processing %zu byte message\n",
+           my_sizes[i]);
+    crypto_poly1305(&my_ref[0], &my_message[0], my_sizes[i], &my_key[0]);
+
+    // In one piece
+    crypto_poly1305_init_key(&my_ctx, &my_ks);
+    crypto_poly1305_update(&my_ctx, &my_message[0], my_sizes[i]);
+    crypto_poly1305_final(&my_ctx, &my_tag[0]);
+    res += check_tag(&my_tag[0], &my_ref[0]);
+
+    // In uneven pieces
+    crypto_poly1305_init_key(&my_ctx, &my_ks);
+    for (size_t j = 0 ; j < my_sizes[i] ; j += 300) {
+      size_t n = my_sizes[i] - j < 300 ? my_sizes[i] - j : 300;
+      crypto_poly1305_update(&my_ctx, &my_message[j], n);
+    }
+    crypto_poly1305_final(&my_ctx, &my_tag[0]);
+    res += check_tag(&my_tag[0], &my_ref[0]);
+  }
+  res += check_tag(&my_tag[0], &my_expected[0]);
+  crypto_wipe(&my_ks, sizeof(my_ks));
+  TRACE_ON();
+
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_max_limbs
+// All ones key and message, giving the largest clamped r and the
+// largest message limbs. Checks the bounds of the carry chains.
+//------------------------------------------------------------------
+int testcase_max_limbs() {
+  uint8_t my_key[32];
+  uint8_t my_message[1024];
+  uint8_t my_tag[16];
+  uint8_t my_expected[16] = {0x25, 0xd4, 0x92, 0x6a, 0x53, 0xbb, 0x48, 0x0d,
+                             0xa2, 0x28, 0xec, 0x61, 0xe0, 0xa3, 0x1a, 0x38};
+  crypto_poly1305_ctx my_ctx;
+  int res = 0;
+
+  for (int i = 0 ; i < 32 ; i++) {
+    my_key[i] = 0xff;
+  }
+  for (int i = 0 ; i < 1024 ; i++) {
+    my_message[i] = 0xff;
+  }
+
+  printf("testcase_max_limbs: Processing 1024 bytes of all ones\n");
+  TRACE_OFF();
+  crypto_poly1305(&my_tag[0], &my_message[0], 1024, &my_key[0]);
+  res += check_tag(&my_tag[0], &my_expected[0]);
+
+  crypto_poly1305_init(&my_ctx, &my_key[0]);
+  for (int i = 0 ; i < 1024 ; i += 112) {
+    crypto_poly1305_update(&my_ctx, &my_message[i],
+                           i + 112 <= 1024 ? 112 : 1024 - i);
+  }
+  crypto_poly1305_final(&my_ctx, &my_tag[0]);
+  res += check_tag(&my_tag[0], &my_expected[0]);
+  TRACE_ON();
+
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_boundary_limbs
+// Start from accumulated hashes at the edges of the partially
+// reduced range, h[4] = 4 and runs of ones across the 26 bit limb
+// boundaries, and check the active kernel against the reference
+// kernel. The hashes are loaded with crypto_poly1305_restore().
+// With r = 1 the same hashes also go through combine(), checked
+// against poly_block() of the reference kernel and the tag of the
+// partial itself.
+//------------------------------------------------------------------
+static void boundary_state(uint8_t *state, uint8_t key[32],
+                           const uint32_t h[5]) {
+  crypto_poly1305_ctx ctx;
+
+  crypto_poly1305_init(&ctx, key);
+  crypto_poly1305_save(state, &ctx);
+  for (int i = 0 ; i < 5 ; i++) {
+    for (int j = 0 ; j < 4 ; j++) {
+      state[8 + i * 4 + j] = (uint8_t)(h[i] >> (j * 8));
+    }
+  }
+  crypto_wipe(&ctx, sizeof(ctx));
+}
+
+static void boundary_mac(uint8_t tag[16], uint8_t key[32],
+                         const uint32_t h[5],
+                         uint8_t *message, size_t size) {
+  uint8_t state[CRYPTO_POLY1305_STATE_SIZE];
+  crypto_poly1305_ctx ctx;
+
+  boundary_state(&state[0], key, h);
+  crypto_poly1305_restore(&ctx, &state[0], key);
+  crypto_poly1305_update(&ctx, message, size);
+  crypto_poly1305_final(&ctx, tag);
+  crypto_wipe(state, sizeof(state));
+}
+
+int testcase_boundary_limbs() {
+  uint32_t my_h[7][5] = {{0x00000000, 0x00000000, 0x00000000, 0x00000000, 0},
+                         {0xfffffffb, 0x001fffff, 0x00000000, 0x00000000, 4},
+                         {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 4},
+                         {0x00000000, 0x00000000, 0x00000000, 0x00000000, 4},
+                         {0xfffffffb, 0xffffffff, 0xffffffff, 0xffffffff, 3},
+                         {0xfffffffa, 0xffffffff, 0xffffffff, 0xffffffff, 3},
+                         {0xffffffff, 0x03ffffff, 0xfff00000, 0xffffffff, 4}};
+
+  size_t my_sizes[6] = {16, 64, 256, 272, 320, 1024};
+  int my_top_blocks[4] = {0, 1, 4, 5};
+
+  uint8_t my_keys[2][32];
+  static uint8_t my_message[3][1024];
+  uint8_t my_tag[16];
+  uint8_t my_ref[16];
+  const char *my_kernel = crypto_poly1305_active_kernel();
+  crypto_poly1305_partial my_a, my_b;
+  int res = 0;
+
+  // r = 1, and the largest clamped r.
+  memset(my_keys, 0x55, sizeof(my_keys));
+  memset(my_keys[0], 0, 16);
+  my_keys[0][0] = 1;
+  memset(my_keys[1], 0xff, 16);
+  memset(my_message[0], 0x00, 1024);
+  memset(my_message[1], 0xff, 1024);
+
+  // With r = 1 and h = 0 the lanes of the AVX2 kernel sum to limbs
+  // that carry from the top limb all the way back into the second,
+  // with the third limb odd. A restored context has no powers of r
+  // yet, so only the 320 and 1024 byte runs go through the lanes.
+  memset(my_message[2], 0x00, 1024);
+  memset(my_message[2], 0xff, 7);
+  my_message[2][0] = 0xe9;
+  my_message[2][6] = 0x1f;
+  for (int i = 0 ; i < 4 ; i++) {
+    memset(&my_message[2][my_top_blocks[i] * 16 + 13], 0xff, 3);
+  }
+  my_message[2][8 * 16 + 13] = 0x02;
+  my_message[2][9 * 16 + 13] = 0x02;
+
+  TRACE_OFF();
+  for (int k = 0 ; k < 2 ; k++) {
+    for (int i = 0 ; i < 7 ; i++) {
+      printf("testcase_boundary_limbs: Key %d, hash %d\n", k, i);
+      for (int m = 0 ; m < 3 ; m++) {
+        for (int j = 0 ; j < 6 ; j++) {
+          crypto_poly1305_select_kernel("ref32");
+          boundary_mac(&my_ref[0], my_keys[k], my_h[i],
+                       my_message[m], my_sizes[j]);
+          crypto_poly1305_select_kernel(my_kernel);
+          boundary_mac(&my_tag[0], my_keys[k], my_h[i],
+                       my_message[m], my_sizes[j]);
+          res += check_tag(&my_tag[0], &my_ref[0]);
+        }
+      }
+    }
+  }
+
+  // With r = 1 combining a one block partial is the same as
+  // processing the block, and an empty partial changes nothing.
+  for (int i = 0 ; i < 7 ; i++) {
+    printf("testcase_boundary_limbs: Combine with hash %d\n", i);
+    for (int m = 0 ; m < 2 ; m++) {
+      memcpy(my_a.h, my_h[i], sizeof(my_a.h));
+      my_a.nb_blocks = 3;
+      crypto_poly1305_chunk(&my_b, my_keys[0], my_message[m], 16);
+      crypto_poly1305_combine(&my_a, &my_b, my_keys[0]);
+      crypto_poly1305_partial_final(&my_tag[0], &my_a, my_keys[0]);
+      boundary_mac(&my_ref[0], my_keys[0], my_h[i], my_message[m], 16);
+      res += check_tag(&my_tag[0], &my_ref[0]);
+    }
+
+    memcpy(my_b.h, my_h[i], sizeof(my_b.h));
+    my_b.nb_blocks = 3;
+    crypto_poly1305_partial_final(&my_ref[0], &my_b, my_keys[1]);
+    crypto_poly1305_chunk(&my_a, my_keys[1], my_message[0], 0);
+    crypto_poly1305_combine(&my_a, &my_b, my_keys[1]);
+    crypto_poly1305_partial_final(&my_tag[0], &my_a, my_keys[1]);
+    res += check_tag(&my_tag[0], &my_ref[0]);
+  }
+  TRACE_ON();
+
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_trace
+// Write the binary trace of the RFC 8439 vector and read it back.
+// There should be three block records and a final record holding
+// the tag. Only the traced build can write traces.
+//------------------------------------------------------------------
+static uint32_t read_word(FILE *f) {
+  uint8_t b[4] = {0, 0, 0, 0};
+  if (fread(b, 1, 4, f) != 4) {
+    return 0xffffffff;
+  }
+  return b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+int testcase_trace() {
+  uint8_t my_key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+                        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+                        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+                        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+  uint8_t my_message[34] = {0x43, 0x72, 0x79, 0x70, 0x74, 0x6f, 0x67, 0x72,
+                            0x61, 0x70, 0x68, 0x69, 0x63, 0x20, 0x46, 0x6f,
+                            0x72, 0x75, 0x6d, 0x20, 0x52, 0x65, 0x73, 0x65,
+                            0x61, 0x72, 0x63, 0x68, 0x20, 0x47, 0x72, 0x6f,
+                            0x75, 0x70};
+
+  uint8_t my_expected[16] = {0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6,
+                             0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9};
+
+  const char *my_file = "test_poly1305.trace";
+  uint8_t my_tag[16];
+  crypto_poly1305_ctx my_ctx;
+  int res = 0;
+
+  printf("testcase_trace: Tracing the RFC 8439 vector to %s\n", my_file);
+  if (poly1305_trace_open(my_file) != 0) {
+#ifdef POLY1305_TRACE
+    printf("testcase_trace: Could not write the trace.\n");
+    return 1;
+#else
+    printf("testcase_trace: No trace in the release build, as expected.\n");
+    return 0;
+#endif
+  }
+  crypto_poly1305_init(&my_ctx, &my_key[0]);
+  crypto_poly1305_update(&my_ctx, &my_message[0], 34);
+  crypto_poly1305_final(&my_ctx, &my_tag[0]);
+  poly1305_trace_close();
+  res += check_tag(&my_tag[0], &my_expected[0]);
+
+  FILE *f = fopen(my_file, "rb");
+  if (!f) {
+    printf("testcase_trace: Could not read the trace back.\n");
+    return 1;
+  }
+  if (read_word(f) != POLY1305_TRACE_MAGIC ||
+      read_word(f) != POLY1305_TRACE_VERSION) {
+    printf("testcase_trace: Bad trace header.\n");
+    res++;
+  }
+  for (uint32_t i = 0 ; i < 4 && !res ; i++) {
+    uint32_t kind  = read_word(f);
+    uint32_t index = read_word(f);
+    uint32_t n     = read_word(f);
+    uint32_t v[2 * CRYPTO_POLY1305_TRACE_BLOCK_VALUES];
+    uint32_t expected_kind = i < 3 ? CRYPTO_POLY1305_TRACE_BLOCK
+                                   : CRYPTO_POLY1305_TRACE_FINAL;
+    uint32_t expected_n    = i < 3 ? CRYPTO_POLY1305_TRACE_BLOCK_VALUES
+                                   : CRYPTO_POLY1305_TRACE_FINAL_VALUES;
+    if (kind != expected_kind || index != (i < 3 ? i : 0) || n != expected_n) {
+      printf("testcase_trace: Bad record %u.\n", i);
+      res++;
+      break;
+    }
+    for (uint32_t j = 0 ; j < 2 * n ; j++) {
+      v[j] = read_word(f);
+    }
+    // uu0..uu3 of the final record hold the tag in the low words.
+    for (uint32_t j = 0 ; i == 3 && j < 4 ; j++) {
+      uint32_t word = my_expected[j * 4] | (uint32_t)my_expected[j * 4 + 1] << 8 |
+        (uint32_t)my_expected[j * 4 + 2] << 16 | (uint32_t)my_expected[j * 4 + 3] << 24;
+      if (v[(5 + j) * 2] != word) {
+        printf("testcase_trace: uu%u does not match the tag.\n", j);
+        res++;
+      }
+    }
+  }
+  if (!res && fgetc(f) != EOF) {
+    printf("testcase_trace: Unexpected data after the final record.\n");
+    res++;
+  }
+  fclose(f);
+  remove(my_file);
+
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_checkpoint
+// Save and restore the state of the MAC of the 16 KiB message from
+// testcase_bulk at a number of offsets, check that invalid states
+// are rejected, and resume the MAC of a file after appending to it.
+// Appending many times must not grow the index beyond one checkpoint
+// per interval and one at the end, and a corrupt index is ignored.
+//------------------------------------------------------------------
+static int write_message(const char *name, uint8_t *message, size_t size) {
+  FILE *f = fopen(name, "wb");
+  if (!f) {
+    return -1;
+  }
+  size_t n = fwrite(message, 1, size, f);
+  return (fclose(f) == 0 && n == size) ? 0 : -1;
+}
+
+int testcase_checkpoint() {
+  uint8_t my_key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+                        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+                        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+                        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+  uint8_t my_expected[16] = {0x27, 0x20, 0x92, 0xa0, 0xac, 0x80, 0xbc, 0x5c,
+                             0xb7, 0x00, 0x97, 0x01, 0xe0, 0x6e, 0x74, 0x57};
+
+  size_t my_offsets[6] = {0, 1, 15, 16, 17, 5000};
+
+  const char *my_file  = "test_poly1305.log";
+  const char *my_index = "test_poly1305.log" POLY1305_CHECKPOINT_SUFFIX;
+  static uint8_t my_message[16384];
+  uint8_t my_state[CRYPTO_POLY1305_STATE_SIZE];
+  uint8_t my_tag[16];
+  uint8_t my_prefix_tag[16];
+  uint64_t my_resumed;
+  crypto_poly1305_ctx my_ctx;
+  int res = 0;
+
+  for (int i = 0 ; i < 16384 ; i++) {
+    my_message[i] = (uint8_t)(i * 7 + 3);
+  }
+
+  TRACE_OFF();
+  for (int i = 0 ; i < 6 ; i++) {
+    size_t offset = my_offsets[i];
+    printf("testcase_checkpoint: Saving the state at %zu\n", offset);
+    crypto_poly1305_init(&my_ctx, &my_key[0]);
+    crypto_poly1305_update(&my_ctx, &my_message[0], offset);
+    crypto_poly1305_save(&my_state[0], &my_ctx);
+    crypto_wipe(&my_ctx, sizeof(my_ctx));
+    if (crypto_poly1305_restore(&my_ctx, &my_state[0], &my_key[0]) != 0) {
+      printf("testcase_checkpoint: Valid state rejected.\n");
+      res++;
+      continue;
+    }
+    crypto_poly1305_update(&my_ctx, &my_message[offset], 16384 - offset);
+    crypto_poly1305_final(&my_ctx, &my_tag[0]);
+    res += check_tag(&my_tag[0], &my_expected[0]);
+  }
+
+  // Bad version, another r, h[4] out of range, and no part of the
+  // key in the state. Only r is matched, s is applied at the end.
+  my_state[4] ^= 1;
+  res += crypto_poly1305_restore(&my_ctx, &my_state[0], &my_key[0]) != -1;
+  my_state[4] ^= 1;
+  my_key[16] ^= 1;
+  res += crypto_poly1305_restore(&my_ctx, &my_state[0], &my_key[0]) != 0;
+  my_key[16] ^= 1;
+  my_key[0] ^= 1;
+  res += crypto_poly1305_restore(&my_ctx, &my_state[0], &my_key[0]) != -1;
+  my_key[0] ^= 1;
+  my_state[24] = 5;
+  res += crypto_poly1305_restore(&my_ctx, &my_state[0], &my_key[0]) != -1;
+  for (int i = 0 ; i + 4 <= CRYPTO_POLY1305_STATE_SIZE ; i++) {
+    res += memcmp(&my_state[i], &my_key[0], 4) == 0;
+    res += memcmp(&my_state[i], &my_key[16], 4) == 0;
+  }
+  crypto_wipe(&my_state[0], sizeof(my_state));
+
+  printf("testcase_checkpoint: Resuming the MAC of %s\n", my_file);
+  remove(my_index);
+  crypto_poly1305(&my_prefix_tag[0], &my_message[0], 10000, &my_key[0]);
+  if (write_message(my_file, &my_message[0], 10000) != 0 ||
+      poly1305_checkpoint_mac(&my_tag[0], my_file, &my_key[0], 4096,
+                              &my_resumed) != 0) {
+    printf("testcase_checkpoint: Could not MAC %s.\n", my_file);
+    TRACE_ON();
+    return res + 1;
+  }
+  res += check_tag(&my_tag[0], &my_prefix_tag[0]);
+  res += my_resumed != 0;
+
+  // Appended to, resumes from the checkpoint at the old end.
+  if (write_message(my_file, &my_message[0], 16384) != 0 ||
+      poly1305_checkpoint_mac(&my_tag[0], my_file, &my_key[0], 4096,
+                              &my_resumed) != 0) {
+    res++;
+  }
+  res += check_tag(&my_tag[0], &my_expected[0]);
+  if (my_resumed != 10000) {
+    printf("testcase_checkpoint: Resumed from %llu, expected 10000.\n",
+           (unsigned long long)my_resumed);
+    res++;
+  }
+
+  // Another key must not resume from the index.
+  my_key[0] ^= 1;
+  if (poly1305_checkpoint_mac(&my_tag[0], my_file, &my_key[0], 4096,
+                              &my_resumed) != 0 || my_resumed != 0) {
+    printf("testcase_checkpoint: Resumed with another key.\n");
+    res++;
+  }
+  my_key[0] ^= 1;
+
+  printf("testcase_checkpoint: Appending to %s 16 times\n", my_file);
+  remove(my_index);
+  for (size_t size = 1000 ; size <= 16000 ; size += 1000) {
+    crypto_poly1305(&my_prefix_tag[0], &my_message[0], size, &my_key[0]);
+    if (write_message(my_file, &my_message[0], size) != 0 ||
+        poly1305_checkpoint_mac(&my_tag[0], my_file, &my_key[0], 4096,
+                                &my_resumed) != 0) {
+      res++;
+      break;
+    }
+    res += check_tag(&my_tag[0], &my_prefix_tag[0]);
+    res += my_resumed != size - 1000;
+
+    // Header of 3 words, then the checkpoints at 4096, 8192 ... and
+    // at the end.
+    size_t nb_checkpoints = size / 4096 + (size % 4096 != 0);
+    long   index_size     = -1;
+    FILE  *f              = fopen(my_index, "rb");
+    if (f && fseek(f, 0, SEEK_END) == 0) {
+      index_size = ftell(f);
+    }
+    if (f) {
+      fclose(f);
+    }
+    if (index_size != (long)(12 + nb_checkpoints *
+                             (8 + CRYPTO_POLY1305_STATE_SIZE))) {
+      printf("testcase_checkpoint: Index of %ld bytes at size %zu.\n",
+             index_size, size);
+      res++;
+    }
+  }
+
+  // An index with a count of checkpoints that does not match its
+  // size is ignored.
+  FILE *f = fopen(my_index, "r+b");
+  if (!f || fseek(f, 8, SEEK_SET) != 0 ||
+      fwrite("\xff\xff\xff\xff", 1, 4, f) != 4) {
+    res++;
+  }
+  if (f) {
+    fclose(f);
+  }
+  if (poly1305_checkpoint_mac(&my_tag[0], my_file, &my_key[0], 4096,
+                              &my_resumed) != 0 || my_resumed != 0) {
+    printf("testcase_checkpoint: Resumed from a corrupt index.\n");
+    res++;
+  }
+  res += check_tag(&my_tag[0], &my_prefix_tag[0]);
+  TRACE_ON();
+
+  remove(my_file);
+  remove(my_index);
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_flow
+// MAC 100 flows with their own keys in a table of 64 slots, in
+// interleaved updates of varying size, both one at a time and in
+// batches, and check against crypto_poly1305(). Handles of finished
+// flows must be rejected after their slots are reused.
+//------------------------------------------------------------------
+int testcase_flow() {
+  static uint8_t my_message[4096];
+  static uint8_t my_keys[100][32];
+  poly1305_flow my_flows[100];
+  size_t my_done[100];
+  poly1305_flow my_batch[64];
+  uint8_t *my_messages[64];
+  size_t my_sizes[64];
+  uint8_t my_tag[16];
+  uint8_t my_expected[16];
+  int res = 0;
+
+  for (int i = 0 ; i < 4096 ; i++) {
+    my_message[i] = (uint8_t)(i * 13 + 5);
+  }
+  for (int i = 0 ; i < 100 ; i++) {
+    for (int j = 0 ; j < 32 ; j++) {
+      my_keys[i][j] = (uint8_t)(i * 31 + j * 7 + 1);
+    }
+  }
+
+  poly1305_flow_table *table = poly1305_flow_table_create(64);
+  if (!table) {
+    printf("testcase_flow: Could not create the table.\n");
+    return 1;
+  }
+
+  TRACE_OFF();
+  // Two rounds of flows, the second reusing the slots of the first.
+  for (int round = 0 ; round < 2 ; round++) {
+    int first = round * 50;
+    int batch = round == 1;
+    printf("testcase_flow: Flows %d to %d, %s updates\n", first, first + 49,
+           batch ? "batched" : "single");
+
+    for (int i = first ; i < first + 50 ; i++) {
+      my_flows[i] = poly1305_flow_open(table, my_keys[i]);
+      my_done[i]  = 0;
+      res += my_flows[i] == 0;
+    }
+
+    // Each flow i gets one to three times i % 37 + 1 bytes at a
+    // time, up to 4096 - i, until all flows are done.
+    size_t n = 1;
+    for (int step = 0 ; n > 0 ; step++) {
+      n = 0;
+      for (int i = first ; i < first + 50 ; i++) {
+        size_t total = 4096 - (size_t)i;
+        size_t size  = (size_t)(i % 37 + 1) * (size_t)(step % 3 + 1);
+        if (my_done[i] + size > total) {
+          size = total - my_done[i];
+        }
+        if (size == 0) {
+          continue;
+        }
+        if (batch) {
+          my_batch[n]    = my_flows[i];
+          my_messages[n] = &my_message[my_done[i]];
+          my_sizes[n]    = size;
+          n++;
+        }
+        else {
+          res += poly1305_flow_update(table, my_flows[i],
+                                      &my_message[my_done[i]], size) != 0;
+          n++;
+        }
+        my_done[i] += size;
+      }
+      if (batch) {
+        res += poly1305_flow_update_batch(table, my_batch, my_messages,
+                                          my_sizes, n) != 0;
+      }
+    }
+
+    for (int i = first ; i < first + 50 ; i++) {
+      crypto_poly1305(my_expected, my_message, 4096 - (size_t)i, my_keys[i]);
+      res += poly1305_flow_finish(table, my_flows[i], my_tag) != 0;
+      res += check_tag(my_tag, my_expected);
+    }
+  }
+  TRACE_ON();
+
+  if (poly1305_flow_update(table, my_flows[0], my_message, 16) != -1 ||
+      poly1305_flow_finish(table, my_flows[0], my_tag) != -1 ||
+      poly1305_flow_table_count(table) != 0) {
+    printf("testcase_flow: Handle of a finished flow accepted.\n");
+    res++;
+  }
+
+  poly1305_flow_table_destroy(table);
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_corpus
+// Run the corpus built from utils/poly1305_vectors.txt by the
+// Makefile on three threads. The first vectors are the ones of
+// testcase_0 and onwards.
+//------------------------------------------------------------------
+int testcase_corpus() {
+  const char *my_file = "poly1305_vectors.p13v";
+  poly1305_vector my_vector;
+  size_t my_first;
+  int res = 0;
+
+  printf("testcase_corpus: Checking the vectors in %s\n", my_file);
+  poly1305_corpus *corpus = poly1305_corpus_open(my_file);
+  if (!corpus) {
+    printf("testcase_corpus: No corpus, 'make %s' builds it.\n", my_file);
+    return 0;
+  }
+
+  TRACE_OFF();
+  size_t failures = poly1305_corpus_run(corpus, 3, &my_first);
+  TRACE_ON();
+  printf("testcase_corpus: %zu vectors, %zu failed.\n",
+         poly1305_corpus_count(corpus), failures);
+  if (failures > 0) {
+    printf("testcase_corpus: First failing vector: %zu\n", my_first);
+    res++;
+  }
+
+  // testcase_0: zero key and empty message.
+  if (poly1305_corpus_count(corpus) < 16 ||
+      poly1305_corpus_get(corpus, 0, &my_vector) != 0 ||
+      my_vector.message_size != 0 || my_vector.key[0] != 0 ||
+      poly1305_corpus_get(corpus, poly1305_corpus_count(corpus),
+                          &my_vector) != -1) {
+    printf("testcase_corpus: Bad vector index.\n");
+    res++;
+  }
+
+  poly1305_corpus_close(corpus);
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_parallel
+// MAC messages large enough to be split over a pool of three
+// threads and check against crypto_poly1305().
+//------------------------------------------------------------------
+int testcase_parallel() {
+  uint8_t my_key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+                        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+                        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+                        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+  size_t my_sizes[3] = {100000, 300005, 1048576};
+
+  static uint8_t my_message[1048576];
+  uint8_t my_tag[16];
+  uint8_t my_expected[16];
+  int res = 0;
+
+  for (int i = 0 ; i < 1048576 ; i++) {
+    my_message[i] = (uint8_t)(i * 7 + 3);
+  }
+
+  poly1305_pool *my_pool = poly1305_pool_create(3);
+  if (!my_pool) {
+    printf("testcase_parallel: Could not create the thread pool.\n");
+    return 1;
+  }
+
+  TRACE_OFF();
+  for (int i = 0 ; i < 3 ; i++) {
+    printf("testcase_parallel: Processing %zu byte message\n", my_sizes[i]);
+    crypto_poly1305(&my_expected[0], &my_message[0], my_sizes[i], &my_key[0]);
+    res += crypto_poly1305_parallel(my_pool, &my_tag[0], &my_message[0],
+                                    my_sizes[i], &my_key[0]) != 0;
+    res += check_tag(&my_tag[0], &my_expected[0]);
+  }
+
+  TRACE_ON();
+  poly1305_pool_destroy(my_pool);
+  return res;
+}
+
+
 //------------------------------------------------------------------
 //------------------------------------------------------------------
 int run_tests() {
@@ -1270,6 +2513,23 @@ int run_tests() {
   test_results += testcase_14();
   test_results += testcase_15();
   test_results += testcase_long();
+  test_results += testcase_bulk();
+  test_results += testcase_updatev();
+  test_results += testcase_update_copy();
+  test_results += testcase_aead();
+  test_results += testcase_small();
+  test_results += testcase_batch();
+  test_results += testcase_verify();
+  test_results += testcase_partial();
+  test_results += testcase_parallel();
+  test_results += testcase_service();
+  test_results += testcase_key_schedule();
+  test_results += testcase_max_limbs();
+  test_results += testcase_boundary_limbs();
+  test_results += testcase_trace();
+  test_results += testcase_checkpoint();
+  test_results += testcase_flow();
+  test_results += testcase_corpus();
 
   printf("Number of failing test cases: %d\n", test_results);
 
@@ -1279,10 +2539,25 @@ int run_tests() {
 
 //------------------------------------------------------------------
 // int main()
+//
+// Run all tests with every block kernel supported by the CPU.
 //------------------------------------------------------------------
 int main(void) {
+  int test_results = 0;
+  const char *kernel;
+
   printf("\nTest of Monocypher Poly1305 function.\n");
-  return run_tests();
+
+  for (size_t i = 0 ; (kernel = crypto_poly1305_kernel_name(i)) ; i++) {
+    if (crypto_poly1305_select_kernel(kernel) != 0) {
+      printf("\nKernel %s not usable on this CPU. Skipped.\n", kernel);
+      continue;
+    }
+    printf("\nRunning tests with kernel %s.\n", kernel);
+    test_results += run_tests();
+  }
+
+  return test_results;
 }
 
 //======================================================================
@@ -0,0 +1,269 @@
+//======================================================================
+//
+// test_poly1305_cpp.cpp
+// ---------------------
+// Tests of the C++ interface in poly1305.hpp against the C model.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+#include <vector>
+#include "poly1305.hpp"
+#include "poly1305_cycle.hpp"
+
+
+//------------------------------------------------------------------
+// RFC 8439, section 2.5.2. The tag is checked at compile time.
+//------------------------------------------------------------------
+constexpr std::array<std::uint8_t, 32> rfc_key = {
+  0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+  0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+  0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+  0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+
+constexpr std::array<std::uint8_t, 34> rfc_message = {
+  0x43, 0x72, 0x79, 0x70, 0x74, 0x6f, 0x67, 0x72,
+  0x61, 0x70, 0x68, 0x69, 0x63, 0x20, 0x46, 0x6f,
+  0x72, 0x75, 0x6d, 0x20, 0x52, 0x65, 0x73, 0x65,
+  0x61, 0x72, 0x63, 0x68, 0x20, 0x47, 0x72, 0x6f,
+  0x75, 0x70};
+
+constexpr poly1305::tag rfc_tag = {
+  0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6,
+  0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9};
+
+static_assert(poly1305::mac(rfc_message, rfc_key) == rfc_tag,
+              "RFC 8439 tag computed at compile time");
+static_assert(poly1305::mac<poly1305::kernel::library>(rfc_message, rfc_key) == rfc_tag,
+              "the library kernel falls back to inline32 at compile time");
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static int check(const char *what, const poly1305::tag &tag,
+                 const std::uint8_t *expected)
+{
+  if (crypto_verify16(tag.data(), expected) == 0) {
+    return 0;
+  }
+  std::printf("%s: Correct tag NOT generated.\n", what);
+  return 1;
+}
+
+
+//------------------------------------------------------------------
+// testcase_kernels
+// Both kernels and the incremental context against crypto_poly1305()
+// for every size up to 300 bytes, with several update sizes.
+//------------------------------------------------------------------
+static int testcase_kernels()
+{
+  std::vector<std::uint8_t> message(300);
+  std::array<std::uint8_t, 32> key;
+  std::uint8_t expected[16];
+  int res = 0;
+
+  for (std::size_t i = 0 ; i < message.size() ; i++) {
+    message[i] = (std::uint8_t)(i * 7 + 3);
+  }
+  for (std::size_t i = 0 ; i < 32 ; i++) {
+    key[i] = (std::uint8_t)(i * 13 + 5);
+  }
+
+  std::printf("testcase_kernels: Sizes 0 to 300 bytes\n");
+  for (std::size_t size = 0 ; size <= message.size() ; size++) {
+    crypto_poly1305(expected, message.data(), size, key.data());
+    std::span<const std::uint8_t> m(message.data(), size);
+
+    res += check("inline32", poly1305::mac<poly1305::kernel::inline32>(m, key),
+                 expected);
+    res += check("library", poly1305::mac<poly1305::kernel::library>(m, key),
+                 expected);
+    res += check("automatic", poly1305::mac(m, key), expected);
+
+    for (std::size_t chunk : {1, 15, 16, 17, 64}) {
+      poly1305::context ctx(key);
+      for (std::size_t i = 0 ; i < size ; i += chunk) {
+        ctx.update(m.subspan(i, std::min(chunk, size - i)));
+      }
+      res += check("context", ctx.finish(), expected);
+    }
+  }
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_fixed
+// Fixed size messages, which get their own code paths.
+//------------------------------------------------------------------
+template <std::size_t N>
+static int check_fixed(const std::array<std::uint8_t, 32> &key)
+{
+  std::array<std::uint8_t, N> message;
+  std::uint8_t expected[16];
+  int res = 0;
+
+  for (std::size_t i = 0 ; i < N ; i++) {
+    message[i] = (std::uint8_t)(i * 11 + 1);
+  }
+  crypto_poly1305(expected, message.data(), N,
+                  const_cast<std::uint8_t *>(key.data()));
+  res += check("fixed inline32", poly1305::mac<poly1305::kernel::inline32>(message, key),
+               expected);
+  res += check("fixed library", poly1305::mac<poly1305::kernel::library>(message, key),
+               expected);
+  res += check("fixed automatic", poly1305::mac(message, key), expected);
+  return res;
+}
+
+static int testcase_fixed()
+{
+  int res = 0;
+  std::printf("testcase_fixed: Sizes 0, 15, 16, 32, 64, 65 and 1000 bytes\n");
+  res += check_fixed<0>(rfc_key);
+  res += check_fixed<15>(rfc_key);
+  res += check_fixed<16>(rfc_key);
+  res += check_fixed<32>(rfc_key);
+  res += check_fixed<64>(rfc_key);
+  res += check_fixed<65>(rfc_key);
+  res += check_fixed<1000>(rfc_key);
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_move
+// Moving a context carries its state and leaves the source unusable.
+// Contexts from a key schedule.
+//------------------------------------------------------------------
+static int testcase_move()
+{
+  int res = 0;
+  std::printf("testcase_move: Moving contexts and key schedules\n");
+
+  poly1305::context a(rfc_key);
+  a.update(std::span(rfc_message).first(20));
+  poly1305::context b(std::move(a));
+  b.update(std::span(rfc_message).subspan(20));
+  if (!a.finished() || b.finished()) {
+    std::printf("testcase_move: Wrong state after the move.\n");
+    res++;
+  }
+  res += check("moved context", b.finish(), rfc_tag.data());
+
+  poly1305::key_schedule ks1(rfc_key);
+  poly1305::key_schedule ks2(std::move(ks1));
+  poly1305::context c(rfc_key);
+  c = poly1305::context(ks2);
+  c.update(rfc_message);
+  res += check("key schedule", c.finish(), rfc_tag.data());
+
+  if (!poly1305::verify(rfc_tag, rfc_message, rfc_key)) {
+    std::printf("testcase_move: verify() rejected the RFC tag.\n");
+    res++;
+  }
+  poly1305::tag bad = rfc_tag;
+  bad[15] ^= 0x80;
+  if (poly1305::verify(bad, rfc_message, rfc_key)) {
+    std::printf("testcase_move: verify() accepted a bad tag.\n");
+    res++;
+  }
+  return res;
+}
+
+
+//------------------------------------------------------------------
+// testcase_cycle
+// The cycle accurate model of poly1305_core against crypto_poly1305()
+// for sizes up to 100 bytes, and the cycles it takes against the
+// latencies derived from the FSMs, for the RTL timing and two
+// others.
+//------------------------------------------------------------------
+static int testcase_cycle()
+{
+  namespace cycle = poly1305::cycle;
+  std::vector<std::uint8_t> message(100);
+  std::array<std::uint8_t, 32> key;
+  std::uint8_t expected[16];
+  int res = 0;
+
+  for (std::size_t i = 0 ; i < message.size() ; i++) {
+    message[i] = (std::uint8_t)(i * 5 + 9);
+  }
+  for (std::size_t i = 0 ; i < 32 ; i++) {
+    key[i] = (std::uint8_t)(i * 3 + 1);
+  }
+
+  std::printf("testcase_cycle: Cycle accurate model of poly1305_core\n");
+  for (const cycle::timing &t : {cycle::timing{}, cycle::timing{3, 4, 1, 8},
+                                 cycle::timing{1, 2, 2, 6}}) {
+    cycle::core dut(t);
+    for (std::size_t size = 0 ; size <= message.size() ; size++) {
+      crypto_poly1305(expected, message.data(), size, key.data());
+      cycle::latency lat;
+      const std::uint64_t start = dut.cycles();
+      res += check("cycle model",
+                   cycle::mac(dut, std::span(message).first(size), key, &lat),
+                   expected);
+      if ((lat.total != cycle::message_cycles(t, size)) ||
+          (dut.cycles() - start != lat.total) ||
+          (lat.init != cycle::init_latency(t)) ||
+          (lat.next != cycle::next_latency(t, size < 16 ? (unsigned)size : 16)) ||
+          (lat.finish != cycle::finish_latency(t))) {
+        std::printf("testcase_cycle: Wrong latency for %zu bytes.\n", size);
+        res++;
+      }
+    }
+  }
+  return res;
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+int main()
+{
+  int test_results = 0;
+
+  std::printf("\nTest of the C++ Poly1305 interface.\n");
+  test_results += testcase_kernels();
+  test_results += testcase_fixed();
+  test_results += testcase_move();
+  test_results += testcase_cycle();
+  std::printf("Number of failing test cases: %d\n", test_results);
+
+  return test_results;
+}
+
+//======================================================================
+// EOF test_poly1305_cpp.cpp
+//======================================================================
@@ -5,6 +5,9 @@
 # extract_vectors.py
 # ------------------
 # Extract vectors from text file. Convert to C test cases or Verilog.
+# The vectors, optionally with random vectors added, can also be
+# written as a binary corpus for the model (see poly1305_corpus.h)
+# and as $readmemh images streamed by tb_poly1305_core.v.
 #
 #
 # Author: Joachim Strömbergson
@@ -41,9 +44,24 @@
 #-------------------------------------------------------------------
 # Python module imports.
 #-------------------------------------------------------------------
+import argparse
+import os
+import struct
 import sys
 
 
+#-------------------------------------------------------------------
+# Corpus format, see poly1305_corpus.h, and the layout of the
+# $readmemh images, see test_corpus in tb_poly1305_core.v.
+#-------------------------------------------------------------------
+CORPUS_MAGIC   = 0x56333150
+CORPUS_VERSION = 1
+
+MEMH_WORDS     = 65536
+MEMH_NEXT      = 0xfffffffe
+MEMH_END       = 0xffffffff
+
+
 #-------------------------------------------------------------------
 #-------------------------------------------------------------------
 def load_vectors(filename):
@@ -125,15 +143,140 @@ def gen_c_structs(i, v):
     print("")
     print("")
 
+#-------------------------------------------------------------------
+# poly1305()
+# Reference MAC with Python integers, used for random vectors.
+#-------------------------------------------------------------------
+def poly1305(key, message):
+    p = (1 << 130) - 5
+    r = int.from_bytes(key[:16], "little") & 0x0ffffffc0ffffffc0ffffffc0fffffff
+    s = int.from_bytes(key[16:], "little")
+    h = 0
+    for i in range(0, len(message), 16):
+        block = message[i : i + 16] + b"\x01"
+        h = ((h + int.from_bytes(block, "little")) * r) % p
+    return ((h + s) & ((1 << 128) - 1)).to_bytes(16, "little")
+
+
+#-------------------------------------------------------------------
+# binary_vectors()
+# The parsed text vectors as (key, message, tag) bytes, followed by
+# nb_random random vectors of up to max_size bytes.
+#-------------------------------------------------------------------
+def binary_vectors(vset, nb_random, max_size, seed):
+    import random
+    rng = random.Random(seed)
+    for (k, dl, d, m) in vset:
+        yield (bytes.fromhex(k), bytes.fromhex(d), bytes.fromhex(m))
+    for i in range(nb_random):
+        key = rng.randbytes(32)
+        message = rng.randbytes(rng.randint(0, max_size))
+        yield (key, message, poly1305(key, message))
+
+
+#-------------------------------------------------------------------
+# write_corpus()
+# Length prefixed records after a header, all little endian.
+#-------------------------------------------------------------------
+def write_corpus(filename, vectors):
+    n = 0
+    with open(filename, "wb") as f:
+        f.write(struct.pack("<III", CORPUS_MAGIC, CORPUS_VERSION, 0))
+        for (key, message, tag) in vectors:
+            f.write(struct.pack("<I", len(message)) + key + tag + message)
+            n += 1
+        f.seek(8)
+        f.write(struct.pack("<I", n))
+    return n
+
+
+#-------------------------------------------------------------------
+# write_memh()
+# $readmemh images of at most words 128 bit words each, named
+# prefix_000.memh and so on. Per vector a header word with the
+# message size in the top 32 bits, the key in two words, the
+# expected tag and the message blocks, at least one, with the first
+# byte in the most significant bits. Each image ends with a header
+# word of MEMH_NEXT, or MEMH_END for the last one.
+#-------------------------------------------------------------------
+def write_memh(prefix, vectors, words):
+    def vector_words(key, message, tag):
+        w = ["%08x%024x" % (len(message), 0), key[:16].hex(), key[16:].hex(),
+             tag.hex()]
+        padded = message + b"\x00" * ((-len(message)) % 16)
+        if len(padded) == 0:
+            padded = b"\x00" * 16
+        for i in range(0, len(padded), 16):
+            w.append(padded[i : i + 16].hex())
+        return w
+
+    images = []
+    current = []
+    for v in vectors:
+        w = vector_words(*v)
+        if len(w) + 1 > words:
+            raise ValueError("a %d byte message does not fit in %d words"
+                             % (len(v[1]), words))
+        if len(current) + len(w) + 1 > words:
+            images.append(current)
+            current = []
+        current += w
+    images.append(current)
+
+    for i, image in enumerate(images):
+        last = MEMH_END if i == len(images) - 1 else MEMH_NEXT
+        with open("%s_%03d.memh" % (prefix, i), "w") as f:
+            for word in image + ["%08x%024x" % (last, 0)]:
+                f.write(word + "\n")
+    return len(images)
+
+
 #-------------------------------------------------------------------
 # Main()
 #-------------------------------------------------------------------
 def main():
-    my_file = "poly1305_vectors.txt"
-    print("// Generated test vectors from the file %s." % my_file)
-    my_vectors = load_vectors(my_file)
+    parser = argparse.ArgumentParser(
+        description="Convert the Poly1305 test vectors. Without options "
+        "C test cases are printed.")
+    parser.add_argument("--vectors", default="poly1305_vectors.txt",
+                        metavar="FILE", help="text vectors to read")
+    parser.add_argument("--corpus", metavar="FILE",
+                        help="write a binary corpus for the model")
+    parser.add_argument("--memh", metavar="PREFIX",
+                        help="write $readmemh images for tb_poly1305_core")
+    parser.add_argument("--memh-words", type=int, default=MEMH_WORDS,
+                        metavar="N", help="words per image, as in the "
+                        "testbench (default %d)" % MEMH_WORDS)
+    parser.add_argument("--random", type=int, default=0, metavar="N",
+                        help="add N random vectors")
+    parser.add_argument("--max-size", type=int, default=1024, metavar="N",
+                        help="largest random message (default 1024)")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="seed of the random vectors")
+    args = parser.parse_args()
+
+    my_vectors = load_vectors(args.vectors)
     my_set = parse_vectors(my_vectors)
-    gen_c_code(my_set)
+    if not args.corpus and not args.memh:
+        print("// Generated test vectors from the file %s."
+              % os.path.basename(args.vectors))
+        gen_c_code(my_set)
+        return 0
+
+    try:
+        if args.corpus:
+            n = write_corpus(args.corpus, binary_vectors(
+                my_set, args.random, args.max_size, args.seed))
+            print("%d vectors written to %s." % (n, args.corpus))
+        if args.memh:
+            n = write_memh(args.memh, binary_vectors(
+                my_set, args.random, args.max_size, args.seed),
+                args.memh_words)
+            print("%d images written to %s_*.memh." % (n, args.memh))
+    except (OSError, ValueError) as e:
+        print(e, file=sys.stderr)
+        return 2
+    return 0
 
 #-------------------------------------------------------------------
 # __name__
@@ -141,8 +284,7 @@ def main():
 # well as parsed from within a Python interpreter.
 #-------------------------------------------------------------------
 if __name__=="__main__":
-    main()
-    sys.exit(0)
+    sys.exit(main())
 
 
 #=======================================================================
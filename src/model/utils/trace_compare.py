@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#=======================================================================
+#
+# trace_compare.py
+# ----------------
+# Compare two binary traces of the Poly1305 intermediate values and
+# report the first block and value where they diverge. The traces
+# are written by the C model (poly1305trace, or poly1305_trace_open())
+# and by the pblock, final and core testbenches run with
+# +trace=<file>. See poly1305_trace.h for the format.
+#
+#
+# Copyright (c) 2026, Secworks Sweden AB
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or
+# without modification, are permitted provided that the following
+# conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in
+#    the documentation and/or other materials provided with the
+#    distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+# STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+#=======================================================================
+
+#-------------------------------------------------------------------
+# Python module imports.
+#-------------------------------------------------------------------
+import argparse
+import struct
+import sys
+
+
+#-------------------------------------------------------------------
+# Trace format, see poly1305_trace.h.
+#-------------------------------------------------------------------
+TRACE_MAGIC   = 0x54333150
+TRACE_VERSION = 1
+
+KIND_BLOCK = 1
+KIND_FINAL = 2
+
+FIELDS = {
+    KIND_BLOCK : ["s0", "s1", "s2", "s3", "s4",
+                  "rr0", "rr1", "rr2", "rr3",
+                  "x0", "x1", "x2", "x3", "x4",
+                  "u0", "u1", "u2", "u3", "u4", "u5"],
+    KIND_FINAL : ["u0", "u1", "u2", "u3", "u4",
+                  "uu0", "uu1", "uu2", "uu3"]
+}
+
+KIND_NAMES = {KIND_BLOCK : "block", KIND_FINAL : "final"}
+
+
+#-------------------------------------------------------------------
+# load_trace()
+# Returns a list of (kind, index, mac, block, values) records.
+# mac and block are counted here, as the index of a record from a
+# block level testbench does not restart at each MAC.
+#-------------------------------------------------------------------
+def load_trace(filename):
+    with open(filename, 'rb') as f:
+        data = f.read()
+
+    if len(data) < 8:
+        raise ValueError("%s: too short for a trace" % filename)
+    magic, version = struct.unpack_from("<II", data, 0)
+    if magic != TRACE_MAGIC:
+        raise ValueError("%s: not a Poly1305 trace" % filename)
+    if version != TRACE_VERSION:
+        raise ValueError("%s: unsupported trace version %d" % (filename, version))
+
+    records = []
+    mac = 0
+    block = 0
+    pos = 8
+    while pos + 12 <= len(data):
+        kind, index, n = struct.unpack_from("<III", data, pos)
+        pos += 12
+        if kind not in FIELDS or n != len(FIELDS[kind]):
+            raise ValueError("%s: bad record at offset %d" % (filename, pos - 12))
+        if pos + 8 * n > len(data):
+            raise ValueError("%s: truncated record at offset %d" % (filename, pos - 12))
+        values = list(struct.unpack_from("<%dQ" % n, data, pos))
+        pos += 8 * n
+        records.append((kind, index, mac, block, values))
+        if kind == KIND_BLOCK:
+            block += 1
+        else:
+            mac += 1
+            block = 0
+    if pos != len(data):
+        raise ValueError("%s: trailing data at offset %d" % (filename, pos))
+    return records
+
+
+#-------------------------------------------------------------------
+# select()
+# Drop the MACs before skip, and the records of other kinds.
+#-------------------------------------------------------------------
+def select(records, skip, kind):
+    return [r for r in records
+            if r[2] >= skip and (kind is None or r[0] == kind)]
+
+
+#-------------------------------------------------------------------
+#-------------------------------------------------------------------
+def describe(record):
+    kind, index, mac, block, values = record
+    if kind == KIND_BLOCK:
+        return "MAC %d block %d" % (mac, block)
+    return "MAC %d final" % mac
+
+
+#-------------------------------------------------------------------
+# compare()
+# Returns 0 if the traces match, 1 otherwise.
+#-------------------------------------------------------------------
+def compare(name_a, a, name_b, b):
+    for i in range(min(len(a), len(b))):
+        if a[i][0] != b[i][0]:
+            print("Record %d differs: %s is %s, %s is %s record (%s)." %
+                  (i, name_a, KIND_NAMES[a[i][0]], name_b,
+                   KIND_NAMES[b[i][0]], describe(a[i])))
+            return 1
+
+        names = FIELDS[a[i][0]]
+        for j in range(len(names)):
+            if a[i][4][j] != b[i][4][j]:
+                print("First divergence in record %d, %s, value %s:" %
+                      (i, describe(a[i]), names[j]))
+                print("  %-20s 0x%016x" % (name_a, a[i][4][j]))
+                print("  %-20s 0x%016x" % (name_b, b[i][4][j]))
+                print("All values of the record:")
+                for k in range(len(names)):
+                    mark = "*" if a[i][4][k] != b[i][4][k] else " "
+                    print("  %s %-4s 0x%016x 0x%016x" %
+                          (mark, names[k], a[i][4][k], b[i][4][k]))
+                return 1
+
+    if len(a) != len(b):
+        short, name = (a, name_a) if len(a) < len(b) else (b, name_b)
+        print("The traces match for %d records, then %s ends." %
+              (len(short), name))
+        return 1
+
+    print("The traces match, %d records." % len(a))
+    return 0
+
+
+#-------------------------------------------------------------------
+# Main()
+#-------------------------------------------------------------------
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compare two Poly1305 intermediate value traces.")
+    parser.add_argument("trace_a", help="first trace, e.g. from the model")
+    parser.add_argument("trace_b", help="second trace, e.g. from the RTL")
+    parser.add_argument("--skip-a", type=int, default=0, metavar="N",
+                        help="skip the first N MACs of the first trace")
+    parser.add_argument("--skip-b", type=int, default=0, metavar="N",
+                        help="skip the first N MACs of the second trace")
+    parser.add_argument("--only", choices=["block", "final"],
+                        help="compare only block or final records, for "
+                        "traces from the pblock and final testbenches")
+    args = parser.parse_args()
+
+    kind = {None : None, "block" : KIND_BLOCK, "final" : KIND_FINAL}[args.only]
+    try:
+        a = select(load_trace(args.trace_a), args.skip_a, kind)
+        b = select(load_trace(args.trace_b), args.skip_b, kind)
+    except (OSError, ValueError) as e:
+        print(e, file=sys.stderr)
+        return 2
+    return compare(args.trace_a, a, args.trace_b, b)
+
+
+#-------------------------------------------------------------------
+# __name__
+# Python thingy which allows the file to be run standalone as
+# well as parsed from within a Python interpreter.
+#-------------------------------------------------------------------
+if __name__=="__main__":
+    sys.exit(main())
+
+
+#=======================================================================
+# EOF trace_compare.py
+#=======================================================================
@@ -51,6 +51,7 @@ module tb_poly1305_core();
   // Register and Wire declarations.
   //----------------------------------------------------------------
   reg [31 : 0]   cycle_ctr;
+  reg [31 : 0]   op_cycles;
   reg [31 : 0]   error_ctr;
   reg [31 : 0]   tc_ctr;
   reg            tc_correct;
@@ -74,6 +75,32 @@ module tb_poly1305_core();
   wire [127 : 0] tb_mac;
 
 
+  //----------------------------------------------------------------
+  // Binary trace of the intermediate values, written when the
+  // simulation is run with +trace=<file>. The writer is shared
+  // by the testbenches, see tb_poly1305_trace.vh.
+  //----------------------------------------------------------------
+  `include "tb_poly1305_trace.vh"
+
+  reg            trace_pblock_ready;
+  reg            trace_final_ready;
+
+
+  //----------------------------------------------------------------
+  // Vector corpus, streamed from $readmemh images written by
+  // src/model/utils/extract_vectors.py --memh when the simulation
+  // is run with +corpus=<prefix>. CORPUS_WORDS must match the
+  // --memh-words of the images.
+  //----------------------------------------------------------------
+  localparam CORPUS_WORDS = 65536;
+  localparam CORPUS_NEXT  = 32'hfffffffe;
+  localparam CORPUS_END   = 32'hffffffff;
+
+  reg [127 : 0]  corpus_mem [0 : (CORPUS_WORDS - 1)];
+  reg [2047 : 0] corpus_prefix;
+  reg [2047 : 0] corpus_image;
+
+
   //----------------------------------------------------------------
   // Device Under Test.
   //----------------------------------------------------------------
@@ -282,6 +309,84 @@ module tb_poly1305_core();
   endtask // display_test_results
 
 
+  //----------------------------------------------------------------
+  // trace_monitor
+  //
+  // When ready is set again the registers hold the final values
+  // of the operation, sample them before the next clock edge
+  // updates anything.
+  //----------------------------------------------------------------
+  always @ (posedge tb_clk)
+    begin : trace_monitor
+      if ((trace_fd != 0) && dut.pblock_inst.ready && !trace_pblock_ready)
+        trace_block();
+      trace_pblock_ready = dut.pblock_inst.ready;
+      if ((trace_fd != 0) && dut.final_inst.ready && !trace_final_ready)
+        trace_final();
+      trace_final_ready = dut.final_inst.ready;
+    end // trace_monitor
+
+
+  //----------------------------------------------------------------
+  // trace_block()
+  //
+  // Write the intermediate values of the block just processed.
+  //----------------------------------------------------------------
+  task trace_block;
+    begin
+      trace_word(TRACE_BLOCK);
+      trace_word(trace_blocks);
+      trace_word(32'd20);
+      trace_value(dut.pblock_inst.s0_reg);
+      trace_value(dut.pblock_inst.s1_reg);
+      trace_value(dut.pblock_inst.s2_reg);
+      trace_value(dut.pblock_inst.s3_reg);
+      trace_value(dut.pblock_inst.s4_reg);
+      trace_value({32'h0, dut.pblock_inst.rr0_reg});
+      trace_value({32'h0, dut.pblock_inst.rr1_reg});
+      trace_value({32'h0, dut.pblock_inst.rr2_reg});
+      trace_value({32'h0, dut.pblock_inst.rr3_reg});
+      trace_value(dut.pblock_inst.x0_new);
+      trace_value(dut.pblock_inst.x1_new);
+      trace_value(dut.pblock_inst.x2_new);
+      trace_value(dut.pblock_inst.x3_new);
+      trace_value(dut.pblock_inst.x4_reg);
+      trace_value(dut.pblock_inst.u0_reg);
+      trace_value(dut.pblock_inst.u1_reg);
+      trace_value(dut.pblock_inst.u2_reg);
+      trace_value(dut.pblock_inst.u3_reg);
+      trace_value({32'h0, dut.pblock_inst.u4_reg});
+      trace_value(dut.pblock_inst.u5_reg);
+      trace_blocks = trace_blocks + 1;
+    end
+  endtask // trace_block
+
+
+  //----------------------------------------------------------------
+  // trace_final()
+  //
+  // Write the intermediate values of the final step just done.
+  //----------------------------------------------------------------
+  task trace_final;
+    begin
+      trace_word(TRACE_FINAL);
+      trace_word(trace_macs);
+      trace_word(32'd9);
+      trace_value(dut.final_inst.u0_reg);
+      trace_value(dut.final_inst.u1_reg);
+      trace_value(dut.final_inst.u2_reg);
+      trace_value(dut.final_inst.u3_reg);
+      trace_value(dut.final_inst.u4_reg);
+      trace_value(dut.final_inst.uu0_reg);
+      trace_value(dut.final_inst.uu1_reg);
+      trace_value(dut.final_inst.uu2_reg);
+      trace_value(dut.final_inst.uu3_reg);
+      trace_macs   = trace_macs + 1;
+      trace_blocks = 32'h0;
+    end
+  endtask // trace_final
+
+
   //----------------------------------------------------------------
   // init_sim()
   //
@@ -341,12 +446,18 @@ module tb_poly1305_core();
   //----------------------------------------------------------------
   // wait_ready()
   //
-  // Wait for the ready flag to be set in dut.
+  // Wait for the ready flag to be set in dut. op_cycles is set
+  // to the latency of the operation, from the cycle the command is
+  // sampled in to the cycle ready is set.
   //----------------------------------------------------------------
   task wait_ready;
     begin : wready
+      op_cycles = 1;
       while (!tb_ready)
-        #(CLK_PERIOD);
+        begin
+          #(CLK_PERIOD);
+          op_cycles = op_cycles + 1;
+        end
     end
   endtask // wait_ready
 
@@ -1462,6 +1573,9 @@ module tb_poly1305_core();
   task testcase_long;
     begin : testcase_long
       integer i;
+      integer init_cycles;
+      integer next_cycles;
+      integer total_cycles;
 
       tb_debug  = 0;
       tb_pblock = 0;
@@ -1477,6 +1591,8 @@ module tb_poly1305_core();
       #(CLK_PERIOD);
       tb_init = 0;
       wait_ready();
+      init_cycles  = op_cycles;
+      total_cycles = op_cycles;
 
       for (i = 0 ; i < 64 ; i = i + 1)
         begin
@@ -1487,6 +1603,9 @@ module tb_poly1305_core();
           #(CLK_PERIOD);
           tb_next = 0;
           wait_ready();
+          if (i == 0)
+            next_cycles = op_cycles;
+          total_cycles = total_cycles + op_cycles;
         end
 
       $display("*** testcase_long: Processing final block");
@@ -1496,12 +1615,18 @@ module tb_poly1305_core();
       #(CLK_PERIOD);
       tb_next = 0;
       wait_ready();
+      total_cycles = total_cycles + op_cycles;
 
       $display("*** testcase_long: Running finish()");
       tb_finish = 1;
       #(CLK_PERIOD);
       tb_finish = 0;
       wait_ready();
+      total_cycles = total_cycles + op_cycles;
+
+      // Same format as poly1305cycle in src/model.
+      $display("*** testcase_long: init %0d, next %0d, finish %0d, total %0d cycles.",
+               init_cycles, next_cycles, op_cycles, total_cycles);
 
       $display("*** testcase_long: Checking the generated MAC.");
       if (tb_mac == 128'hdc0964e5ce9cd7d9a7571fafa5dc0473)
@@ -1522,6 +1647,115 @@ module tb_poly1305_core();
   endtask // testcase_long
 
 
+  //----------------------------------------------------------------
+  // test_corpus;
+  //
+  // Run every vector of the corpus given with +corpus=<prefix>,
+  // loading the images <prefix>_000.memh, <prefix>_001.memh and so
+  // on in turn. A vector is a header word with the message size in
+  // the top 32 bits, the key in two words, the expected MAC and at
+  // least one message block. A header of CORPUS_NEXT ends an image
+  // with more images to follow, CORPUS_END the last image.
+  //----------------------------------------------------------------
+  task test_corpus;
+    begin : test_corpus
+      integer image;
+      integer addr;
+      integer block;
+      integer nb_blocks;
+      integer nb_vectors;
+      integer nb_errors;
+      reg [31 : 0] size;
+      reg [31 : 0] header;
+
+      if ($value$plusargs("corpus=%s", corpus_prefix))
+        begin
+          $display("*** test_corpus started.");
+          inc_tc_ctr();
+
+          tb_debug   = 0;
+          tb_pblock  = 0;
+          tb_final   = 0;
+          image      = 0;
+          nb_vectors = 0;
+          nb_errors  = 0;
+          header     = CORPUS_NEXT;
+
+          while (header == CORPUS_NEXT)
+            begin
+              $sformat(corpus_image, "%0s_%03d.memh", corpus_prefix, image);
+              $display("*** test_corpus: Loading %0s", corpus_image);
+              corpus_mem[0] = {CORPUS_END, 96'h0};
+              $readmemh(corpus_image, corpus_mem);
+              addr   = 0;
+              header = corpus_mem[0][127 : 96];
+
+              while (header < CORPUS_NEXT)
+                begin
+                  size      = header;
+                  nb_blocks = (size == 0) ? 1 : (size + 15) / 16;
+                  tb_key    = {corpus_mem[addr + 1], corpus_mem[addr + 2]};
+
+                  tb_init = 1;
+                  #(CLK_PERIOD);
+                  tb_init = 0;
+                  wait_ready();
+
+                  for (block = 0 ; block < nb_blocks ; block = block + 1)
+                    begin
+                      tb_block = corpus_mem[addr + 4 + block];
+                      if (block == nb_blocks - 1)
+                        tb_blocklen = size - 16 * block;
+                      else
+                        tb_blocklen = 5'h10;
+                      tb_next = 1;
+                      #(CLK_PERIOD);
+                      tb_next = 0;
+                      wait_ready();
+                    end
+
+                  tb_finish = 1;
+                  #(CLK_PERIOD);
+                  tb_finish = 0;
+                  wait_ready();
+                  #(CLK_PERIOD);
+
+                  if (tb_mac != corpus_mem[addr + 3])
+                    begin
+                      if (nb_errors < 10)
+                        begin
+                          $display("*** test_corpus: Error in vector %0d, %0d bytes.",
+                                   nb_vectors, size);
+                          $display("*** test_corpus: Expected: 0x%032x",
+                                   corpus_mem[addr + 3]);
+                          $display("*** test_corpus: Got:      0x%032x", tb_mac);
+                        end
+                      nb_errors = nb_errors + 1;
+                    end
+
+                  nb_vectors = nb_vectors + 1;
+                  addr       = addr + 4 + nb_blocks;
+                  header     = corpus_mem[addr][127 : 96];
+                end
+
+              image = image + 1;
+            end
+
+          if (nb_vectors == 0)
+            begin
+              $display("*** test_corpus: Error. No vectors in %0s.", corpus_image);
+              nb_errors = 1;
+            end
+          error_ctr = error_ctr + nb_errors;
+
+          $display("*** test_corpus: %0d vectors in %0d images, %0d errors.",
+                   nb_vectors, image, nb_errors);
+          $display("*** test_corpus completed.\n");
+        end
+    end
+  endtask // test_corpus
+
+
   //----------------------------------------------------------------
   // main
   //
@@ -1533,6 +1767,7 @@ module tb_poly1305_core();
       $display("");
 
       init_sim();
+      trace_open();
       reset_dut();
 
       tb_pblock = 1;
@@ -1556,10 +1791,12 @@ module tb_poly1305_core();
       testcase_11();
       testcase_12();
       testcase_long();
+      test_corpus();
 
       display_test_results();
 
       $display("*** Testbench for poly1305_core done ***");
+      trace_close();
       $finish;
     end // main
 
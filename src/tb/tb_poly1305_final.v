@@ -86,6 +86,16 @@ module tb_poly1305_final();
   wire [31 : 0] tb_hres3;
 
 
+  //----------------------------------------------------------------
+  // Binary trace of the intermediate values, written when the
+  // simulation is run with +trace=<file>. The writer is shared
+  // by the testbenches, see tb_poly1305_trace.vh.
+  //----------------------------------------------------------------
+  `include "tb_poly1305_trace.vh"
+
+  reg            trace_ready;
+
+
   //----------------------------------------------------------------
   // Device Under Test.
   //----------------------------------------------------------------
@@ -210,6 +220,46 @@ module tb_poly1305_final();
   endtask // wait_ready
 
 
+  //----------------------------------------------------------------
+  // trace_monitor
+  //
+  // When ready is set again the registers hold the final values
+  // of the operation, sample them before the next clock edge
+  // updates anything.
+  //----------------------------------------------------------------
+  always @ (posedge tb_clk)
+    begin : trace_monitor
+      if ((trace_fd != 0) && tb_ready && !trace_ready)
+        trace_final();
+      trace_ready = tb_ready;
+    end // trace_monitor
+
+
+  //----------------------------------------------------------------
+  // trace_final()
+  //
+  // Write the intermediate values of the final step just done.
+  //----------------------------------------------------------------
+  task trace_final;
+    begin
+      trace_word(TRACE_FINAL);
+      trace_word(trace_macs);
+      trace_word(32'd9);
+      trace_value(dut.u0_reg);
+      trace_value(dut.u1_reg);
+      trace_value(dut.u2_reg);
+      trace_value(dut.u3_reg);
+      trace_value(dut.u4_reg);
+      trace_value(dut.uu0_reg);
+      trace_value(dut.uu1_reg);
+      trace_value(dut.uu2_reg);
+      trace_value(dut.uu3_reg);
+      trace_macs   = trace_macs + 1;
+      trace_blocks = 32'h0;
+    end
+  endtask // trace_final
+
+
   //----------------------------------------------------------------
   // init_sim()
   //
@@ -413,6 +463,7 @@ module tb_poly1305_final();
       $display("*** Poly1305 final simulation started.\n");
 
       init_sim();
+      trace_open();
       dump_dut_state();
       reset_dut();
       dump_dut_state();
@@ -425,6 +476,7 @@ module tb_poly1305_final();
 
       $display("");
       $display("*** Poly1305 final simulation done.\n");
+      trace_close();
       $finish;
     end // poly1305_final_test
 endmodule // tb_tb_poly1305_final
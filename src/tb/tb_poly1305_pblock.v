@@ -94,6 +94,16 @@ module tb_poly1305_pblock();
   wire [31 : 0] tb_h4_new;
 
 
+  //----------------------------------------------------------------
+  // Binary trace of the intermediate values, written when the
+  // simulation is run with +trace=<file>. The writer is shared
+  // by the testbenches, see tb_poly1305_trace.vh.
+  //----------------------------------------------------------------
+  `include "tb_poly1305_trace.vh"
+
+  reg            trace_ready;
+
+
   //----------------------------------------------------------------
   // Device Under Test.
   //----------------------------------------------------------------
@@ -224,6 +234,56 @@ module tb_poly1305_pblock();
   endtask // dump_dut_state
 
 
+  //----------------------------------------------------------------
+  // trace_monitor
+  //
+  // When ready is set again the registers hold the final values
+  // of the operation, sample them before the next clock edge
+  // updates anything.
+  //----------------------------------------------------------------
+  always @ (posedge tb_clk)
+    begin : trace_monitor
+      if ((trace_fd != 0) && tb_ready && !trace_ready)
+        trace_block();
+      trace_ready = tb_ready;
+    end // trace_monitor
+
+
+  //----------------------------------------------------------------
+  // trace_block()
+  //
+  // Write the intermediate values of the block just processed.
+  //----------------------------------------------------------------
+  task trace_block;
+    begin
+      trace_word(TRACE_BLOCK);
+      trace_word(trace_blocks);
+      trace_word(32'd20);
+      trace_value(dut.s0_reg);
+      trace_value(dut.s1_reg);
+      trace_value(dut.s2_reg);
+      trace_value(dut.s3_reg);
+      trace_value(dut.s4_reg);
+      trace_value({32'h0, dut.rr0_reg});
+      trace_value({32'h0, dut.rr1_reg});
+      trace_value({32'h0, dut.rr2_reg});
+      trace_value({32'h0, dut.rr3_reg});
+      trace_value(dut.x0_new);
+      trace_value(dut.x1_new);
+      trace_value(dut.x2_new);
+      trace_value(dut.x3_new);
+      trace_value(dut.x4_reg);
+      trace_value(dut.u0_reg);
+      trace_value(dut.u1_reg);
+      trace_value(dut.u2_reg);
+      trace_value(dut.u3_reg);
+      trace_value({32'h0, dut.u4_reg});
+      trace_value(dut.u5_reg);
+      trace_blocks = trace_blocks + 1;
+    end
+  endtask // trace_block
+
+
   //----------------------------------------------------------------
   // init_sim()
   //
@@ -568,6 +628,7 @@ module tb_poly1305_pblock();
       $display("*** Poly1305 pblock simulation started.\n");
 
       init_sim();
+      trace_open();
       dump_dut_state();
       reset_dut();
       dump_dut_state();
@@ -581,6 +642,7 @@ module tb_poly1305_pblock();
 
       $display("");
       $display("*** Poly1305 pblock simulation done.\n");
+      trace_close();
       $finish;
     end // poly1305_pblock_test
 endmodule // tb_tb_poly1305_pblock
@@ -0,0 +1,118 @@
+//======================================================================
+//
+// tb_poly1305_trace.vh
+// --------------------
+// Binary trace writer shared by the pblock, final and core
+// testbenches. Included inside the testbench module, which writes
+// its records with trace_word() and trace_value() and keeps its own
+// ready flags. The format is the one of the C model:
+//
+//   header: magic, version
+//   record: kind, index, nb_values, nb_values 64 bit values
+//
+// all as little endian 32 bit words, see src/model/poly1305_trace.h.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+  localparam TRACE_MAGIC   = 32'h54333150;
+  localparam TRACE_VERSION = 32'h1;
+  localparam TRACE_BLOCK   = 32'h1;
+  localparam TRACE_FINAL   = 32'h2;
+
+  integer        trace_fd;
+  reg [2047 : 0] trace_name;
+  reg [31 : 0]   trace_blocks;
+  reg [31 : 0]   trace_macs;
+
+
+  //----------------------------------------------------------------
+  // trace_open()
+  //
+  // Open the trace file given with +trace=<file>, if any.
+  //----------------------------------------------------------------
+  task trace_open;
+    begin
+      trace_fd     = 0;
+      trace_blocks = 32'h0;
+      trace_macs   = 32'h0;
+      if ($value$plusargs("trace=%s", trace_name))
+        begin
+          trace_fd = $fopen(trace_name, "wb");
+          if (trace_fd == 0)
+            $display("*** Could not open the trace file %0s.", trace_name);
+          else
+            begin
+              trace_word(TRACE_MAGIC);
+              trace_word(TRACE_VERSION);
+            end
+        end
+    end
+  endtask // trace_open
+
+
+  //----------------------------------------------------------------
+  // trace_close()
+  //----------------------------------------------------------------
+  task trace_close;
+    begin
+      if (trace_fd != 0)
+        $fclose(trace_fd);
+      trace_fd = 0;
+    end
+  endtask // trace_close
+
+
+  //----------------------------------------------------------------
+  // trace_word()
+  //
+  // Write a 32 bit word. %u writes the raw little endian bytes.
+  //----------------------------------------------------------------
+  task trace_word(input [31 : 0] word);
+    begin
+      $fwrite(trace_fd, "%u", word);
+    end
+  endtask // trace_word
+
+
+  //----------------------------------------------------------------
+  // trace_value()
+  //
+  // Write a 64 bit value, low word first.
+  //----------------------------------------------------------------
+  task trace_value(input [63 : 0] value);
+    begin
+      trace_word(value[31 : 0]);
+      trace_word(value[63 : 32]);
+    end
+  endtask // trace_value
+
+//======================================================================
+// EOF tb_poly1305_trace.vh
+//======================================================================
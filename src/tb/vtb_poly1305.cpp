@@ -0,0 +1,625 @@
+//======================================================================
+//
+// vtb_poly1305.cpp
+// ----------------
+// Verilator harness for poly1305_core, or the poly1305 top level
+// wrapper when built with VTB_TOP defined. Large sets of random
+// messages and corpus vectors are MACed on the DUT and every tag
+// is checked against the C model. The work is sharded over a
+// number of threads, each with its own Verilated model. The core
+// is also run in lockstep with the cycle accurate model in
+// src/model/poly1305_cycle.hpp, comparing ready every cycle.
+//
+// The Verilated model is expected to be built with --prefix Vdut,
+// see vtb-core and vtb-top in toolruns/Makefile.
+//
+// Copyright (c) 2026, Secworks Sweden AB
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted provided that the following
+// conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//======================================================================
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "verilated.h"
+#include "Vdut.h"
+
+#include "monocypher.h"
+#include "poly1305_corpus.h"
+#include "poly1305_cycle.hpp"
+
+namespace cycle = poly1305::cycle;
+
+// Failures printed in full, the rest are only counted.
+#define VTB_MAX_REPORTS 10
+
+
+//------------------------------------------------------------------
+// Helpers.
+//------------------------------------------------------------------
+static std::uint32_t load32_be(const std::uint8_t *p)
+{
+  return ((std::uint32_t)p[0] << 24) | ((std::uint32_t)p[1] << 16) |
+         ((std::uint32_t)p[2] <<  8) |  (std::uint32_t)p[3];
+}
+
+static void store32_be(std::uint8_t *p, std::uint32_t w)
+{
+  p[0] = (std::uint8_t)(w >> 24);
+  p[1] = (std::uint8_t)(w >> 16);
+  p[2] = (std::uint8_t)(w >>  8);
+  p[3] = (std::uint8_t)w;
+}
+
+// SplitMix64, so that random message i is the same whatever the
+// number of threads and the range each of them gets.
+static std::uint64_t splitmix64(std::uint64_t &state)
+{
+  std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+
+//------------------------------------------------------------------
+// Drivers. Both run a whole MAC on the DUT and return the tag,
+// with the key, block and mac ports as in the testbenches: the
+// first byte in the most significant bits.
+//------------------------------------------------------------------
+#ifndef VTB_TOP
+
+//------------------------------------------------------------------
+// core_driver
+// Drives the poly1305_core ports directly, as test_corpus in
+// tb_poly1305_core.v, and clocks the cycle accurate model with
+// the same inputs every cycle.
+//------------------------------------------------------------------
+class core_driver {
+public:
+  core_driver(VerilatedContext *context, const cycle::timing &t)
+    : dut_(context, "dut"), model_(t) {}
+
+  std::uint64_t cycles()     const { return cycles_; }
+  std::uint64_t mismatches() const { return mismatches_; }
+
+  void reset()
+  {
+    dut_.clk     = 0;
+    dut_.reset_n = 0;
+    dut_.init    = 0;
+    dut_.next    = 0;
+    dut_.finish  = 0;
+    dut_.eval();
+    for (int i = 0 ; i < 4 ; i++) {
+      edge();
+    }
+    dut_.reset_n = 1;
+    dut_.eval();
+  }
+
+  void mac(std::uint8_t tag[16], const std::uint8_t *message,
+           std::size_t size, const std::uint8_t key[32])
+  {
+    for (int i = 0 ; i < 32 ; i++) {
+      key_[i] = key[i];
+    }
+    for (int w = 0 ; w < 8 ; w++) {
+      dut_.key[7 - w] = load32_be(&key[4 * w]);
+    }
+    command(init_, cycle::init_latency(model_.params()));
+
+    std::size_t i = 0;
+    do {
+      const std::size_t len = std::min<std::size_t>(16, size - i);
+      block_ = {};
+      std::copy(message + i, message + i + len, block_.begin());
+      for (int w = 0 ; w < 4 ; w++) {
+        dut_.block[3 - w] = load32_be(&block_[4 * w]);
+      }
+      blocklen_     = (unsigned)len;
+      dut_.blocklen = (CData)len;
+      command(next_, cycle::next_latency(model_.params(), blocklen_));
+      i += 16;
+    } while (i < size);
+
+    command(finish_, cycle::finish_latency(model_.params()));
+    for (int w = 0 ; w < 4 ; w++) {
+      store32_be(&tag[4 * w], dut_.mac[3 - w]);
+    }
+    if (std::memcmp(tag, model_.mac().data(), 16) != 0) {
+      mismatches_++;
+    }
+  }
+
+private:
+  // One rising and one falling edge of clk.
+  void edge()
+  {
+    dut_.clk = 1;
+    dut_.eval();
+    dut_.clk = 0;
+    dut_.eval();
+  }
+
+  void tick()
+  {
+    edge();
+    model_.clock(init_, next_, finish_, key_, block_, blocklen_);
+    if ((bool)dut_.ready != model_.ready()) {
+      mismatches_++;
+    }
+    cycles_++;
+  }
+
+  // Assert a command for one cycle and wait for ready, as
+  // wait_ready() in tb_poly1305_core.v. A latency other than the
+  // one derived from the FSMs is a mismatch.
+  void command(bool &cmd, unsigned expected)
+  {
+    cmd         = true;
+    dut_.init   = init_;
+    dut_.next   = next_;
+    dut_.finish = finish_;
+    tick();
+    cmd         = false;
+    dut_.init   = 0;
+    dut_.next   = 0;
+    dut_.finish = 0;
+
+    unsigned latency = 1;
+    while (!dut_.ready) {
+      tick();
+      latency++;
+    }
+    if (latency != expected) {
+      mismatches_++;
+    }
+  }
+
+  Vdut        dut_;
+  cycle::core model_;
+
+  bool init_   = false;
+  bool next_   = false;
+  bool finish_ = false;
+  std::array<std::uint8_t, 32> key_   = {};
+  std::array<std::uint8_t, 16> block_ = {};
+  unsigned                     blocklen_ = 0;
+
+  std::uint64_t cycles_     = 0;
+  std::uint64_t mismatches_ = 0;
+};
+
+using driver = core_driver;
+
+#else
+
+//------------------------------------------------------------------
+// top_driver
+// Drives the poly1305 register interface, one bus access per
+// cycle, as the read_word() and write_word() tasks in
+// tb_poly1305.v.
+//------------------------------------------------------------------
+class top_driver {
+public:
+  top_driver(VerilatedContext *context, const cycle::timing &)
+    : dut_(context, "dut") {}
+
+  std::uint64_t cycles()     const { return cycles_; }
+  std::uint64_t mismatches() const { return mismatches_; }
+
+  void reset()
+  {
+    dut_.clk     = 0;
+    dut_.reset_n = 0;
+    dut_.cs      = 0;
+    dut_.we      = 0;
+    dut_.eval();
+    for (int i = 0 ; i < 4 ; i++) {
+      tick();
+    }
+    dut_.reset_n = 1;
+    dut_.eval();
+
+    if ((read(ADDR_NAME0) != 0x706f6c79) || (read(ADDR_NAME1) != 0x31333035)) {
+      mismatches_++;
+    }
+  }
+
+  void mac(std::uint8_t tag[16], const std::uint8_t *message,
+           std::size_t size, const std::uint8_t key[32])
+  {
+    for (int w = 0 ; w < 8 ; w++) {
+      write(ADDR_KEY0 + w, load32_be(&key[4 * w]));
+    }
+    write(ADDR_CTRL, 1 << CTRL_INIT_BIT);
+    wait_ready();
+
+    std::size_t i = 0;
+    do {
+      const std::size_t len = std::min<std::size_t>(16, size - i);
+      std::uint8_t block[16] = {};
+      std::copy(message + i, message + i + len, block);
+      for (int w = 0 ; w < 4 ; w++) {
+        write(ADDR_BLOCK0 + w, load32_be(&block[4 * w]));
+      }
+      write(ADDR_BLOCKLEN, (std::uint32_t)len);
+      write(ADDR_CTRL, 1 << CTRL_NEXT_BIT);
+      wait_ready();
+      i += 16;
+    } while (i < size);
+
+    write(ADDR_CTRL, 1 << CTRL_FINISH_BIT);
+    wait_ready();
+    for (int w = 0 ; w < 4 ; w++) {
+      store32_be(&tag[4 * w], read(ADDR_MAC0 + w));
+    }
+  }
+
+private:
+  enum {
+    ADDR_NAME0      = 0x00,
+    ADDR_NAME1      = 0x01,
+    ADDR_CTRL       = 0x08,
+    CTRL_INIT_BIT   = 0,
+    CTRL_NEXT_BIT   = 1,
+    CTRL_FINISH_BIT = 2,
+    ADDR_STATUS     = 0x09,
+    ADDR_BLOCKLEN   = 0x0a,
+    ADDR_KEY0       = 0x10,
+    ADDR_BLOCK0     = 0x20,
+    ADDR_MAC0       = 0x30
+  };
+
+  void tick()
+  {
+    dut_.clk = 1;
+    dut_.eval();
+    dut_.clk = 0;
+    dut_.eval();
+    cycles_++;
+  }
+
+  void write(unsigned address, std::uint32_t word)
+  {
+    dut_.cs         = 1;
+    dut_.we         = 1;
+    dut_.address    = (CData)address;
+    dut_.write_data = word;
+    tick();
+    dut_.cs = 0;
+    dut_.we = 0;
+  }
+
+  std::uint32_t read(unsigned address)
+  {
+    dut_.cs      = 1;
+    dut_.we      = 0;
+    dut_.address = (CData)address;
+    dut_.eval();
+    const std::uint32_t word = dut_.read_data;
+    tick();
+    dut_.cs = 0;
+    return word;
+  }
+
+  // The command reaches the core one cycle after the write, and
+  // the status register follows the core ready one cycle later,
+  // so the status is stale for two cycles after the write.
+  void wait_ready()
+  {
+    tick();
+    tick();
+    while ((read(ADDR_STATUS) & 1) == 0) {
+    }
+  }
+
+  Vdut          dut_;
+  std::uint64_t cycles_     = 0;
+  std::uint64_t mismatches_ = 0;
+};
+
+using driver = top_driver;
+
+#endif // VTB_TOP
+
+
+//------------------------------------------------------------------
+// Work shared by the threads. Messages 0 .. nb_random - 1 are
+// random, the rest are the corpus vectors in order.
+//------------------------------------------------------------------
+struct corpus_file {
+  const char      *path;
+  poly1305_corpus *corpus;
+  std::size_t      first;  // index of its first vector
+};
+
+struct regression {
+  cycle::timing            timing;
+  std::uint64_t            seed      = 1305;
+  std::size_t              max_size  = 1024;
+  std::size_t              nb_random = 0;
+  std::size_t              nb_total  = 0;
+  std::vector<corpus_file> corpora;
+  FILE                    *failures_out = nullptr;
+
+  std::mutex                report_lock;
+  std::atomic<std::size_t>  nb_failed{0};
+  std::atomic<std::size_t>  nb_mismatched{0};
+  std::atomic<std::uint64_t> nb_cycles{0};
+  std::size_t               nb_written = 0;
+};
+
+// Message number index, random or from a corpus. The expected tag
+// is from the corpus or from crypto_poly1305().
+static void get_message(const regression &reg, std::size_t index,
+                        std::vector<std::uint8_t> &message,
+                        std::uint8_t key[32], std::uint8_t expected[16])
+{
+  if (index < reg.nb_random) {
+    std::uint64_t state = reg.seed ^ (index * 0xd1342543de82ef95ULL);
+    const std::size_t size = splitmix64(state) % (reg.max_size + 1);
+    message.resize(size);
+    for (std::size_t i = 0 ; i < size ; i += 8) {
+      const std::uint64_t x = splitmix64(state);
+      for (std::size_t j = 0 ; (j < 8) && (i + j < size) ; j++) {
+        message[i + j] = (std::uint8_t)(x >> (8 * j));
+      }
+    }
+    for (int i = 0 ; i < 32 ; i += 8) {
+      const std::uint64_t x = splitmix64(state);
+      for (int j = 0 ; j < 8 ; j++) {
+        key[i + j] = (std::uint8_t)(x >> (8 * j));
+      }
+    }
+    crypto_poly1305(expected, message.data(), message.size(), key);
+    return;
+  }
+
+  std::size_t c = reg.corpora.size() - 1;
+  while (reg.corpora[c].first > index) {
+    c--;
+  }
+  poly1305_vector v;
+  poly1305_corpus_get(reg.corpora[c].corpus, index - reg.corpora[c].first, &v);
+  message.assign(v.message, v.message + v.message_size);
+  std::memcpy(key, v.key, 32);
+  std::memcpy(expected, v.tag, 16);
+}
+
+static void print_hex(const char *what, const std::uint8_t *data, std::size_t size)
+{
+  std::printf("  %s ", what);
+  for (std::size_t i = 0 ; i < size ; i++) {
+    std::printf("%02x", data[i]);
+  }
+  std::printf("\n");
+}
+
+// Report a failing message, and append it to the failures corpus
+// with the expected tag, so that it can be run again on its own.
+static void report_failure(regression &reg, std::size_t index,
+                           const std::vector<std::uint8_t> &message,
+                           const std::uint8_t key[32],
+                           const std::uint8_t expected[16],
+                           const std::uint8_t tag[16])
+{
+  std::lock_guard<std::mutex> guard(reg.report_lock);
+  const std::size_t n = reg.nb_failed++;
+  if (n < VTB_MAX_REPORTS) {
+    std::printf("Message %zu, %zu bytes: incorrect MAC.\n", index, message.size());
+    print_hex("key:     ", key, 32);
+    print_hex("expected:", expected, 16);
+    print_hex("got:     ", tag, 16);
+  }
+  if (reg.failures_out) {
+    std::uint8_t size[4] = {(std::uint8_t)message.size(),
+                            (std::uint8_t)(message.size() >> 8),
+                            (std::uint8_t)(message.size() >> 16),
+                            (std::uint8_t)(message.size() >> 24)};
+    std::fwrite(size, 1, 4, reg.failures_out);
+    std::fwrite(key, 1, 32, reg.failures_out);
+    std::fwrite(expected, 1, 16, reg.failures_out);
+    std::fwrite(message.data(), 1, message.size(), reg.failures_out);
+    reg.nb_written++;
+  }
+}
+
+
+//------------------------------------------------------------------
+// run_shard()
+// MAC messages first .. last - 1 on a DUT of its own.
+//------------------------------------------------------------------
+static void run_shard(regression &reg, std::size_t first, std::size_t last)
+{
+  VerilatedContext context;
+  driver dut(&context, reg.timing);
+  std::vector<std::uint8_t> message;
+  std::uint8_t key[32];
+  std::uint8_t expected[16];
+  std::uint8_t tag[16];
+
+  dut.reset();
+  for (std::size_t i = first ; i < last ; i++) {
+    get_message(reg, i, message, key, expected);
+    const std::uint64_t mismatches = dut.mismatches();
+    dut.mac(tag, message.data(), message.size(), key);
+    if (std::memcmp(tag, expected, 16) != 0) {
+      report_failure(reg, i, message, key, expected, tag);
+    }
+    else if (dut.mismatches() != mismatches) {
+      std::lock_guard<std::mutex> guard(reg.report_lock);
+      if (reg.nb_mismatched++ < VTB_MAX_REPORTS) {
+        std::printf("Message %zu, %zu bytes: cycle model mismatch.\n",
+                    i, message.size());
+      }
+    }
+  }
+  reg.nb_cycles += dut.cycles();
+}
+
+
+//------------------------------------------------------------------
+//------------------------------------------------------------------
+static void usage(const char *name)
+{
+  std::fprintf(stderr,
+               "Usage: %s [-j N] [-n N] [-s N] [-S SEED] [-o FILE]"
+               " [-a N] [-b N] [-m N] [-f N] [CORPUS...]\n"
+               "MAC N random messages and every vector of each CORPUS on the\n"
+               "Verilated DUT and check the tags against the C model.\n"
+               "  -j N     Number of threads, default all CPUs.\n"
+               "  -n N     Number of random messages, default 100000.\n"
+               "  -s N     Largest random message in bytes, default 1024.\n"
+               "  -S SEED  Seed of the random messages, default 1305.\n"
+               "  -o FILE  Write the failing messages as a corpus.\n"
+               "  -a, -b, -m, -f  Timing of the cycle accurate model, as\n"
+               "           for poly1305cycle, if the RTL has been changed.\n",
+               name);
+}
+
+
+//------------------------------------------------------------------
+// main()
+//------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  regression  reg;
+  long        nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *failures_path = nullptr;
+  int         opt;
+
+  reg.nb_random = 100000;
+  while ((opt = getopt(argc, argv, "j:n:s:S:o:a:b:m:f:h")) != -1) {
+    switch (opt) {
+    case 'j': nb_threads = std::atol(optarg); break;
+    case 'n': reg.nb_random = std::strtoull(optarg, nullptr, 0); break;
+    case 's': reg.max_size  = std::strtoull(optarg, nullptr, 0); break;
+    case 'S': reg.seed      = std::strtoull(optarg, nullptr, 0); break;
+    case 'o': failures_path = optarg; break;
+    case 'a': reg.timing.pre_cycles      = (unsigned)std::atoi(optarg); break;
+    case 'b': reg.timing.post_cycles     = (unsigned)std::atoi(optarg); break;
+    case 'm': reg.timing.mulacc_products = (unsigned)std::atoi(optarg); break;
+    case 'f': reg.timing.pipe_cycles     = (unsigned)std::atoi(optarg); break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if ((nb_threads < 1) || !cycle::valid(reg.timing)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  reg.nb_total = reg.nb_random;
+  for (int i = optind ; i < argc ; i++) {
+    poly1305_corpus *corpus = poly1305_corpus_open(argv[i]);
+    if (!corpus) {
+      std::fprintf(stderr, "%s: %s: %s\n", argv[0], argv[i], std::strerror(errno));
+      return 2;
+    }
+    reg.corpora.push_back({argv[i], corpus, reg.nb_total});
+    reg.nb_total += poly1305_corpus_count(corpus);
+  }
+
+  std::uint8_t header[12] = {};
+  if (failures_path) {
+    reg.failures_out = std::fopen(failures_path, "wb");
+    if (!reg.failures_out) {
+      std::fprintf(stderr, "%s: %s: %s\n", argv[0], failures_path,
+                   std::strerror(errno));
+      return 2;
+    }
+    std::fwrite(header, 1, sizeof(header), reg.failures_out);
+  }
+
+#ifdef VTB_TOP
+  const char *dut_name = "poly1305";
+#else
+  const char *dut_name = "poly1305_core";
+#endif
+  std::printf("%s: %zu messages, %zu random and %zu from %zu corpus files,"
+              " on %ld threads.\n", dut_name, reg.nb_total, reg.nb_random,
+              reg.nb_total - reg.nb_random, reg.corpora.size(), nb_threads);
+
+  // Contiguous shards, one per thread.
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  const std::size_t nb_shards = std::min<std::size_t>((std::size_t)nb_threads,
+                                                      reg.nb_total ? reg.nb_total : 1);
+  for (std::size_t t = 0 ; t < nb_shards ; t++) {
+    threads.emplace_back(run_shard, std::ref(reg),
+                         reg.nb_total * t / nb_shards,
+                         reg.nb_total * (t + 1) / nb_shards);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  if (reg.failures_out) {
+    // Patch the header with the number of vectors written.
+    const std::uint32_t words[3] = {POLY1305_CORPUS_MAGIC, POLY1305_CORPUS_VERSION,
+                                    (std::uint32_t)reg.nb_written};
+    for (int i = 0 ; i < 3 ; i++) {
+      for (int j = 0 ; j < 4 ; j++) {
+        header[4 * i + j] = (std::uint8_t)(words[i] >> (8 * j));
+      }
+    }
+    std::fseek(reg.failures_out, 0, SEEK_SET);
+    std::fwrite(header, 1, sizeof(header), reg.failures_out);
+    std::fclose(reg.failures_out);
+  }
+  for (corpus_file &c : reg.corpora) {
+    poly1305_corpus_close(c.corpus);
+  }
+
+  std::printf("%s: %zu failed, %zu cycle model mismatches.\n", dut_name,
+              reg.nb_failed.load(), reg.nb_mismatched.load());
+  std::printf("%s: %llu cycles in %.1f s, %.2f Mcycles/s, %.0f messages/s.\n",
+              dut_name, (unsigned long long)reg.nb_cycles.load(), elapsed.count(),
+              (double)reg.nb_cycles.load() / elapsed.count() * 1e-6,
+              (double)reg.nb_total / elapsed.count());
+
+  return (reg.nb_failed || reg.nb_mismatched) ? 1 : 0;
+}
+
+//======================================================================
+// EOF vtb_poly1305.cpp
+//======================================================================